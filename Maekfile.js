@@ -53,6 +53,11 @@ let copies = [
 	maek.COPY(`shaders/frag.spv`, `dist/frag.spv`),
 ];
 
+//only --quantize-vertices uses this one, and compile.sh has to have built it (with glslc):
+if (require('fs').existsSync(`shaders/vert_quantized.spv`)) {
+	copies.push(maek.COPY(`shaders/vert_quantized.spv`, `dist/vert_quantized.spv`));
+}
+
 //call rules on the maek object to specify tasks.
 // rules generally look like:
 //  output = maek.RULE_NAME(input [, output] [, {options}])
@@ -61,9 +66,39 @@ let copies = [
 // cppFile: name of c++ file to compile
 // objFileBase (optional): base name object file to produce (if not supplied, set to options.objDir + '/' + cppFile without the extension)
 //returns objFile: objFileBase + a platform-dependant suffix ('.o' or '.obj')
+//json structural index, also used to pick the vertex kernels:
+const jsonindex_obj = maek.CPP('jsonindex.cpp');
+
+//scene loading, shared by the game and the benchmark:
+const loader_objs = [
+	maek.CPP('jsonloader.cpp'),
+	maek.CPP('arena.cpp'),
+	maek.CPP('mappedfile.cpp'),
+	jsonindex_obj,
+	maek.CPP('sceneloader.cpp')
+];
+
+//vertex conversion kernels, shared by the game and their test:
+const vertexkernels_obj = maek.CPP('vertexkernels.cpp');
+
+//vertex packing for --quantize-vertices, shared by the game and its test:
+const vertexquantizer_obj = maek.CPP('vertexquantizer.cpp');
+
 const game_objs = [
 	maek.CPP('sceneviewer.cpp'),
-	maek.CPP('jsonloader.cpp'),
+	...loader_objs,
+	maek.CPP('scenecache.cpp'),
+	maek.CPP('meshloader.cpp'),
+	maek.CPP('sourcefilecache.cpp'),
+	maek.CPP('meshpipeline.cpp'),
+	vertexkernels_obj,
+	maek.CPP('meshindexer.cpp'),
+	maek.CPP('meshoptimizer.cpp'),
+	vertexquantizer_obj,
+	maek.CPP('meshletbuilder.cpp'),
+	maek.CPP('meshsimplifier.cpp'),
+	maek.CPP('uploadbatcher.cpp'),
+	maek.CPP('memoryallocator.cpp'),
 	maek.CPP('eventloader.cpp'),
 	maek.CPP('OrbitCamera.cpp'),
 	maek.CPP('rg_WindowGLFW.cpp'),
@@ -76,8 +111,20 @@ const game_objs = [
 //returns exeFile: exeFileBase + a platform-dependant suffix (e.g., '.exe' on windows)
 const game_exe = maek.LINK(game_objs, 'dist/game');
 
-//set the default target to the game (and copy the readme files):
-maek.TARGETS = [game_exe, ...copies];
+//scene loading microbenchmarks, run without a window or vulkan device:
+const benchmark_exe = maek.LINK([maek.CPP('benchmark.cpp'), ...loader_objs], 'dist/benchmark');
+
+//checks that the cursor and indexed json backends build the same trees:
+const json_test_exe = maek.LINK([maek.CPP('jsontest.cpp'), ...loader_objs], 'dist/json-test');
+
+//checks the simd vertex kernels against the scalar ones:
+const vertex_kernels_test_exe = maek.LINK([maek.CPP('vertexkernelstest.cpp'), vertexkernels_obj, jsonindex_obj], 'dist/vertex-kernels-test');
+
+//checks that quantized vertices decode to what they were packed from:
+const vertex_quantizer_test_exe = maek.LINK([maek.CPP('vertexquantizertest.cpp'), vertexquantizer_obj], 'dist/vertex-quantizer-test');
+
+//set the default target to the game, the benchmark and the tests (and copy the readme files):
+maek.TARGETS = [game_exe, benchmark_exe, json_test_exe, vertex_kernels_test_exe, vertex_quantizer_test_exe, ...copies];
 
 //======================================================================
 //Now, onward to the code that makes all this work:
@@ -0,0 +1,79 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// blocks keep doubling until they reach this size so big files don't end up with thousands of them
+static const size_t MAX_BLOCK_SIZE = 16 * 1024 * 1024;
+
+Arena::Arena(size_t firstBlockSize) {
+    current = nullptr;
+    remaining = 0;
+    nextBlockSize = firstBlockSize;
+    this->firstBlockSize = firstBlockSize;
+    reserved = 0;
+}
+
+Arena::~Arena() {
+    release();
+}
+
+void* Arena::allocate(size_t size, size_t alignment) {
+    if (size == 0) {
+        return nullptr;
+    }
+
+    size_t padding = (alignment - (reinterpret_cast<uintptr_t>(current) & (alignment - 1))) & (alignment - 1);
+
+    if (current == nullptr || padding + size > remaining) {
+        size_t blockSize = std::max(nextBlockSize, size + alignment);
+
+        char* block = static_cast<char*>(std::malloc(blockSize));
+
+        if (block == nullptr) {
+            throw std::bad_alloc();
+        }
+
+        blocks.push_back(block);
+        reserved += blockSize;
+
+        current = block;
+        remaining = blockSize;
+        nextBlockSize = std::min(nextBlockSize * 2, MAX_BLOCK_SIZE);
+
+        padding = (alignment - (reinterpret_cast<uintptr_t>(current) & (alignment - 1))) & (alignment - 1);
+    }
+
+    char* result = current + padding;
+
+    current += padding + size;
+    remaining -= padding + size;
+
+    return result;
+}
+
+std::string_view Arena::copyString(std::string_view str) {
+    char* copy = allocateArray<char>(str.size());
+
+    if (!str.empty()) {
+        std::memcpy(copy, str.data(), str.size());
+    }
+
+    return std::string_view(copy, str.size());
+}
+
+void Arena::release() {
+    for (char* block : blocks) {
+        std::free(block);
+    }
+
+    blocks.clear();
+
+    current = nullptr;
+    remaining = 0;
+    nextBlockSize = firstBlockSize;
+    reserved = 0;
+}
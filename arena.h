@@ -0,0 +1,45 @@
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// Bump allocator. Memory is handed out from large blocks and is only ever given back
+// all at once, either through release() or when the arena is destroyed. Nothing that
+// lives in an arena has its destructor run, so it should only hold trivially
+// destructible types.
+class Arena {
+public:
+
+    Arena(size_t firstBlockSize = 64 * 1024);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t alignment);
+
+    template<typename T>
+    T* allocateArray(size_t count) {
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    // copies the string into the arena, the returned view stays valid until release()
+    std::string_view copyString(std::string_view str);
+
+    void release();
+
+    size_t bytesReserved() const { return reserved; }
+
+private:
+
+    std::vector<char*> blocks;
+    char* current;
+    size_t remaining;
+    size_t nextBlockSize;
+    size_t firstBlockSize;
+    size_t reserved;
+};
+
+#endif // _ARENA_H
@@ -0,0 +1,634 @@
+// Scene loading microbenchmarks. Generates synthetic s72 files and times JsonLoader and
+// SceneLoader on them, without needing a window or a Vulkan device. Results are printed as
+// a table and appended to a JSON lines file so they can be tracked over time.
+//
+// usage: benchmark [--scale <factor>] [--repeat <count>] [--case <name>] [--dir <directory>] [--output <file>] [--keep-files]
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "jsonindex.h"
+#include "jsonloader.h"
+#include "scene.h"
+#include "sceneloader.h"
+
+// after the scene headers, windows.h defines near and far away
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+struct BenchmarkArguments {
+    double scale = 1.0;
+    uint32_t repeat = 3;
+    std::string caseName = "all";
+    std::string directory = "";
+    std::string outputFile = "benchmark-results.jsonl";
+    bool keepFiles = false;
+};
+
+// the shape of a generated scene
+struct SyntheticScene {
+    std::string name;
+    uint32_t nodeCount;
+    // children of node i are [first, first + count)
+    std::function<std::pair<uint32_t, uint32_t>(uint32_t)> children;
+    uint32_t driverCount;
+    uint32_t keyframeCount;
+};
+
+struct BenchmarkResult {
+    std::string caseName;
+    std::string run;
+    std::string backend;
+    uint64_t fileBytes;
+    uint32_t nodeCount;
+    uint64_t keyframeCount;
+    double bestSeconds;
+    double meanSeconds;
+    uint64_t rssBeforeBytes;
+    uint64_t peakRssBytes;
+};
+
+//----------------------------------------------------------------------
+// generator
+
+// the same file for the same arguments, so runs can be compared
+class SceneWriter {
+public:
+
+    explicit SceneWriter(const std::string& path) : out(path, std::ios::binary | std::ios::out | std::ios::trunc) {
+        if (!out) {
+            throw std::runtime_error("Couldn't write the benchmark scene " + path);
+        }
+
+        buffer.reserve(FLUSH_BYTES + 4096);
+    }
+
+    ~SceneWriter() {
+        flush();
+    }
+
+    SceneWriter& operator<<(const char* str) {
+        buffer += str;
+        flushIfFull();
+        return *this;
+    }
+
+    SceneWriter& operator<<(uint32_t value) {
+        char chars[16];
+        int length = std::snprintf(chars, sizeof(chars), "%u", value);
+        buffer.append(chars, length);
+        flushIfFull();
+        return *this;
+    }
+
+    // a float with a few digits, like an exporter would write
+    void writeFloat(float value) {
+        char chars[32];
+        int length = std::snprintf(chars, sizeof(chars), "%.6g", value);
+        buffer.append(chars, length);
+        flushIfFull();
+    }
+
+    // in [-range, range)
+    float nextRandom(float range) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return (static_cast<float>(state >> 40) / static_cast<float>(1 << 24) * 2.0f - 1.0f) * range;
+    }
+
+    void flush() {
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+private:
+
+    static const size_t FLUSH_BYTES = 1 << 20;
+
+    std::ofstream out;
+    std::string buffer;
+    uint64_t state = 0x853c49e6748fea9bull;
+
+    void flushIfFull() {
+        if (buffer.size() >= FLUSH_BYTES) {
+            flush();
+        }
+    }
+};
+
+// Layout of the top level array: the version string, the scene, the nodes, one mesh,
+// one camera and then the drivers. Every eighth node draws the mesh, the first one
+// also carries the camera.
+void writeSyntheticScene(const SyntheticScene& synthetic, const std::string& path) {
+    const uint32_t firstNode = 2;
+    const uint32_t meshIndex = firstNode + synthetic.nodeCount;
+    const uint32_t cameraIndex = meshIndex + 1;
+
+    SceneWriter writer(path);
+
+    writer << "[\"s72-v1\",\n";
+    writer << "{\"type\":\"SCENE\",\"name\":\"" << synthetic.name.c_str() << "\",\"roots\":[" << firstNode << "]},\n";
+
+    for (uint32_t i = 0; i < synthetic.nodeCount; i++) {
+        writer << "{\"type\":\"NODE\",\"name\":\"node" << i << "\",\"translation\":[";
+        writer.writeFloat(writer.nextRandom(10.0f));
+        writer << ",";
+        writer.writeFloat(writer.nextRandom(10.0f));
+        writer << ",";
+        writer.writeFloat(writer.nextRandom(10.0f));
+        writer << "],\"rotation\":[0,0,";
+        writer.writeFloat(0.70710677f);
+        writer << ",";
+        writer.writeFloat(0.70710677f);
+        writer << "],\"scale\":[1,1,1],\"children\":[";
+
+        std::pair<uint32_t, uint32_t> children = synthetic.children(i);
+
+        for (uint32_t c = 0; c < children.second; c++) {
+            if (c > 0) {
+                writer << ",";
+            }
+            writer << firstNode + children.first + c;
+        }
+
+        writer << "]";
+
+        if (i % 8 == 0) {
+            writer << ",\"mesh\":" << meshIndex;
+        }
+
+        if (i == 0) {
+            writer << ",\"camera\":" << cameraIndex;
+        }
+
+        writer << "},\n";
+    }
+
+    // the loaders don't read the .b72 file, so it doesn't have to exist
+    writer << "{\"type\":\"MESH\",\"name\":\"mesh\",\"topology\":\"TRIANGLE_LIST\",\"count\":36,\"attributes\":{";
+    writer << "\"POSITION\":{\"src\":\"benchmark.b72\",\"offset\":0,\"stride\":28,\"format\":\"R32G32B32_SFLOAT\"},";
+    writer << "\"NORMAL\":{\"src\":\"benchmark.b72\",\"offset\":12,\"stride\":28,\"format\":\"R32G32B32_SFLOAT\"},";
+    writer << "\"COLOR\":{\"src\":\"benchmark.b72\",\"offset\":24,\"stride\":28,\"format\":\"R8G8B8A8_UNORM\"}}},\n";
+
+    writer << "{\"type\":\"CAMERA\",\"name\":\"camera\",\"perspective\":{\"aspect\":1.777,\"vfov\":0.9,\"near\":0.1,\"far\":1000}}";
+
+    static const std::array<const char*, 3> channels = { "translation", "rotation", "scale" };
+
+    for (uint32_t d = 0; d < synthetic.driverCount; d++) {
+        const char* channel = channels[d % channels.size()];
+        uint32_t components = d % channels.size() == 1 ? 4 : 3;
+
+        writer << ",\n{\"type\":\"DRIVER\",\"name\":\"driver" << d << "\",\"node\":" << firstNode + d % synthetic.nodeCount;
+        writer << ",\"channel\":\"" << channel << "\",\"times\":[";
+
+        for (uint32_t k = 0; k < synthetic.keyframeCount; k++) {
+            if (k > 0) {
+                writer << ",";
+            }
+            writer.writeFloat(static_cast<float>(k) / 60.0f);
+        }
+
+        writer << "],\"values\":[";
+
+        for (uint32_t k = 0; k < synthetic.keyframeCount * components; k++) {
+            if (k > 0) {
+                writer << ",";
+            }
+            writer.writeFloat(writer.nextRandom(1.0f));
+        }
+
+        writer << "],\"interpolation\":\"LINEAR\"}";
+    }
+
+    writer << "\n]\n";
+}
+
+uint32_t scaled(double scale, uint32_t count) {
+    return std::max<uint32_t>(1, static_cast<uint32_t>(count * scale));
+}
+
+std::vector<SyntheticScene> getSyntheticScenes(double scale) {
+    std::vector<SyntheticScene> scenes;
+
+    // a single chain, the camera view matrices are generated recursively so keep it within the stack
+    uint32_t deepCount = scaled(scale, 10000);
+    scenes.push_back({ "deep", deepCount, [deepCount](uint32_t i) {
+        return i + 1 < deepCount ? std::make_pair(i + 1, 1u) : std::make_pair(0u, 0u);
+    }, 0, 0 });
+
+    // one node with every other node as a child
+    uint32_t wideCount = scaled(scale, 100000);
+    scenes.push_back({ "wide", wideCount, [wideCount](uint32_t i) {
+        return i == 0 ? std::make_pair(1u, wideCount - 1) : std::make_pair(0u, 0u);
+    }, 0, 0 });
+
+    // a balanced tree with eight children per node
+    uint32_t nodeCount = scaled(scale, 1000000);
+    scenes.push_back({ "nodes", nodeCount, [nodeCount](uint32_t i) {
+        uint64_t first = static_cast<uint64_t>(i) * 8 + 1;
+        if (first >= nodeCount) {
+            return std::make_pair(0u, 0u);
+        }
+        return std::make_pair(static_cast<uint32_t>(first), static_cast<uint32_t>(std::min<uint64_t>(8, nodeCount - first)));
+    }, 0, 0 });
+
+    // a few nodes animated by long drivers
+    scenes.push_back({ "keyframes", 9, [](uint32_t i) {
+        return i == 0 ? std::make_pair(1u, 8u) : std::make_pair(0u, 0u);
+    }, 9, scaled(scale, 100000) });
+
+    return scenes;
+}
+
+//----------------------------------------------------------------------
+// measuring
+
+// Linux can reset the peak so each run gets its own, elsewhere it's the peak of the whole process so far
+bool resetPeakRss() {
+#if defined(__linux__)
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+    clearRefs.flush();
+
+    return static_cast<bool>(clearRefs);
+#else
+    return false;
+#endif
+}
+
+#if defined(__linux__)
+uint64_t readProcStatus(const char* field) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+
+    while (std::getline(status, line)) {
+        if (line.rfind(field, 0) == 0) {
+            // e.g. "VmHWM:     1234 kB"
+            return std::stoull(line.substr(std::string(field).size())) * 1024;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+uint64_t getCurrentRss() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.WorkingSetSize;
+#elif defined(__linux__)
+    return readProcStatus("VmRSS:");
+#else
+    return 0;
+#endif
+}
+
+uint64_t getPeakRss() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+#if defined(__linux__)
+    uint64_t peak = readProcStatus("VmHWM:");
+    if (peak != 0) {
+        return peak;
+    }
+#endif
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+
+#if defined(__APPLE__)
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+std::string getBackendName(JsonLoader::Backend backend) {
+    if (backend == JsonLoader::Backend::INDEXED) {
+        return std::string("indexed (") + JsonIndex::getKernelName(JsonIndex::detectKernel()) + ")";
+    }
+
+    return "cursor";
+}
+
+// the loaders log their progress, which would drown out the table
+class SilenceOutput {
+public:
+
+    SilenceOutput() : previous(std::cout.rdbuf(nullptr)) {}
+
+    ~SilenceOutput() {
+        std::cout.rdbuf(previous);
+        std::cout.clear();
+    }
+
+private:
+
+    std::streambuf* previous;
+};
+
+BenchmarkResult runBenchmark(const BenchmarkArguments& args, const SyntheticScene& synthetic, const std::string& path,
+                             const std::string& run, JsonLoader::Backend backend, const std::function<void()>& load) {
+    BenchmarkResult result;
+    result.caseName = synthetic.name;
+    result.run = run;
+    result.backend = getBackendName(backend);
+    result.fileBytes = std::filesystem::file_size(path);
+    result.nodeCount = synthetic.nodeCount;
+    result.keyframeCount = static_cast<uint64_t>(synthetic.driverCount) * synthetic.keyframeCount;
+    result.bestSeconds = std::numeric_limits<double>::max();
+    result.meanSeconds = 0.0;
+
+    resetPeakRss();
+    result.rssBeforeBytes = getCurrentRss();
+
+    for (uint32_t i = 0; i < args.repeat; i++) {
+        auto start = std::chrono::steady_clock::now();
+
+        {
+            SilenceOutput silence;
+            load();
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        result.bestSeconds = std::min(result.bestSeconds, seconds);
+        result.meanSeconds += seconds / args.repeat;
+    }
+
+    result.peakRssBytes = getPeakRss();
+
+    return result;
+}
+
+std::vector<BenchmarkResult> runSyntheticScene(const BenchmarkArguments& args, const SyntheticScene& synthetic, const std::string& path) {
+    std::vector<BenchmarkResult> results;
+
+    static const std::array<JsonLoader::Backend, 2> backends = { JsonLoader::Backend::CURSOR, JsonLoader::Backend::INDEXED };
+
+    static const std::array<std::pair<const char*, SceneLoader::Parser>, 3> parsers = {{
+        { "scene-dom", SceneLoader::Parser::DOM },
+        { "scene-streaming", SceneLoader::Parser::STREAMING },
+        { "scene-parallel", SceneLoader::Parser::PARALLEL }
+    }};
+
+    for (JsonLoader::Backend backend : backends) {
+        results.push_back(runBenchmark(args, synthetic, path, "json-tree", backend, [&]() {
+            JsonLoader json(path, backend);
+            json.parseJson();
+        }));
+
+        for (const std::pair<const char*, SceneLoader::Parser>& parser : parsers) {
+            results.push_back(runBenchmark(args, synthetic, path, parser.first, backend, [&]() {
+                Scene scene;
+                SceneLoader(path, parser.second, backend).loadScene(scene);
+
+                if (scene.nodes.size() != synthetic.nodeCount || scene.drivers.size() != synthetic.driverCount) {
+                    throw std::runtime_error("The " + synthetic.name + " scene didn't load completely");
+                }
+            }));
+        }
+    }
+
+    return results;
+}
+
+//----------------------------------------------------------------------
+// reporting
+
+double toMegabytes(uint64_t bytes) {
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+void printResult(const BenchmarkResult& result) {
+    std::cout << std::left << std::setw(10) << result.caseName
+              << std::setw(17) << result.run
+              << std::setw(16) << result.backend
+              << std::right << std::fixed
+              << std::setw(10) << std::setprecision(4) << result.bestSeconds
+              << std::setw(10) << std::setprecision(1) << toMegabytes(result.fileBytes) / result.bestSeconds
+              << std::setw(14) << std::setprecision(0) << result.nodeCount / result.bestSeconds
+              << std::setw(11) << std::setprecision(1) << toMegabytes(result.peakRssBytes)
+              << std::endl;
+}
+
+std::string escapeJsonString(const std::string& str) {
+    std::string escaped;
+
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+
+    return escaped;
+}
+
+std::string getTimestamp() {
+    std::time_t now = std::time(nullptr);
+    char chars[32];
+
+    std::strftime(chars, sizeof(chars), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    return chars;
+}
+
+// one object per line, so a tracking script can append runs and read them back with any JSON parser
+void writeResults(const BenchmarkArguments& args, const std::vector<BenchmarkResult>& results, bool peakRssPerRun) {
+    std::ofstream out(args.outputFile, std::ios::app);
+
+    if (!out) {
+        throw std::runtime_error("Couldn't write the benchmark results to " + args.outputFile);
+    }
+
+    std::string timestamp = getTimestamp();
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (const BenchmarkResult& result : results) {
+        std::ostringstream line;
+        line << std::setprecision(9);
+
+        line << "{\"timestamp\":\"" << timestamp << "\""
+             << ",\"case\":\"" << escapeJsonString(result.caseName) << "\""
+             << ",\"run\":\"" << escapeJsonString(result.run) << "\""
+             << ",\"backend\":\"" << escapeJsonString(result.backend) << "\""
+             << ",\"threads\":" << threads
+             << ",\"scale\":" << args.scale
+             << ",\"repeat\":" << args.repeat
+             << ",\"file_bytes\":" << result.fileBytes
+             << ",\"nodes\":" << result.nodeCount
+             << ",\"keyframes\":" << result.keyframeCount
+             << ",\"best_seconds\":" << result.bestSeconds
+             << ",\"mean_seconds\":" << result.meanSeconds
+             << ",\"mb_per_second\":" << toMegabytes(result.fileBytes) / result.bestSeconds
+             << ",\"nodes_per_second\":" << result.nodeCount / result.bestSeconds
+             << ",\"rss_before_bytes\":" << result.rssBeforeBytes
+             << ",\"peak_rss_bytes\":" << result.peakRssBytes
+             << ",\"peak_rss_per_run\":" << (peakRssPerRun ? "true" : "false")
+             << "}";
+
+        out << line.str() << "\n";
+    }
+}
+
+//----------------------------------------------------------------------
+// arguments
+
+void handleArgScale(BenchmarkArguments& args, const std::array<std::string, 2>& arr) {
+    try {
+        args.scale = std::stod(arr[1]);
+    } catch (const std::exception& e) {
+        throw std::invalid_argument("Unexpected scale: " + arr[1]);
+    }
+
+    if (args.scale <= 0.0) {
+        throw std::invalid_argument("Unexpected scale: " + arr[1] + " (must be greater than 0)");
+    }
+}
+
+void handleArgRepeat(BenchmarkArguments& args, const std::array<std::string, 2>& arr) {
+    try {
+        args.repeat = static_cast<uint32_t>(std::stoul(arr[1]));
+    } catch (const std::exception& e) {
+        throw std::invalid_argument("Unexpected repeat count: " + arr[1]);
+    }
+
+    if (args.repeat == 0) {
+        throw std::invalid_argument("Unexpected repeat count: " + arr[1] + " (must be at least 1)");
+    }
+}
+
+void handleArgCase(BenchmarkArguments& args, const std::array<std::string, 2>& arr) {
+    args.caseName = arr[1];
+
+    if (args.caseName != "all" && args.caseName != "deep" && args.caseName != "wide" && args.caseName != "nodes" && args.caseName != "keyframes") {
+        throw std::runtime_error("Unexpected benchmark case: " + args.caseName + " (must be \"all\", \"deep\", \"wide\", \"nodes\" or \"keyframes\")");
+    }
+}
+
+BenchmarkArguments processCLIArgs(int argc, char* argv[]) {
+    BenchmarkArguments args;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--scale" && hasValue) {
+            handleArgScale(args, std::array<std::string, 2>{ argv[i], argv[i+1] });
+            i++;
+        } else if (arg == "--repeat" && hasValue) {
+            handleArgRepeat(args, std::array<std::string, 2>{ argv[i], argv[i+1] });
+            i++;
+        } else if (arg == "--case" && hasValue) {
+            handleArgCase(args, std::array<std::string, 2>{ argv[i], argv[i+1] });
+            i++;
+        } else if (arg == "--dir" && hasValue) {
+            args.directory = argv[i+1];
+            i++;
+        } else if (arg == "--output" && hasValue) {
+            args.outputFile = argv[i+1];
+            i++;
+        } else if (arg == "--keep-files") {
+            args.keepFiles = true;
+        } else {
+            throw std::invalid_argument("Unknown or incomplete command-line argument: " + arg);
+        }
+    }
+
+    if (args.directory == "") {
+        args.directory = (std::filesystem::temp_directory_path() / "s72-benchmark").string();
+    }
+
+    return args;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        BenchmarkArguments args = processCLIArgs(argc, argv);
+
+        std::filesystem::create_directories(args.directory);
+
+        bool peakRssPerRun = resetPeakRss();
+
+        std::cout << "scale " << args.scale << ", best of " << args.repeat << ", "
+                  << std::max(1u, std::thread::hardware_concurrency()) << " threads" << std::endl;
+
+        if (!peakRssPerRun) {
+            std::cout << "peak RSS can't be reset on this platform, it is the peak of the whole process so far" << std::endl;
+        }
+
+        std::vector<BenchmarkResult> results;
+
+        for (const SyntheticScene& synthetic : getSyntheticScenes(args.scale)) {
+            if (args.caseName != "all" && args.caseName != synthetic.name) {
+                continue;
+            }
+
+            std::string path = (std::filesystem::path(args.directory) / (synthetic.name + ".s72")).string();
+
+            std::cout << std::endl << "GENERATING " << path << "..." << std::endl;
+            writeSyntheticScene(synthetic, path);
+            std::cout << std::fixed << std::setprecision(1) << toMegabytes(std::filesystem::file_size(path)) << " MB, "
+                      << synthetic.nodeCount << " nodes, " << synthetic.driverCount * synthetic.keyframeCount << " keyframes" << std::endl << std::endl;
+
+            std::cout << std::left << std::setw(10) << "case" << std::setw(17) << "run" << std::setw(16) << "backend"
+                      << std::right << std::setw(10) << "seconds" << std::setw(10) << "MB/s"
+                      << std::setw(14) << "nodes/s" << std::setw(11) << "peak MB" << std::endl;
+
+            for (const BenchmarkResult& result : runSyntheticScene(args, synthetic, path)) {
+                printResult(result);
+                results.push_back(result);
+            }
+
+            if (!args.keepFiles) {
+                std::filesystem::remove(path);
+            }
+        }
+
+        writeResults(args, results, peakRssPerRun);
+
+        std::cout << std::endl << "Appended " << results.size() << " results to " << args.outputFile << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
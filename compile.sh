@@ -1,6 +1,7 @@
 cd shaders
 
 glslc shader.vert -o vert.spv
+glslc shader_quantized.vert -o vert_quantized.spv
 glslc shader.frag -o frag.spv
 
 cd ..
\ No newline at end of file
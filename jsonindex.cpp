@@ -0,0 +1,289 @@
+#include "jsonindex.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define JSON_INDEX_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// lets the AVX2 kernel live in the same file without compiling everything else with -mavx2
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace {
+
+// per-byte classification of one 64 byte block, bit i is set if byte i matches
+struct BlockMasks {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op; // { } [ ] : ,
+    uint64_t whitespace;
+};
+
+// carried from one block to the next
+struct IndexState {
+    uint64_t endsOddBackslash = 0;
+    uint64_t inString = 0;
+    uint64_t endsInValue = 0;
+};
+
+typedef void (*ClassifyFn)(const char* block, BlockMasks& masks);
+
+void classifyScalar(const char* block, BlockMasks& masks) {
+    masks = {};
+
+    for (int i = 0; i < 64; i++) {
+        uint64_t bit = uint64_t(1) << i;
+
+        switch (block[i]) {
+            case '"':
+                masks.quote |= bit;
+                break;
+            case '\\':
+                masks.backslash |= bit;
+                break;
+            case '{': case '}': case '[': case ']': case ':': case ',':
+                masks.op |= bit;
+                break;
+            case ' ': case '\t': case '\n': case '\r':
+                masks.whitespace |= bit;
+                break;
+        }
+    }
+}
+
+#ifdef JSON_INDEX_X86
+inline __m128i matchSSE2(__m128i chunk, char c) {
+    return _mm_cmpeq_epi8(chunk, _mm_set1_epi8(c));
+}
+
+void classifySSE2(const char* block, BlockMasks& masks) {
+    masks = {};
+
+    for (int i = 0; i < 4; i++) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i * 16));
+
+        __m128i op = _mm_or_si128(
+            _mm_or_si128(matchSSE2(chunk, '{'), matchSSE2(chunk, '}')),
+            _mm_or_si128(
+                _mm_or_si128(matchSSE2(chunk, '['), matchSSE2(chunk, ']')),
+                _mm_or_si128(matchSSE2(chunk, ':'), matchSSE2(chunk, ','))));
+
+        __m128i whitespace = _mm_or_si128(
+            _mm_or_si128(matchSSE2(chunk, ' '), matchSSE2(chunk, '\t')),
+            _mm_or_si128(matchSSE2(chunk, '\n'), matchSSE2(chunk, '\r')));
+
+        int shift = i * 16;
+
+        masks.quote |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(matchSSE2(chunk, '"')))) << shift;
+        masks.backslash |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(matchSSE2(chunk, '\\')))) << shift;
+        masks.op |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(op))) << shift;
+        masks.whitespace |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(whitespace))) << shift;
+    }
+}
+
+TARGET_AVX2 inline __m256i matchAVX2(__m256i chunk, char c) {
+    return _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(c));
+}
+
+TARGET_AVX2 void classifyAVX2(const char* block, BlockMasks& masks) {
+    masks = {};
+
+    for (int i = 0; i < 2; i++) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i * 32));
+
+        __m256i op = _mm256_or_si256(
+            _mm256_or_si256(matchAVX2(chunk, '{'), matchAVX2(chunk, '}')),
+            _mm256_or_si256(
+                _mm256_or_si256(matchAVX2(chunk, '['), matchAVX2(chunk, ']')),
+                _mm256_or_si256(matchAVX2(chunk, ':'), matchAVX2(chunk, ','))));
+
+        __m256i whitespace = _mm256_or_si256(
+            _mm256_or_si256(matchAVX2(chunk, ' '), matchAVX2(chunk, '\t')),
+            _mm256_or_si256(matchAVX2(chunk, '\n'), matchAVX2(chunk, '\r')));
+
+        int shift = i * 32;
+
+        masks.quote |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(matchAVX2(chunk, '"')))) << shift;
+        masks.backslash |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(matchAVX2(chunk, '\\')))) << shift;
+        masks.op |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(op))) << shift;
+        masks.whitespace |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(whitespace))) << shift;
+    }
+}
+#endif
+
+inline uint32_t trailingZeros(uint64_t x) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return static_cast<uint32_t>(index);
+#else
+    return static_cast<uint32_t>(__builtin_ctzll(x));
+#endif
+}
+
+// bit i of the result is the xor of bits 0..i of x
+inline uint64_t prefixXor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+
+    return x;
+}
+
+// marks the characters that follow an odd-length run of backslashes, i.e. the escaped ones
+inline uint64_t findEscaped(uint64_t backslash, uint64_t& endsOddBackslash) {
+    const uint64_t evenBits = 0x5555555555555555ULL;
+    const uint64_t oddBits = ~evenBits;
+
+    uint64_t startEdges = backslash & ~(backslash << 1);
+
+    // a run that started in the previous block flips the parity of bit 0
+    uint64_t evenStartMask = evenBits ^ endsOddBackslash;
+    uint64_t evenStarts = startEdges & evenStartMask;
+    uint64_t oddStarts = startEdges & ~evenStartMask;
+
+    uint64_t evenCarries = backslash + evenStarts;
+    uint64_t oddCarries = backslash + oddStarts;
+    bool overflow = oddCarries < backslash;
+
+    oddCarries |= endsOddBackslash;
+    endsOddBackslash = overflow ? 1 : 0;
+
+    uint64_t evenCarryEnds = evenCarries & ~backslash;
+    uint64_t oddCarryEnds = oddCarries & ~backslash;
+
+    return (evenCarryEnds & oddBits) | (oddCarryEnds & evenBits);
+}
+
+inline void indexBlock(const BlockMasks& masks, IndexState& state, uint32_t blockOffset, std::vector<uint32_t>& positions) {
+    uint64_t quotes = masks.quote & ~findEscaped(masks.backslash, state.endsOddBackslash);
+
+    // covers each opening quote and the string contents, but not the closing quote
+    uint64_t inString = prefixXor(quotes) ^ state.inString;
+    state.inString = static_cast<uint64_t>(static_cast<int64_t>(inString) >> 63);
+
+    uint64_t stringChars = inString | quotes;
+
+    // anything else that isn't whitespace is part of a number (or an invalid literal), only its first character is indexed
+    uint64_t value = ~(masks.op | masks.whitespace | stringChars);
+    uint64_t valueStarts = value & ~((value << 1) | state.endsInValue);
+    state.endsInValue = value >> 63;
+
+    uint64_t tokens = (masks.op & ~stringChars) | quotes | valueStarts;
+
+    while (tokens) {
+        positions.push_back(blockOffset + trailingZeros(tokens));
+        tokens &= tokens - 1;
+    }
+}
+
+void buildIndex(const char* data, size_t size, ClassifyFn classify, std::vector<uint32_t>& positions) {
+    IndexState state;
+    BlockMasks masks;
+
+    size_t offset = 0;
+
+    for (; offset + 64 <= size; offset += 64) {
+        classify(data + offset, masks);
+        indexBlock(masks, state, static_cast<uint32_t>(offset), positions);
+    }
+
+    if (offset < size) {
+        // pad the last block with whitespace so it can go through the same path
+        char tail[64];
+        std::memset(tail, ' ', sizeof(tail));
+        std::memcpy(tail, data + offset, size - offset);
+
+        classify(tail, masks);
+        indexBlock(masks, state, static_cast<uint32_t>(offset), positions);
+    }
+
+    if (state.inString) {
+        throw std::runtime_error("Error parsing JSON: Unterminated string");
+    }
+}
+
+} // namespace
+
+JsonIndex::Kernel JsonIndex::detectKernel() {
+#ifdef JSON_INDEX_X86
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        return Kernel::AVX2;
+    }
+
+    if (__builtin_cpu_supports("sse2")) {
+        return Kernel::SSE2;
+    }
+#elif defined(_MSC_VER)
+    int info[4];
+
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0;
+
+    // the OS also has to save the ymm registers on context switches
+    if (avx2 && avx && osxsave && (_xgetbv(0) & 6) == 6) {
+        return Kernel::AVX2;
+    }
+
+    if (sse2) {
+        return Kernel::SSE2;
+    }
+#endif
+#endif
+
+    return Kernel::SCALAR;
+}
+
+const char* JsonIndex::getKernelName(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::AVX2:
+            return "avx2";
+        case Kernel::SSE2:
+            return "sse2";
+        default:
+            return "scalar";
+    }
+}
+
+void JsonIndex::build(const char* data, size_t size, Kernel kernel, std::vector<uint32_t>& positions) {
+    if (size > UINT32_MAX) {
+        throw std::runtime_error("Error parsing JSON: files over 4GB can't be indexed");
+    }
+
+    ClassifyFn classify = classifyScalar;
+
+#ifdef JSON_INDEX_X86
+    if (kernel == Kernel::AVX2) {
+        classify = classifyAVX2;
+    } else if (kernel == Kernel::SSE2) {
+        classify = classifySSE2;
+    }
+#endif
+
+    positions.clear();
+
+    // scene files are mostly short numbers, so there tends to be a token every few bytes
+    positions.reserve(size / 4);
+
+    buildIndex(data, size, classify, positions);
+}
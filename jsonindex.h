@@ -0,0 +1,33 @@
+#ifndef _JSON_INDEX_H
+#define _JSON_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Stage 1 of the indexed JSON backend (in the style of simdjson). The input is
+// classified 64 bytes at a time into bitmasks, and the masks are turned into a list
+// of the byte offsets where tokens start:
+//   - every structural character ({ } [ ] : ,) outside of a string
+//   - both the opening and the closing quote of every string
+//   - the first character of every other value (numbers)
+// JsonLoader then walks that list instead of looking at every byte.
+class JsonIndex {
+public:
+
+    // which instructions are used to classify the bytes, every kernel produces the same index
+    enum class Kernel {
+        SCALAR,
+        SSE2,
+        AVX2
+    };
+
+    // the fastest kernel this CPU supports
+    static Kernel detectKernel();
+    static const char* getKernelName(Kernel kernel);
+
+    // throws if the input ends inside of a string
+    static void build(const char* data, size_t size, Kernel kernel, std::vector<uint32_t>& positions);
+};
+
+#endif // _JSON_INDEX_H
@@ -1,26 +1,320 @@
 #include "jsonloader.h"
 
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <cctype>
 
-JsonLoader::JsonLoader(std::string fileName) {
-    fileStream.open(fileName, std::ios::in);
+// what JSON counts as whitespace, the same bytes JsonIndex skips (std::isspace also takes \v and \f)
+static bool isJsonWhitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// the characters JsonIndex indexes outside of a string, besides the first one of a number
+static bool isStructural(char c) {
+    return c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',' || c == '"';
+}
+
+// numbers are converted in place from the mapped file with from_chars, which doesn't allocate or look at the locale
+
+static bool isIntegerToken(std::string_view value) {
+    // -0 has to stay a float to keep its sign, rotations are full of them
+    return value.find_first_of(".eE") == std::string_view::npos && value != "-0";
+}
+
+static float toFloat(std::string_view value) {
+    float number = 0.0f;
+
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    std::from_chars_result result = std::from_chars(value.data(), value.data() + value.size(), number);
+
+    bool outOfRange = result.ec == std::errc::result_out_of_range;
+    bool invalid = result.ec != std::errc() || result.ptr != value.data() + value.size();
+#else
+    // older standard libraries (libc++) only have the integer overloads
+    char buffer[64];
+
+    if (value.size() >= sizeof(buffer)) {
+        throw std::runtime_error("Error parsing JSON: Invalid number: " + std::string(value));
+    }
+
+    std::memcpy(buffer, value.data(), value.size());
+    buffer[value.size()] = '\0';
+
+    char* parsedEnd;
+    errno = 0;
+    number = std::strtof(buffer, &parsedEnd);
+
+    bool outOfRange = errno == ERANGE;
+    bool invalid = parsedEnd != buffer + value.size();
+#endif
+
+    if (outOfRange) {
+        throw std::runtime_error("Error parsing JSON: Number out of range: " + std::string(value));
+    }
+
+    if (invalid) {
+        throw std::runtime_error("Error parsing JSON: Invalid number: " + std::string(value));
+    }
+
+    return number;
+}
+
+// returns false if the value doesn't fit, so it can be read as a float instead
+static bool toInteger(std::string_view value, int64_t& integer) {
+    std::from_chars_result result = std::from_chars(value.data(), value.data() + value.size(), integer);
+
+    if (result.ec == std::errc::result_out_of_range) {
+        return false;
+    }
+
+    if (result.ec != std::errc() || result.ptr != value.data() + value.size()) {
+        throw std::runtime_error("Error parsing JSON: Invalid number: " + std::string(value));
+    }
+
+    return true;
+}
+
+static int64_t floatToInteger(float number) {
+    if (std::trunc(number) != number || std::fabs(number) >= 9.2e18f) {
+        throw std::runtime_error("Error reading JSON: Expected an integer");
+    }
+
+    return static_cast<int64_t>(number);
+}
+
+static int64_t integerTokenToInteger(std::string_view value) {
+    int64_t integer;
+
+    if (isIntegerToken(value) && toInteger(value, integer)) {
+        return integer;
+    }
+
+    return floatToInteger(toFloat(value));
+}
+
+// The commas and the closing bracket of a NUMBER_ARRAY were already checked when it was
+// skimmed, so its text only has to be split. Calls f with the first count elements.
+template<typename F>
+static void forEachLazyNumber(const char* first, size_t count, F f) {
+    const char* cursor = first;
+
+    for (size_t i = 0; i < count; i++) {
+        while (isJsonWhitespace(*cursor)) {
+            cursor++;
+        }
+
+        const char* start = cursor;
+
+        while (*cursor != ',' && *cursor != ']' && !isJsonWhitespace(*cursor)) {
+            cursor++;
+        }
+
+        f(i, std::string_view(start, cursor - start));
+
+        while (isJsonWhitespace(*cursor)) {
+            cursor++;
+        }
+
+        cursor++; // the comma
+    }
+}
+
+namespace {
+
+struct KnownKey {
+    const char* name;
+    JsonLoader::Key key;
+};
+
+// in the same order as JsonLoader::Key
+const KnownKey KNOWN_KEYS[] = {
+    { "", JsonLoader::Key::OTHER },
+    { "type", JsonLoader::Key::TYPE },
+    { "name", JsonLoader::Key::NAME },
+    { "roots", JsonLoader::Key::ROOTS },
+    { "translation", JsonLoader::Key::TRANSLATION },
+    { "rotation", JsonLoader::Key::ROTATION },
+    { "scale", JsonLoader::Key::SCALE },
+    { "children", JsonLoader::Key::CHILDREN },
+    { "camera", JsonLoader::Key::CAMERA },
+    { "mesh", JsonLoader::Key::MESH },
+    { "topology", JsonLoader::Key::TOPOLOGY },
+    { "count", JsonLoader::Key::COUNT },
+    { "indices", JsonLoader::Key::INDICES },
+    { "attributes", JsonLoader::Key::ATTRIBUTES },
+    { "src", JsonLoader::Key::SRC },
+    { "offset", JsonLoader::Key::OFFSET },
+    { "stride", JsonLoader::Key::STRIDE },
+    { "format", JsonLoader::Key::FORMAT },
+    { "perspective", JsonLoader::Key::PERSPECTIVE },
+    { "aspect", JsonLoader::Key::ASPECT },
+    { "vfov", JsonLoader::Key::VFOV },
+    { "near", JsonLoader::Key::NEAR_PLANE },
+    { "far", JsonLoader::Key::FAR_PLANE },
+    { "node", JsonLoader::Key::NODE },
+    { "channel", JsonLoader::Key::CHANNEL },
+    { "times", JsonLoader::Key::TIMES },
+    { "values", JsonLoader::Key::VALUES },
+    { "interpolation", JsonLoader::Key::INTERPOLATION }
+};
+
+const size_t KNOWN_KEY_COUNT = sizeof(KNOWN_KEYS) / sizeof(KNOWN_KEYS[0]);
+
+// open addressing on the hash, with plenty of empty slots so a probe rarely goes past the first one
+class KnownKeyTable {
+public:
+
+    KnownKeyTable() {
+        slots.fill(nullptr);
+
+        for (size_t i = 1; i < KNOWN_KEY_COUNT; i++) {
+            const KnownKey* known = &KNOWN_KEYS[i];
+            uint32_t hash = JsonLoader::hashKey(known->name);
+
+            size_t slot = hash & (SLOT_COUNT - 1);
+            while (slots[slot] != nullptr) {
+                slot = (slot + 1) & (SLOT_COUNT - 1);
+            }
+
+            slots[slot] = known;
+            hashes[slot] = hash;
+        }
+    }
+
+    JsonLoader::Key find(std::string_view key, uint32_t hash) const {
+        size_t slot = hash & (SLOT_COUNT - 1);
+
+        while (slots[slot] != nullptr) {
+            if (hashes[slot] == hash && key == slots[slot]->name) {
+                return slots[slot]->key;
+            }
+
+            slot = (slot + 1) & (SLOT_COUNT - 1);
+        }
+
+        return JsonLoader::Key::OTHER;
+    }
+
+private:
+
+    static const size_t SLOT_COUNT = 128;
+
+    std::array<const KnownKey*, SLOT_COUNT> slots;
+    std::array<uint32_t, SLOT_COUNT> hashes;
+};
+
+} // namespace
+
+uint32_t JsonLoader::hashKey(std::string_view key) {
+    uint32_t hash = 2166136261u;
+
+    for (char c : key) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+JsonLoader::Key JsonLoader::internKey(std::string_view key, uint32_t hash) {
+    static const KnownKeyTable table;
+
+    return table.find(key, hash);
+}
+
+const char* JsonLoader::getKeyName(Key key) {
+    size_t i = static_cast<size_t>(key);
+
+    return i < KNOWN_KEY_COUNT ? KNOWN_KEYS[i].name : "";
+}
+
+JsonLoader::JsonLoader(std::string fileName, Backend backend)
+    : JsonLoader(fileName, backend, JsonIndex::detectKernel()) {
+}
+
+JsonLoader::JsonLoader(std::string fileName, Backend backend, JsonIndex::Kernel kernel) {
     root = nullptr;
-    prevPos = 0;
+    lazyArrays = false;
 
-    if (fileStream.fail()) {
+    if (!file.open(fileName)) {
         throw std::runtime_error("Failed to open scene file: " + fileName);
     }
+
+    data = file.data();
+
+    cursor = data;
+    end = data + file.size();
+    prevPos = cursor;
+
+    index = nullptr;
+    nextStructural = 0;
+    prevStructural = 0;
+    endStructural = 0;
+    unindexed = nullptr;
+    prevUnindexed = nullptr;
+
+    this->kernel = kernel;
+
+    if (backend == Backend::AUTO) {
+        // the index isn't paying for itself yet: in the benchmark the tree is built a little slower
+        // from it, even with AVX2, and it takes 4 bytes per structural character on top of the file
+        backend = Backend::CURSOR;
+    }
+
+    this->backend = backend;
+
+    if (backend == Backend::INDEXED) {
+        JsonIndex::build(file.data(), file.size(), kernel, structurals);
+
+        index = structurals.data();
+        endStructural = structurals.size();
+    }
+}
+
+JsonLoader::JsonLoader(const JsonLoader& source, Position begin, Position end) {
+    root = nullptr;
+    lazyArrays = source.lazyArrays;
+
+    data = source.data;
+    backend = source.backend;
+    kernel = source.kernel;
+
+    cursor = begin.cursor;
+    this->end = end.cursor;
+    prevPos = cursor;
+
+    index = source.index;
+    nextStructural = begin.structural;
+    prevStructural = begin.structural;
+    endStructural = end.structural;
+    unindexed = nullptr;
+    prevUnindexed = nullptr;
+}
+
+std::string JsonLoader::getBackendName() const {
+    if (backend == Backend::INDEXED) {
+        return std::string("indexed (") + JsonIndex::getKernelName(kernel) + ")";
+    }
+
+    return "cursor";
 }
 
 JsonLoader::JsonNode* JsonLoader::parseJson() {
-    while (!fileStream.eof()) {
+    while (hasMoreTokens()) {
         try {
-            JsonNode* node = parseNode();
+            JsonNode node = parseNode();
 
             if (!root) {
-                root = node;
+                root = arena.allocateArray<JsonNode>(1);
+                *root = node;
             }
         } catch (const std::logic_error& e) {
             break;
@@ -30,23 +324,29 @@ JsonLoader::JsonNode* JsonLoader::parseJson() {
     return root;
 }
 
-JsonLoader::JsonNode* JsonLoader::parseObject() {
-    JsonNode* node = new JsonNode();
-    node->type = JsonNode::Type::OBJECT;
+JsonLoader::JsonNode JsonLoader::parseObject() {
+    size_t firstMember = memberStack.size();
 
-    std::map<std::string, JsonNode*>* obj = new std::map<std::string, JsonNode*>();
+    // an empty object closes straight away
+    bool completed = hasMoreTokens() && peekToken() == Token::Type::CURLY_CLOSE;
+    if (completed) {
+        getToken();
+    }
 
-    bool completed = false;
     while (!completed) {
-        if (fileStream.eof()) {
+        if (!hasMoreTokens()) {
             throw std::logic_error("No more tokens");
         } else {
             Token token = getToken();
-            std::string key = token.value;
+            std::string_view key = arena.copyString(token.value);
+            uint32_t hash = hashKey(key);
+            Key id = internKey(key, hash);
 
-            getToken(); // get the comma
+            getToken(); // get the colon
 
-            (*obj)[key] = parseNode();
+            // parse the value first, nested containers use the stack above this object's members
+            JsonNode value = parseNode();
+            memberStack.push_back({ key, hash, id, value });
 
             token = getToken();
             if (token.type == Token::Type::CURLY_CLOSE) {
@@ -54,23 +354,37 @@ JsonLoader::JsonNode* JsonLoader::parseObject() {
             }
         }
     }
-    node->value = obj;
+
+    JsonNode node{};
+    node.type = JsonNode::Type::OBJECT;
+    node.count = static_cast<uint32_t>(memberStack.size() - firstMember);
+    node.members = arena.allocateArray<JsonMember>(node.count);
+
+    std::copy(memberStack.begin() + firstMember, memberStack.end(), node.members);
+    memberStack.resize(firstMember);
 
     return node;
 }
 
-JsonLoader::JsonNode* JsonLoader::parseArray() {
-    JsonNode* node = new JsonNode();
-    node->type = JsonNode::Type::ARRAY;
+JsonLoader::JsonNode JsonLoader::parseArray() {
+    JsonNode lazyNode{};
+    if (lazyArrays && skimNumberArray(lazyNode)) {
+        return lazyNode;
+    }
+
+    size_t firstElement = elementStack.size();
 
-    std::vector<JsonNode*>* arr = new std::vector<JsonNode*>();
+    bool completed = hasMoreTokens() && peekToken() == Token::Type::ARRAY_CLOSE;
+    if (completed) {
+        getToken();
+    }
 
-    bool completed = false;
     while (!completed) {
-        if (fileStream.eof()) {
+        if (!hasMoreTokens()) {
             throw std::logic_error("No more tokens");
         } else {
-            arr->push_back(parseNode());
+            JsonNode element = parseNode();
+            elementStack.push_back(element);
 
             Token token = getToken();
             if (token.type == Token::Type::ARRAY_CLOSE) {
@@ -78,33 +392,87 @@ JsonLoader::JsonNode* JsonLoader::parseArray() {
             }
         }
     }
-    node->value = arr;
+
+    JsonNode node{};
+    node.type = JsonNode::Type::ARRAY;
+    node.count = static_cast<uint32_t>(elementStack.size() - firstElement);
+    node.elements = arena.allocateArray<JsonNode>(node.count);
+
+    std::copy(elementStack.begin() + firstElement, elementStack.end(), node.elements);
+    elementStack.resize(firstElement);
 
     return node;
 }
 
-JsonLoader::JsonNode* JsonLoader::parseString() {
-    JsonNode* node = new JsonNode();
-    node->type = JsonNode::Type::STRING;
+// returns false and leaves the loader where it was if the array holds anything but numbers
+bool JsonLoader::skimNumberArray(JsonNode& node) {
+    Position start = tell();
 
-    Token token = getToken();
-    node->value = token.value;
+    const char* first = nullptr;
+    uint32_t count = 0;
+
+    while (hasMoreTokens()) {
+        Token token = getToken();
+
+        if (token.type != Token::Type::NUMBER) {
+            break;
+        }
+
+        if (first == nullptr) {
+            first = token.value.data();
+        }
+        count++;
+
+        if (!hasMoreTokens()) {
+            break;
+        }
+
+        token = getToken();
+
+        if (token.type == Token::Type::ARRAY_CLOSE) {
+            node.type = JsonNode::Type::NUMBER_ARRAY;
+            node.count = count;
+            node.string = first;
+
+            return true;
+        }
+
+        if (token.type != Token::Type::COMMA) {
+            break;
+        }
+    }
+
+    seek(start);
+
+    return false;
+}
+
+JsonLoader::JsonNode JsonLoader::parseString(const Token& token) {
+    std::string_view str = arena.copyString(token.value);
+
+    JsonNode node{};
+    node.type = JsonNode::Type::STRING;
+    node.count = static_cast<uint32_t>(str.size());
+    node.string = str.data();
 
     return node;
 }
 
-JsonLoader::JsonNode* JsonLoader::parseNumber() {
-    JsonNode* node = new JsonNode();
-    node->type = JsonNode::Type::NUMBER;
+JsonLoader::JsonNode JsonLoader::parseNumber(const Token& token) {
+    JsonNode node{};
 
-    Token token = getToken();
-    node->value = std::stof(token.value);
+    if (isIntegerToken(token.value) && toInteger(token.value, node.integer)) {
+        node.type = JsonNode::Type::INTEGER;
+    } else {
+        node.type = JsonNode::Type::NUMBER;
+        node.number = toFloat(token.value);
+    }
 
     return node;
 }
 
-JsonLoader::JsonNode* JsonLoader::parseNode() {
-    JsonNode* node;
+JsonLoader::JsonNode JsonLoader::parseNode() {
+    JsonNode node{};
 
     Token token = getToken();
 
@@ -118,13 +486,11 @@ JsonLoader::JsonNode* JsonLoader::parseNode() {
             break;
         }
         case Token::Type::STRING: {
-            rollbackToken();
-            node = parseString();
+            node = parseString(token);
             break;
         }
         case Token::Type::NUMBER: {
-            rollbackToken();
-            node = parseNumber();
+            node = parseNumber(token);
             break;
         default:
             throw std::runtime_error("Error parsing JSON: Unknown token type");
@@ -134,95 +500,498 @@ JsonLoader::JsonNode* JsonLoader::parseNode() {
     return node;
 }
 
+bool JsonLoader::hasMoreTokens() {
+    if (backend == Backend::INDEXED) {
+        return nextStructural < endStructural || unindexed != nullptr;
+    }
+
+    // trailing whitespace doesn't count
+    while (cursor < end && isJsonWhitespace(*cursor)) {
+        cursor++;
+    }
+
+    return cursor < end;
+}
+
 JsonLoader::Token JsonLoader::getToken() {
-    if (fileStream.eof()) {
+    if (backend == Backend::INDEXED) {
+        return getIndexedToken();
+    }
+
+    return getCursorToken();
+}
+
+JsonLoader::Token JsonLoader::getCursorToken() {
+    if (cursor == end) {
         throw std::logic_error("Ran out of tokens!");
     }
 
-    char c;
+    prevPos = cursor;
 
-    prevPos = fileStream.tellg();
-    c = getWithoutWhiteSpace();
+    char c = getWithoutWhiteSpace();
+    const char* start = cursor - 1;
 
     Token token;
 
     if (c == '"') {
         token.type = Token::Type::STRING;
-        token.value = "";
 
-        fileStream.get(c);
-        while (c != '"') {
-            token.value += c;
-            fileStream.get(c);
+        const char* stringEnd = cursor;
+
+        while (stringEnd < end && *stringEnd != '"') {
+            // skip whatever is escaped so that \" doesn't end the string
+            if (*stringEnd == '\\') {
+                stringEnd++;
+            }
+
+            stringEnd++;
         }
-    } else if (c == '-' || std::isdigit(c)) {
-        token.type = Token::Type::NUMBER;
-        token.value = "";
-        token.value += c;
 
-        size_t prevCharPos = fileStream.tellg();
+        if (stringEnd >= end) {
+            throw std::runtime_error("Error parsing JSON: Unterminated string");
+        }
 
-        while (c == '-' || c == '+' || c == 'e' || c == '.' || std::isdigit(c)) { // check for scientific notation as well
-            prevCharPos = fileStream.tellg();
-            fileStream.get(c);
+        token.value = std::string_view(cursor, stringEnd - cursor);
+        cursor = stringEnd + 1;
+    } else {
+        cursor = readUnquotedToken(start, token);
+    }
 
-            if (fileStream.eof()) {
-                break;
-            } else if (c == '-' || c == '+' || c == 'e' || c == '.' || std::isdigit(c)) {
-                token.value += c;
-            } else {
-                fileStream.seekg(prevCharPos);
-            }
+    return token;
+}
+
+JsonLoader::Token JsonLoader::getIndexedToken() {
+    prevStructural = nextStructural;
+    prevUnindexed = unindexed;
+
+    Token token;
+
+    // whatever was stuck to the end of the last number, it's never a valid token
+    if (unindexed != nullptr) {
+        const char* start = unindexed;
+        unindexed = nullptr;
+
+        readUnquotedToken(start, token);
+
+        return token;
+    }
+
+    if (nextStructural == endStructural) {
+        throw std::logic_error("Ran out of tokens!");
+    }
+
+    const char* start = data + index[nextStructural++];
+
+    if (*start == '"') {
+        // the index always has the closing quote right after the opening one
+        const char* stringEnd = data + index[nextStructural++];
+
+        token.type = Token::Type::STRING;
+        token.value = std::string_view(start + 1, stringEnd - start - 1);
+    } else {
+        const char* tokenEnd = readUnquotedToken(start, token);
+
+        // the index only has the first character of a number, so anything else in the same run (like
+        // the x in 1x) is read as the next token here, where the cursor backend would come across it
+        if (token.type == Token::Type::NUMBER && tokenEnd < end && !isJsonWhitespace(*tokenEnd) && !isStructural(*tokenEnd)) {
+            unindexed = tokenEnd;
+        }
+    }
+
+    return token;
+}
+
+const char* JsonLoader::readUnquotedToken(const char* start, Token& token) {
+    char c = *start;
+    const char* tokenEnd = start + 1;
+
+    if (c == '-' || std::isdigit(static_cast<unsigned char>(c))) {
+        token.type = Token::Type::NUMBER;
+
+        // check for scientific notation as well
+        while (tokenEnd < end && (*tokenEnd == '-' || *tokenEnd == '+' || *tokenEnd == 'e' || *tokenEnd == 'E' || *tokenEnd == '.' || std::isdigit(static_cast<unsigned char>(*tokenEnd)))) {
+            tokenEnd++;
         }
     } else if (c == '{') {
         token.type = Token::Type::CURLY_OPEN;
-        token.value = "{";
     } else if (c == '}') {
         token.type = Token::Type::CURLY_CLOSE;
-        token.value = "}";
     } else if (c == '[') {
         token.type = Token::Type::ARRAY_OPEN;
-        token.value = "[";
     } else if (c == ']') {
         token.type = Token::Type::ARRAY_CLOSE;
-        token.value = "]";
     } else if (c == ':') {
         token.type = Token::Type::COLON;
-        token.value = ":";
     } else if (c == ',') {
         token.type = Token::Type::COMMA;
-        token.value = ",";
+    } else {
+        throw std::runtime_error("Error parsing JSON: Unexpected character '" + std::string(1, c) + "'");
     }
 
-    return token;
+    token.value = std::string_view(start, tokenEnd - start);
+
+    return tokenEnd;
 }
 
 char JsonLoader::getWithoutWhiteSpace() {
-    char c = ' ';
+    while (cursor < end && isJsonWhitespace(*cursor)) {
+        cursor++;
+    }
 
-    while (std::isspace(c)) {
-        fileStream.get(c);
+    if (cursor == end) {
+        throw std::logic_error("Ran out of tokens!");
+    }
+
+    return *cursor++;
+}
+
+void JsonLoader::rollbackToken() {
+    cursor = prevPos;
+    nextStructural = prevStructural;
+    unindexed = prevUnindexed;
+}
+
+JsonLoader::Position JsonLoader::tell() const {
+    return { cursor, nextStructural };
+}
+
+void JsonLoader::seek(Position position) {
+    cursor = position.cursor;
+    nextStructural = position.structural;
+    unindexed = nullptr;
+}
 
-        if (!fileStream.good()) {
-            if (std::isspace(c)) {
-                throw std::logic_error("Ran out of tokens!");
-            } else {
-                return c;
+std::vector<JsonLoader::Position> JsonLoader::splitTopLevelArray() {
+    Position start = tell();
+
+    beginArray();
+
+    std::vector<Position> boundaries;
+    size_t depth = 1;
+
+    if (backend == Backend::INDEXED) {
+        // only the index has to be walked, strings are a pair of quotes in it
+        for (size_t i = nextStructural; i < endStructural; i++) {
+            char c = data[index[i]];
+
+            if (boundaries.empty()) {
+                boundaries.push_back({ data + index[i], i });
+            }
+
+            if (c == '"') {
+                i++;
+            } else if (c == '[' || c == '{') {
+                depth++;
+            } else if (c == ']' || c == '}') {
+                depth--;
+            }
+
+            if ((depth == 1 && c == ',') || depth == 0) {
+                boundaries.push_back({ data + index[i], i });
+            }
+
+            if (depth == 0) {
+                break;
+            }
+        }
+    } else {
+        for (const char* c = cursor; c < end; c++) {
+            if (boundaries.empty() && !isJsonWhitespace(*c)) {
+                boundaries.push_back({ c, 0 });
+            }
+
+            if (*c == '"') {
+                for (c++; c < end && *c != '"'; c++) {
+                    if (*c == '\\') {
+                        c++;
+                    }
+                }
+
+                if (c >= end) {
+                    break;
+                }
+            } else if (*c == '[' || *c == '{') {
+                depth++;
+            } else if (*c == ']' || *c == '}') {
+                depth--;
+            }
+
+            if ((depth == 1 && *c == ',') || depth == 0) {
+                boundaries.push_back({ c, 0 });
+            }
+
+            if (depth == 0) {
+                break;
             }
-        } 
+        }
+    }
+
+    if (depth != 0) {
+        throw std::runtime_error("Error parsing JSON: Unterminated array");
     }
 
-    return c;
+    seek(start);
+
+    return boundaries;
 }
 
-void JsonLoader::rollbackToken() {
-    if (fileStream.eof()) {
-        fileStream.clear();
+JsonLoader::Token::Type JsonLoader::peekToken() {
+    Token token = getToken();
+    rollbackToken();
+
+    return token.type;
+}
+
+JsonLoader::Token JsonLoader::expectToken(Token::Type type, const char* expected) {
+    Token token = getToken();
+
+    if (token.type != type) {
+        throw std::runtime_error(std::string("Error reading JSON: Expected ") + expected);
     }
 
-    fileStream.seekg(prevPos);
+    return token;
+}
+
+void JsonLoader::beginArray() {
+    expectToken(Token::Type::ARRAY_OPEN, "an array");
+}
+
+bool JsonLoader::nextElement() {
+    if (!hasMoreTokens()) {
+        return false;
+    }
+
+    Token token = getToken();
+
+    if (token.type == Token::Type::ARRAY_CLOSE) {
+        return false;
+    }
+
+    // the first element isn't preceded by a comma
+    if (token.type != Token::Type::COMMA) {
+        rollbackToken();
+    }
+
+    return true;
+}
+
+void JsonLoader::beginObject() {
+    expectToken(Token::Type::CURLY_OPEN, "an object");
+}
+
+bool JsonLoader::nextMember(std::string_view& key) {
+    Token token = getToken();
+
+    if (token.type == Token::Type::CURLY_CLOSE) {
+        return false;
+    }
+
+    if (token.type == Token::Type::COMMA) {
+        token = getToken();
+    }
+
+    if (token.type != Token::Type::STRING) {
+        throw std::runtime_error("Error reading JSON: Expected a key");
+    }
+
+    key = token.value;
+
+    expectToken(Token::Type::COLON, "a colon");
+
+    return true;
+}
+
+std::string_view JsonLoader::readString() {
+    return expectToken(Token::Type::STRING, "a string").value;
+}
+
+float JsonLoader::readNumber() {
+    return toFloat(expectToken(Token::Type::NUMBER, "a number").value);
+}
+
+int64_t JsonLoader::readInteger() {
+    return integerTokenToInteger(expectToken(Token::Type::NUMBER, "an integer").value);
+}
+
+void JsonLoader::skipValue() {
+    size_t depth = 0;
+
+    do {
+        Token token = getToken();
+
+        if (token.type == Token::Type::ARRAY_OPEN || token.type == Token::Type::CURLY_OPEN) {
+            depth++;
+        } else if (token.type == Token::Type::ARRAY_CLOSE || token.type == Token::Type::CURLY_CLOSE) {
+            depth--;
+        }
+    } while (depth > 0);
 }
 
 void JsonLoader::close() {
-    fileStream.close();
+    file.close();
+
+    cursor = nullptr;
+    end = nullptr;
+    prevPos = nullptr;
+
+    data = nullptr;
+
+    structurals = {};
+    index = nullptr;
+    nextStructural = 0;
+    prevStructural = 0;
+    endStructural = 0;
+    unindexed = nullptr;
+    prevUnindexed = nullptr;
+}
+
+void JsonLoader::release() {
+    arena.release();
+    root = nullptr;
+
+    elementStack = {};
+    memberStack = {};
+}
+
+JsonLoader::Range<const JsonLoader::JsonMember> JsonLoader::JsonNode::getObject() const {
+    if (type != Type::OBJECT) {
+        throw std::runtime_error("Error reading JSON: Expected an object");
+    }
+
+    return { members, members + count };
+}
+
+JsonLoader::Range<const JsonLoader::JsonNode> JsonLoader::JsonNode::getArray() const {
+    if (type == Type::NUMBER_ARRAY) {
+        throw std::runtime_error("Error reading JSON: Lazy arrays have to be read with getNumbers() or getIntegers()");
+    }
+
+    if (type != Type::ARRAY) {
+        throw std::runtime_error("Error reading JSON: Expected an array");
+    }
+
+    return { elements, elements + count };
+}
+
+std::string_view JsonLoader::JsonNode::getString() const {
+    if (type != Type::STRING) {
+        throw std::runtime_error("Error reading JSON: Expected a string");
+    }
+
+    return std::string_view(string, count);
+}
+
+float JsonLoader::JsonNode::getNumber() const {
+    if (type == Type::INTEGER) {
+        return static_cast<float>(integer);
+    }
+
+    if (type != Type::NUMBER) {
+        throw std::runtime_error("Error reading JSON: Expected a number");
+    }
+
+    return number;
+}
+
+int64_t JsonLoader::JsonNode::getInteger() const {
+    if (type == Type::INTEGER) {
+        return integer;
+    }
+
+    if (type != Type::NUMBER) {
+        throw std::runtime_error("Error reading JSON: Expected an integer");
+    }
+
+    return floatToInteger(number);
+}
+
+void JsonLoader::JsonNode::getNumbers(float* numbers, size_t count) const {
+    if (type != Type::ARRAY && type != Type::NUMBER_ARRAY) {
+        throw std::runtime_error("Error reading JSON: Expected an array");
+    }
+
+    if (this->count < count) {
+        throw std::runtime_error("Error reading JSON: Expected at least " + std::to_string(count) + " elements");
+    }
+
+    if (type == Type::NUMBER_ARRAY) {
+        forEachLazyNumber(string, count, [numbers](size_t i, std::string_view value) {
+            numbers[i] = toFloat(value);
+        });
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            numbers[i] = elements[i].getNumber();
+        }
+    }
+}
+
+void JsonLoader::JsonNode::getIntegers(int64_t* integers, size_t count) const {
+    if (type != Type::ARRAY && type != Type::NUMBER_ARRAY) {
+        throw std::runtime_error("Error reading JSON: Expected an array");
+    }
+
+    if (this->count < count) {
+        throw std::runtime_error("Error reading JSON: Expected at least " + std::to_string(count) + " elements");
+    }
+
+    if (type == Type::NUMBER_ARRAY) {
+        forEachLazyNumber(string, count, [integers](size_t i, std::string_view value) {
+            integers[i] = integerTokenToInteger(value);
+        });
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            integers[i] = elements[i].getInteger();
+        }
+    }
+}
+
+const JsonLoader::JsonNode* JsonLoader::JsonNode::find(Key key) const {
+    if (key == Key::OTHER) {
+        throw std::logic_error("Can't look up a key that isn't interned");
+    }
+
+    for (const JsonMember& member : getObject()) {
+        if (member.id == key) {
+            return &member.value;
+        }
+    }
+
+    return nullptr;
+}
+
+const JsonLoader::JsonNode* JsonLoader::JsonNode::find(std::string_view key) const {
+    uint32_t hash = hashKey(key);
+    Key id = internKey(key, hash);
+
+    if (id != Key::OTHER) {
+        return find(id);
+    }
+
+    for (const JsonMember& member : getObject()) {
+        if (member.hash == hash && member.key == key) {
+            return &member.value;
+        }
+    }
+
+    return nullptr;
+}
+
+const JsonLoader::JsonNode& JsonLoader::JsonNode::at(Key key) const {
+    const JsonNode* value = find(key);
+
+    if (value == nullptr) {
+        throw std::runtime_error(std::string("Error reading JSON: Missing key \"") + getKeyName(key) + "\"");
+    }
+
+    return *value;
+}
+
+const JsonLoader::JsonNode& JsonLoader::JsonNode::at(std::string_view key) const {
+    const JsonNode* value = find(key);
+
+    if (value == nullptr) {
+        throw std::runtime_error("Error reading JSON: Missing key \"" + std::string(key) + "\"");
+    }
+
+    return *value;
 }
\ No newline at end of file
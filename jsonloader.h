@@ -1,12 +1,15 @@
 #ifndef _JSON_LOADER_H
 #define _JSON_LOADER_H
 
-#include <fstream>
-#include <map>
+#include <cstdint>
 #include <string>
-#include <variant>
+#include <string_view>
 #include <vector>
 
+#include "arena.h"
+#include "jsonindex.h"
+#include "mappedfile.h"
+
 class JsonLoader {
 public:
 
@@ -21,44 +24,224 @@ public:
             COLON,
             COMMA
         };
-        std::string value;
+        std::string_view value; // points into the mapped file
         Type type;
     };
 
+    template<typename T>
+    struct Range {
+        T* first;
+        T* last;
+
+        T* begin() const { return first; }
+        T* end() const { return last; }
+        size_t size() const { return last - first; }
+        T& operator[](size_t i) const { return first[i]; }
+    };
+
+    // The keys s72 files use. Keys are interned as the file is parsed, so looking one of
+    // these up in an object is an integer compare. Any other key is OTHER and is looked
+    // up by its hash first.
+    enum class Key : uint32_t {
+        OTHER,
+        TYPE,
+        NAME,
+        ROOTS,
+        TRANSLATION,
+        ROTATION,
+        SCALE,
+        CHILDREN,
+        CAMERA,
+        MESH,
+        TOPOLOGY,
+        COUNT,
+        INDICES,
+        ATTRIBUTES,
+        SRC,
+        OFFSET,
+        STRIDE,
+        FORMAT,
+        PERSPECTIVE,
+        ASPECT,
+        VFOV,
+        NEAR_PLANE, // "near", NEAR and FAR are macros on Windows
+        FAR_PLANE,  // "far"
+        NODE,
+        CHANNEL,
+        TIMES,
+        VALUES,
+        INTERPOLATION
+    };
+
+    // FNV-1a
+    static uint32_t hashKey(std::string_view key);
+    static Key internKey(std::string_view key, uint32_t hash);
+    // e.g. "type" for TYPE, for error messages
+    static const char* getKeyName(Key key);
+
+    struct JsonMember;
+
+    // All nodes, child arrays and strings live in the loader's arena. The members of an
+    // object and the elements of an array are stored contiguously, in file order.
     struct JsonNode {
         enum class Type {
             OBJECT,
             ARRAY,
             STRING,
-            NUMBER
+            NUMBER,
+            INTEGER, // a number written without a fraction or exponent, kept exact
+            NUMBER_ARRAY // an array of numbers that is only decoded when it's read, see setLazyArrays()
         };
-        std::variant<
-            std::map<std::string, JsonNode*>*,
-            std::vector<JsonNode*>*,
-            std::string,
-            float
-        > value;
         Type type;
+        uint32_t count; // members of an OBJECT, elements of an (NUMBER_)ARRAY, or characters of a STRING
+        union {
+            JsonMember* members;
+            JsonNode* elements;
+            const char* string; // also the first element of a NUMBER_ARRAY, in the mapped file
+            float number;
+            int64_t integer;
+        };
+
+        Range<const JsonMember> getObject() const;
+        Range<const JsonNode> getArray() const;
+        std::string_view getString() const;
+        // also accepts an INTEGER
+        float getNumber() const;
+        // also accepts a NUMBER as long as it has no fractional part
+        int64_t getInteger() const;
+
+        // Decode the first count elements of an ARRAY or a NUMBER_ARRAY, and throw if
+        // there are fewer than that. A NUMBER_ARRAY is decoded from the mapped file
+        // every time, so these are only valid until close().
+        void getNumbers(float* numbers, size_t count) const;
+        void getIntegers(int64_t* integers, size_t count) const;
+
+        // returns nullptr if the object has no member with that key
+        const JsonNode* find(Key key) const;
+        const JsonNode* find(std::string_view key) const;
+        // throws if the object has no member with that key
+        const JsonNode& at(Key key) const;
+        const JsonNode& at(std::string_view key) const;
     };
 
-    JsonLoader(std::string filename);
+    struct JsonMember {
+        std::string_view key;
+        uint32_t hash;
+        Key id; // OTHER unless it's one of the s72 keys
+        JsonNode value;
+    };
+
+    enum class Backend {
+        AUTO,    // whichever is faster, which is CURSOR for now
+        CURSOR,  // tokenizes by scanning the file a byte at a time
+        INDEXED  // builds a structural index with JsonIndex first and tokenizes from that
+    };
+
+    JsonLoader(std::string filename, Backend backend = Backend::AUTO);
+    // builds the index with the given kernel rather than the fastest one, which has to be one the CPU supports
+    JsonLoader(std::string filename, Backend backend, JsonIndex::Kernel kernel);
+
+    Backend getBackend() const { return backend; }
+    // e.g. "indexed (avx2)", for logging
+    std::string getBackendName() const;
+
+    // When this is on, parseJson() turns arrays that only hold numbers into NUMBER_ARRAY
+    // nodes. Their elements are only checked for commas while parsing, they aren't
+    // converted or given a node until getNumbers() or getIntegers() asks for them, so
+    // long keyframe arrays that are never read cost next to nothing.
+    void setLazyArrays(bool lazy) { lazyArrays = lazy; }
 
     JsonNode* parseJson();
-    JsonNode* parseObject();
-    JsonNode* parseArray();
-    JsonNode* parseString();
-    JsonNode* parseNumber();
-    JsonNode* parseNode();
 
+    // Pull interface, an alternative to parseJson() that reads values straight from the
+    // tokens without building a tree. Strings point into the mapped file, so they are
+    // only valid until close().
+    struct Position {
+        const char* cursor;
+        size_t structural;
+    };
+
+    // Reads the tokens in [begin, end) of another loader, sharing its mapped file and
+    // structural index. The source has to stay open for as long as this one is used.
+    JsonLoader(const JsonLoader& source, Position begin, Position end);
+
+    Position tell() const;
+    void seek(Position position);
+
+    // false at the end of the file, or of the range given to a sub-loader
+    bool hasMoreTokens();
+
+    // Finds the elements of the top level array without parsing them. Returns the position
+    // of the first element, then of every separating comma, then of the closing bracket,
+    // so a sub-loader over [boundaries[i], boundaries[j]) reads elements i to j - 1 with
+    // nextElement(). Leaves the loader where it was.
+    std::vector<Position> splitTopLevelArray();
+
+    Token::Type peekToken();
+
+    void beginArray();
+    // consumes the separating comma, returns false (and consumes the bracket) once the array is closed
+    // or there are no tokens left
+    bool nextElement();
+
+    void beginObject();
+    // reads the key and the colon, returns false (and consumes the brace) once the object is closed
+    bool nextMember(std::string_view& key);
+
+    std::string_view readString();
+    float readNumber();
+    int64_t readInteger();
+
+    // skips over a whole value, nested containers included
+    void skipValue();
+
+    // closes the scene file, the tree returned by parseJson() stays valid
     void close();
+    // frees the whole tree returned by parseJson() in one go
+    void release();
 
 private:
 
-    std::fstream fileStream;
+    MappedFile file;
+    const char* data; // start of the file, which might belong to another loader
+    Arena arena;
     JsonNode* root;
-    size_t prevPos;
+    bool lazyArrays;
+
+    Backend backend;
+    JsonIndex::Kernel kernel;
+
+    // the file is tokenized in a single forward pass over the mapping
+    const char* cursor;
+    const char* end;
+    const char* prevPos;
+
+    // offsets of the token starts, only used by the INDEXED backend
+    std::vector<uint32_t> structurals;
+    const uint32_t* index; // structurals, or the index of the loader this one reads a range of
+    size_t nextStructural;
+    size_t prevStructural;
+    size_t endStructural;
+    // a token the index doesn't have, that has to be read before nextStructural
+    const char* unindexed;
+    const char* prevUnindexed;
+
+    // children of the containers that are still being parsed, they get copied into the arena once the container closes
+    std::vector<JsonNode> elementStack;
+    std::vector<JsonMember> memberStack;
+
+    JsonNode parseObject();
+    JsonNode parseArray();
+    bool skimNumberArray(JsonNode& node);
+    JsonNode parseString(const Token& token);
+    JsonNode parseNumber(const Token& token);
+    JsonNode parseNode();
 
     Token getToken();
+    Token expectToken(Token::Type type, const char* expected);
+    Token getCursorToken();
+    Token getIndexedToken();
+    const char* readUnquotedToken(const char* start, Token& token);
     char getWithoutWhiteSpace();
     void rollbackToken();
 };
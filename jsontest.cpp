@@ -0,0 +1,286 @@
+// Checks that the two JsonLoader backends agree. Every document is parsed with the CURSOR
+// backend and with the INDEXED backend at every JsonIndex kernel this CPU supports, with and
+// without lazy arrays, and the trees have to be identical, or every parse has to be rejected.
+// The documents are a fixed list of valid and malformed ones, plus random corruptions of the
+// valid ones.
+//
+// usage: jsontest [--fuzz <count>] [--seed <seed>]
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "jsonindex.h"
+#include "jsonloader.h"
+
+namespace {
+
+const std::vector<std::string> VALID_DOCUMENTS = {
+    "[]",
+    "{}",
+    "[1, 2, 3]",
+    "[-1, 0, -0, 1.5, -2.25e3, 4E-2, 1e+2]",
+    "[9007199254740993, -9223372036854775808]",
+    "{\"a\": 1, \"b\": [\"x\"], \"c\": {}}",
+    "{\"name\": \"with \\\"escaped\\\" quotes and a \\\\ backslash\", \"values\": [1,2,3]}",
+    "{\"nested\": [[1, 2], [3, [4, [5]]], {\"x\": [\"a\", \"b\"]}]}",
+    " \t\r\n[ 1 ,\n2\t,\r3 ] \n",
+    "[\"a string that is long enough to cross the end of the first sixty four byte block\", 12345]",
+    "[1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,26,27,28,29,30,31,32]",
+    "[\"\", \"{[:,]}\", \"\\\\\", \"\\\\\\\"\"]",
+    "{\"times\": [0, 0.5, 1], \"values\": [0, 0, 0, 1, 1, 1, 2, 2, 2], \"interpolation\": \"LINEAR\"}",
+    "[{\"type\": \"NODE\", \"translation\": [1, 2, 3], \"children\": [2, 3]}, {\"type\": \"MESH\"}]",
+    "1",
+    "-12.5",
+    "\"just a string\"",
+    ""
+};
+
+// each has to be rejected, or accepted, by every backend the same way
+const std::vector<std::string> MALFORMED_DOCUMENTS = {
+    "[1x, 2]",
+    "[1, 2x]",
+    "[1, 2]x",
+    "1x",
+    "[1.2.3x]",
+    "[1-, 2]",
+    "[1e, 2]",
+    "[-]",
+    "[-x]",
+    "{\"a\": 1x}",
+    "{\"a\": 1x, \"b\": 2}",
+    "{1x: 2}",
+    "[tru]",
+    "[null]",
+    "[1\v, 2]",
+    "[1\f, 2]",
+    "[\"unterminated",
+    "[1, 2",
+    "{\"a\": [1, 2}",
+    "[1 2]",
+    "{\"a\" 1}",
+    "[1,,2]",
+    "[\"a\"x]",
+    "[1\"a\"]",
+    "[1, 2]]",
+    "]",
+    "                                                            [12x]",
+    "                                                              [1x]",
+    "[0.000000000000000000000000000000000000000000000000001, 1e99999]",
+    "[1e99999x]"
+};
+
+std::string formatNode(const JsonLoader::JsonNode* node);
+
+std::string formatNumber(float number) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.9g", number);
+
+    return buffer;
+}
+
+std::string formatNode(const JsonLoader::JsonNode* node) {
+    if (node == nullptr) {
+        return "(none)";
+    }
+
+    std::ostringstream out;
+
+    switch (node->type) {
+        case JsonLoader::JsonNode::Type::OBJECT:
+            out << "{";
+            for (const JsonLoader::JsonMember& member : node->getObject()) {
+                out << "\"" << member.key << "\"#" << static_cast<uint32_t>(member.id) << ":" << formatNode(&member.value) << ",";
+            }
+            out << "}";
+            break;
+        case JsonLoader::JsonNode::Type::ARRAY:
+            out << "[";
+            for (const JsonLoader::JsonNode& element : node->getArray()) {
+                out << formatNode(&element) << ",";
+            }
+            out << "]";
+            break;
+        case JsonLoader::JsonNode::Type::STRING:
+            out << "\"" << node->getString() << "\"";
+            break;
+        case JsonLoader::JsonNode::Type::NUMBER:
+            out << "f" << formatNumber(node->number);
+            break;
+        case JsonLoader::JsonNode::Type::INTEGER:
+            out << "i" << node->integer;
+            break;
+        case JsonLoader::JsonNode::Type::NUMBER_ARRAY: {
+            // decoded the way the scene loader would, which can only fail here
+            std::vector<float> numbers(node->count);
+            node->getNumbers(numbers.data(), numbers.size());
+
+            out << "lazy[";
+            for (float number : numbers) {
+                out << "f" << formatNumber(number) << ",";
+            }
+            out << "]";
+            break;
+        }
+    }
+
+    return out.str();
+}
+
+bool isError(const std::string& result) {
+    return result.compare(0, 7, "error: ") == 0;
+}
+
+// the tree, or the error it was rejected with
+std::string parse(const std::string& path, JsonLoader::Backend backend, JsonIndex::Kernel kernel, bool lazyArrays) {
+    try {
+        JsonLoader loader(path, backend, kernel);
+        loader.setLazyArrays(lazyArrays);
+
+        return formatNode(loader.parseJson());
+    } catch (const std::exception& e) {
+        return std::string("error: ") + e.what();
+    }
+}
+
+std::vector<JsonIndex::Kernel> getSupportedKernels() {
+    std::vector<JsonIndex::Kernel> kernels = { JsonIndex::Kernel::SCALAR };
+    JsonIndex::Kernel best = JsonIndex::detectKernel();
+
+    if (best == JsonIndex::Kernel::SSE2 || best == JsonIndex::Kernel::AVX2) {
+        kernels.push_back(JsonIndex::Kernel::SSE2);
+    }
+
+    if (best == JsonIndex::Kernel::AVX2) {
+        kernels.push_back(JsonIndex::Kernel::AVX2);
+    }
+
+    return kernels;
+}
+
+// returns the number of backend/kernel combinations that disagreed with CURSOR
+uint32_t checkDocument(const std::string& document, const std::string& path, const std::vector<JsonIndex::Kernel>& kernels) {
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(document.data(), document.size());
+    }
+
+    uint32_t mismatches = 0;
+
+    for (bool lazyArrays : { false, true }) {
+        std::string expected = parse(path, JsonLoader::Backend::CURSOR, JsonIndex::Kernel::SCALAR, lazyArrays);
+
+        for (JsonIndex::Kernel kernel : kernels) {
+            std::string result = parse(path, JsonLoader::Backend::INDEXED, kernel, lazyArrays);
+
+            // both have to reject the same documents, but not always with the same message: the index
+            // finds an unterminated string before anything is parsed, the cursor wherever it runs into trouble first
+            if (result != expected && !(isError(result) && isError(expected))) {
+                std::cout << "MISMATCH (" << JsonIndex::getKernelName(kernel) << (lazyArrays ? ", lazy arrays" : "") << ") on:" << std::endl
+                    << "  " << document << std::endl
+                    << "  cursor:  " << expected << std::endl
+                    << "  indexed: " << result << std::endl;
+
+                mismatches++;
+            }
+        }
+    }
+
+    return mismatches;
+}
+
+// a valid document with a few bytes replaced, inserted or removed
+std::string corrupt(const std::string& document, std::mt19937& rng) {
+    static const std::string BYTES = "{}[]:,\"\\ \t\n\v-+.eE0123456789xa";
+
+    std::string result = document;
+    uint32_t edits = 1 + rng() % 3;
+
+    for (uint32_t i = 0; i < edits; i++) {
+        size_t position = result.empty() ? 0 : rng() % result.size();
+        char c = BYTES[rng() % BYTES.size()];
+
+        switch (rng() % 3) {
+            case 0:
+                if (!result.empty()) {
+                    result[position] = c;
+                }
+                break;
+            case 1:
+                result.insert(result.begin() + position, c);
+                break;
+            default:
+                if (!result.empty()) {
+                    result.erase(result.begin() + position);
+                }
+                break;
+        }
+    }
+
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    uint32_t fuzzCount = 20000;
+    uint32_t seed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--fuzz" && i + 1 < argc) {
+            fuzzCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else {
+            std::cerr << "usage: jsontest [--fuzz <count>] [--seed <seed>]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<JsonIndex::Kernel> kernels = getSupportedKernels();
+    std::string path = (std::filesystem::temp_directory_path() / "jsontest.json").string();
+
+    std::cout << "Comparing the cursor backend against the indexed one with";
+    for (JsonIndex::Kernel kernel : kernels) {
+        std::cout << " " << JsonIndex::getKernelName(kernel);
+    }
+    std::cout << std::endl;
+
+    uint32_t documents = 0;
+    uint32_t mismatches = 0;
+
+    for (const std::string& document : VALID_DOCUMENTS) {
+        mismatches += checkDocument(document, path, kernels);
+        documents++;
+    }
+
+    for (const std::string& document : MALFORMED_DOCUMENTS) {
+        mismatches += checkDocument(document, path, kernels);
+        documents++;
+    }
+
+    std::mt19937 rng(seed);
+
+    for (uint32_t i = 0; i < fuzzCount; i++) {
+        const std::string& document = VALID_DOCUMENTS[rng() % VALID_DOCUMENTS.size()];
+
+        mismatches += checkDocument(corrupt(document, rng), path, kernels);
+        documents++;
+    }
+
+    std::filesystem::remove(path);
+
+    std::cout << documents << " documents, " << mismatches << " mismatches" << std::endl;
+
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
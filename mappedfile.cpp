@@ -0,0 +1,153 @@
+#include "mappedfile.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() {
+    mappedData = nullptr;
+    mappedSize = 0;
+    opened = false;
+
+#ifdef _WIN32
+    fileHandle = nullptr;
+    mappingHandle = nullptr;
+#endif
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept : MappedFile() {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+
+        std::swap(mappedData, other.mappedData);
+        std::swap(mappedSize, other.mappedSize);
+        std::swap(opened, other.opened);
+
+#ifdef _WIN32
+        std::swap(fileHandle, other.fileHandle);
+        std::swap(mappingHandle, other.mappingHandle);
+#endif
+    }
+
+    return *this;
+}
+
+bool MappedFile::open(const std::string& fileName) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        return false;
+    }
+
+    fileHandle = file;
+    mappedSize = static_cast<size_t>(fileSize.QuadPart);
+
+    // zero-length files can't be mapped, but they are still valid (empty) files
+    if (mappedSize > 0) {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+        if (mapping == nullptr) {
+            close();
+            return false;
+        }
+
+        mappingHandle = mapping;
+        mappedData = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+
+        if (mappedData == nullptr) {
+            close();
+            return false;
+        }
+    }
+#else
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat fileInfo;
+    if (fstat(fd, &fileInfo) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    mappedSize = static_cast<size_t>(fileInfo.st_size);
+
+    // zero-length files can't be mapped, but they are still valid (empty) files
+    if (mappedSize > 0) {
+        void* addr = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            mappedSize = 0;
+            return false;
+        }
+
+        // we only ever walk the mapping front to back
+        madvise(addr, mappedSize, MADV_SEQUENTIAL);
+
+        mappedData = static_cast<const char*>(addr);
+    }
+
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+#endif
+
+    opened = true;
+
+    return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    if (mappedData) {
+        UnmapViewOfFile(mappedData);
+    }
+
+    if (mappingHandle) {
+        CloseHandle(static_cast<HANDLE>(mappingHandle));
+    }
+
+    if (fileHandle) {
+        CloseHandle(static_cast<HANDLE>(fileHandle));
+    }
+
+    fileHandle = nullptr;
+    mappingHandle = nullptr;
+#else
+    if (mappedData) {
+        munmap(const_cast<char*>(mappedData), mappedSize);
+    }
+#endif
+
+    mappedData = nullptr;
+    mappedSize = 0;
+    opened = false;
+}
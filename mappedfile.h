@@ -0,0 +1,43 @@
+#ifndef _MAPPED_FILE_H
+#define _MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only view of a whole file. Uses mmap (or a file mapping on Windows) so that
+// callers can walk the contents with a pointer instead of going through a stream.
+class MappedFile {
+public:
+
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // returns false if the file could not be opened or mapped
+    bool open(const std::string& fileName);
+    void close();
+
+    bool isOpen() const { return opened; }
+    const char* data() const { return mappedData; }
+    size_t size() const { return mappedSize; }
+    std::string_view view() const { return std::string_view(mappedData, mappedSize); }
+
+private:
+
+    const char* mappedData;
+    size_t mappedSize;
+    bool opened;
+
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
+
+#endif // _MAPPED_FILE_H
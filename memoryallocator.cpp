@@ -0,0 +1,586 @@
+#include "memoryallocator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include <vulkan/vk_enum_string_helper.h>
+
+namespace {
+
+// every range starts and ends on this, so what's left after a split is always a usable range
+const VkDeviceSize GRANULE = 16;
+
+VkDeviceSize roundUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+uint32_t highestBit(uint64_t value) {
+    uint32_t bit = 0;
+
+    while (value >>= 1) {
+        bit++;
+    }
+
+    return bit;
+}
+
+uint32_t lowestBit(uint64_t value) {
+    uint32_t bit = 0;
+
+    while ((value & 1) == 0) {
+        value >>= 1;
+        bit++;
+    }
+
+    return bit;
+}
+
+// the size class, sizes are at least GRANULE so there's always SL_BITS below the top bit
+void getSizeClass(VkDeviceSize size, uint32_t slBits, uint32_t& fl, uint32_t& sl) {
+    fl = highestBit(size);
+    sl = static_cast<uint32_t>(size >> (fl - slBits)) & ((1u << slBits) - 1);
+}
+
+std::string formatSize(VkDeviceSize size) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.1f MiB", static_cast<double>(size) / (1024.0 * 1024.0));
+
+    return text;
+}
+
+std::string formatProperties(VkMemoryPropertyFlags properties) {
+    std::string text;
+
+    if (properties & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) {
+        text += "device local ";
+    }
+    if (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        text += "host visible ";
+    }
+    if (properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) {
+        text += "host coherent ";
+    }
+    if (properties & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) {
+        text += "host cached ";
+    }
+
+    return text.empty() ? "no properties" : text.substr(0, text.size() - 1);
+}
+
+void checkResult(VkResult result, const std::string& errorMsg) {
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error(errorMsg + std::string(string_VkResult(result)) + " [" + std::to_string(result) + "]");
+    }
+}
+
+} // namespace
+
+const VkDeviceSize MemoryAllocator::BLOCK_SIZE;
+const uint32_t MemoryAllocator::NO_RANGE;
+
+void MemoryAllocator::init(VkPhysicalDevice physicalDevice, VkDevice device) {
+    this->device = device;
+
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+    maxAllocationCount = deviceProperties.limits.maxMemoryAllocationCount;
+}
+
+void MemoryAllocator::destroy() {
+    for (Pool& pool : pools) {
+        for (Block& block : pool.blocks) {
+            if (block.memory != VK_NULL_HANDLE) {
+                freeMemory(block.memory);
+            }
+        }
+    }
+
+    for (TransientPool& pool : transientPools) {
+        for (TransientBlock& block : pool.blocks) {
+            freeMemory(block.memory);
+        }
+    }
+
+    pools.clear();
+    transientPools.clear();
+}
+
+MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, Kind kind) {
+    uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+
+    std::vector<Pool>::iterator poolIt = std::find_if(pools.begin(), pools.end(), [&](const Pool& pool) {
+        return pool.memoryType == memoryType && pool.kind == kind;
+    });
+
+    if (poolIt == pools.end()) {
+        Pool pool;
+        pool.memoryType = memoryType;
+        pool.kind = kind;
+
+        // small heaps (like a 256 MiB BAR) get smaller blocks, so one pool can't take all of it
+        VkDeviceSize heapSize = memProperties.memoryHeaps[memProperties.memoryTypes[memoryType].heapIndex].size;
+        pool.blockSize = std::max(std::min(BLOCK_SIZE, heapSize / 8) & ~(GRANULE - 1), GRANULE);
+
+        pools.push_back(pool);
+        poolIt = pools.end() - 1;
+    }
+
+    Pool& pool = *poolIt;
+
+    MemoryAllocation allocation;
+    allocation.pool = static_cast<uint32_t>(poolIt - pools.begin());
+
+    if (requirements.size > pool.blockSize / 2) {
+        allocation.memory = allocateMemory(memoryType, requirements.size, allocation.mapped);
+        allocation.size = requirements.size;
+        allocation.source = MemoryAllocation::Source::DEDICATED;
+
+        pool.dedicatedCount++;
+        pool.dedicatedSize += requirements.size;
+
+        return allocation;
+    }
+
+    uint32_t blockIndex = 0;
+    uint32_t rangeIndex = NO_RANGE;
+
+    for (; blockIndex < pool.blocks.size(); blockIndex++) {
+        Block& block = pool.blocks[blockIndex];
+
+        if (block.memory != VK_NULL_HANDLE && allocateFromBlock(block, requirements.size, requirements.alignment, rangeIndex)) {
+            break;
+        }
+    }
+
+    if (rangeIndex == NO_RANGE) {
+        blockIndex = 0;
+
+        while (blockIndex < pool.blocks.size() && pool.blocks[blockIndex].memory != VK_NULL_HANDLE) {
+            blockIndex++;
+        }
+
+        if (blockIndex == pool.blocks.size()) {
+            pool.blocks.emplace_back();
+        }
+
+        Block& block = pool.blocks[blockIndex];
+        block.memory = allocateMemory(memoryType, pool.blockSize, block.mapped);
+        initBlock(block, pool.blockSize);
+        pool.liveBlocks++;
+
+        if (!allocateFromBlock(block, requirements.size, requirements.alignment, rangeIndex)) {
+            throw std::runtime_error("failed to sub-allocate from a new memory block!");
+        }
+    }
+
+    const Block& block = pool.blocks[blockIndex];
+
+    allocation.memory = block.memory;
+    allocation.offset = block.ranges[rangeIndex].offset;
+    allocation.size = block.ranges[rangeIndex].size;
+    allocation.mapped = block.mapped != nullptr ? block.mapped + allocation.offset : nullptr;
+    allocation.source = MemoryAllocation::Source::BLOCK;
+    allocation.block = blockIndex;
+    allocation.range = rangeIndex;
+
+    return allocation;
+}
+
+void MemoryAllocator::free(MemoryAllocation& allocation) {
+    if (allocation.source == MemoryAllocation::Source::BLOCK) {
+        Pool& pool = pools[allocation.pool];
+        Block& block = pool.blocks[allocation.block];
+
+        freeToBlock(block, allocation.range);
+
+        // one empty block is kept, so a pool that's emptied and filled again doesn't allocate every time
+        if (block.allocationCount == 0 && pool.liveBlocks > 1) {
+            freeMemory(block.memory);
+            block = Block();
+            pool.liveBlocks--;
+        }
+    } else if (allocation.source == MemoryAllocation::Source::DEDICATED) {
+        Pool& pool = pools[allocation.pool];
+
+        freeMemory(allocation.memory);
+
+        pool.dedicatedCount--;
+        pool.dedicatedSize -= allocation.size;
+    }
+
+    allocation = MemoryAllocation();
+}
+
+MemoryAllocation MemoryAllocator::allocateTransient(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties) {
+    uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+
+    std::vector<TransientPool>::iterator poolIt = std::find_if(transientPools.begin(), transientPools.end(), [&](const TransientPool& pool) {
+        return pool.memoryType == memoryType;
+    });
+
+    if (poolIt == transientPools.end()) {
+        TransientPool pool;
+        pool.memoryType = memoryType;
+
+        transientPools.push_back(pool);
+        poolIt = transientPools.end() - 1;
+    }
+
+    TransientPool& pool = *poolIt;
+    VkDeviceSize alignment = std::max(requirements.alignment, GRANULE);
+
+    while (true) {
+        if (pool.current == pool.blocks.size()) {
+            TransientBlock block;
+            block.size = std::max(BLOCK_SIZE, roundUp(requirements.size, GRANULE));
+            block.memory = allocateMemory(memoryType, block.size, block.mapped);
+
+            pool.blocks.push_back(block);
+            pool.offset = 0;
+        }
+
+        const TransientBlock& block = pool.blocks[pool.current];
+        VkDeviceSize offset = roundUp(pool.offset, alignment);
+
+        if (offset + requirements.size <= block.size) {
+            pool.offset = offset + requirements.size;
+
+            MemoryAllocation allocation;
+            allocation.memory = block.memory;
+            allocation.offset = offset;
+            allocation.size = requirements.size;
+            allocation.mapped = block.mapped != nullptr ? block.mapped + offset : nullptr;
+            allocation.source = MemoryAllocation::Source::TRANSIENT;
+
+            return allocation;
+        }
+
+        pool.current++;
+        pool.offset = 0;
+    }
+}
+
+void MemoryAllocator::resetTransient() {
+    for (TransientPool& pool : transientPools) {
+        pool.current = 0;
+        pool.offset = 0;
+    }
+}
+
+void MemoryAllocator::dump(std::ostream& out) const {
+    out << "MEMORY ALLOCATOR" << std::endl;
+
+    for (const Pool& pool : pools) {
+        const VkMemoryType& type = memProperties.memoryTypes[pool.memoryType];
+
+        uint32_t blockCount = 0;
+        uint32_t allocations = 0;
+        VkDeviceSize used = 0;
+        VkDeviceSize total = 0;
+        VkDeviceSize free = 0;
+        VkDeviceSize largestFree = 0;
+        uint32_t freeRanges = 0;
+
+        for (const Block& block : pool.blocks) {
+            if (block.memory == VK_NULL_HANDLE) {
+                continue;
+            }
+
+            blockCount++;
+            allocations += block.allocationCount;
+            used += block.used;
+            total += block.size;
+
+            for (uint32_t i = 0; i < block.ranges.size(); i++) {
+                // unused slots are never free
+                if (block.ranges[i].free) {
+                    free += block.ranges[i].size;
+                    largestFree = std::max(largestFree, block.ranges[i].size);
+                    freeRanges++;
+                }
+            }
+        }
+
+        // how much of the free memory can't be had in one piece
+        float fragmentation = free > 0 ? 1.0f - static_cast<float>(largestFree) / static_cast<float>(free) : 0.0f;
+
+        out << "memory type " << pool.memoryType << " (heap " << type.heapIndex << ", "
+            << formatProperties(type.propertyFlags) << ") "
+            << (pool.kind == Kind::LINEAR ? "buffers" : "images") << ": "
+            << blockCount << " blocks of " << formatSize(pool.blockSize) << ", "
+            << allocations << " allocations using " << formatSize(used) << " of " << formatSize(total) << ", "
+            << formatSize(free) << " free in " << freeRanges << " ranges (largest " << formatSize(largestFree) << ", "
+            << static_cast<int>(fragmentation * 100.0f + 0.5f) << "% fragmented), "
+            << pool.dedicatedCount << " dedicated (" << formatSize(pool.dedicatedSize) << ")" << std::endl;
+    }
+
+    for (const TransientPool& pool : transientPools) {
+        VkDeviceSize total = 0;
+        VkDeviceSize used = pool.offset;
+
+        for (size_t i = 0; i < pool.blocks.size(); i++) {
+            total += pool.blocks[i].size;
+
+            if (i < pool.current) {
+                used += pool.blocks[i].size;
+            }
+        }
+
+        out << "memory type " << pool.memoryType << " transient: " << pool.blocks.size() << " blocks, "
+            << formatSize(used) << " in use of " << formatSize(total) << std::endl;
+    }
+
+    out << "VkDeviceMemory objects: " << allocationCount << " of " << maxAllocationCount << std::endl << std::endl;
+}
+
+uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+        if (typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("failed to find available memory type!");
+}
+
+VkDeviceMemory MemoryAllocator::allocateMemory(uint32_t memoryType, VkDeviceSize size, char*& mapped) {
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    VkDeviceMemory memory;
+
+    checkResult(
+        vkAllocateMemory(device, &allocInfo, nullptr, &memory),
+        "failed to allocate memory");
+
+    allocationCount++;
+    mapped = nullptr;
+
+    // mapped once for as long as it lives, everything in it can be written at any time
+    if (memProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        void* data;
+
+        checkResult(
+            vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data),
+            "failed to map memory");
+
+        mapped = static_cast<char*>(data);
+    }
+
+    return memory;
+}
+
+// mapped memory is unmapped along with it
+void MemoryAllocator::freeMemory(VkDeviceMemory memory) {
+    vkFreeMemory(device, memory, nullptr);
+    allocationCount--;
+}
+
+void MemoryAllocator::initBlock(Block& block, VkDeviceSize size) {
+    block.size = size;
+    block.ranges.clear();
+    block.unusedRanges.clear();
+    block.flBitmap = 0;
+    block.slBitmaps.fill(0);
+    block.heads.fill(NO_RANGE);
+    block.used = 0;
+    block.allocationCount = 0;
+
+    uint32_t whole = newRange(block, 0, size);
+    insertFree(block, whole);
+}
+
+bool MemoryAllocator::allocateFromBlock(Block& block, VkDeviceSize size, VkDeviceSize alignment, uint32_t& rangeIndex) {
+    size = roundUp(std::max(size, GRANULE), GRANULE);
+    alignment = std::max(alignment, GRANULE);
+
+    // enough for the range to be aligned wherever it starts
+    uint32_t found = findFree(block, size + alignment - GRANULE);
+
+    if (found == NO_RANGE) {
+        return false;
+    }
+
+    removeFree(block, found);
+
+    VkDeviceSize aligned = roundUp(block.ranges[found].offset, alignment);
+    VkDeviceSize padding = aligned - block.ranges[found].offset;
+
+    // free ranges never touch, so whatever is split off can't be merged with anything
+    if (padding > 0) {
+        uint32_t front = newRange(block, block.ranges[found].offset, padding);
+        uint32_t prev = block.ranges[found].prevPhysical;
+
+        block.ranges[front].prevPhysical = prev;
+        block.ranges[front].nextPhysical = found;
+
+        if (prev != NO_RANGE) {
+            block.ranges[prev].nextPhysical = front;
+        }
+
+        block.ranges[found].prevPhysical = front;
+        block.ranges[found].offset = aligned;
+        block.ranges[found].size -= padding;
+
+        insertFree(block, front);
+    }
+
+    if (block.ranges[found].size > size) {
+        uint32_t back = newRange(block, aligned + size, block.ranges[found].size - size);
+        uint32_t next = block.ranges[found].nextPhysical;
+
+        block.ranges[back].prevPhysical = found;
+        block.ranges[back].nextPhysical = next;
+
+        if (next != NO_RANGE) {
+            block.ranges[next].prevPhysical = back;
+        }
+
+        block.ranges[found].nextPhysical = back;
+        block.ranges[found].size = size;
+
+        insertFree(block, back);
+    }
+
+    block.used += size;
+    block.allocationCount++;
+    rangeIndex = found;
+
+    return true;
+}
+
+void MemoryAllocator::freeToBlock(Block& block, uint32_t rangeIndex) {
+    block.used -= block.ranges[rangeIndex].size;
+    block.allocationCount--;
+
+    uint32_t prev = block.ranges[rangeIndex].prevPhysical;
+
+    if (prev != NO_RANGE && block.ranges[prev].free) {
+        removeFree(block, prev);
+
+        block.ranges[prev].size += block.ranges[rangeIndex].size;
+        block.ranges[prev].nextPhysical = block.ranges[rangeIndex].nextPhysical;
+
+        if (block.ranges[prev].nextPhysical != NO_RANGE) {
+            block.ranges[block.ranges[prev].nextPhysical].prevPhysical = prev;
+        }
+
+        block.unusedRanges.push_back(rangeIndex);
+        rangeIndex = prev;
+    }
+
+    uint32_t next = block.ranges[rangeIndex].nextPhysical;
+
+    if (next != NO_RANGE && block.ranges[next].free) {
+        removeFree(block, next);
+
+        block.ranges[rangeIndex].size += block.ranges[next].size;
+        block.ranges[rangeIndex].nextPhysical = block.ranges[next].nextPhysical;
+
+        if (block.ranges[rangeIndex].nextPhysical != NO_RANGE) {
+            block.ranges[block.ranges[rangeIndex].nextPhysical].prevPhysical = rangeIndex;
+        }
+
+        block.unusedRanges.push_back(next);
+    }
+
+    insertFree(block, rangeIndex);
+}
+
+uint32_t MemoryAllocator::newRange(Block& block, VkDeviceSize offset, VkDeviceSize size) {
+    uint32_t index;
+
+    if (!block.unusedRanges.empty()) {
+        index = block.unusedRanges.back();
+        block.unusedRanges.pop_back();
+    } else {
+        index = static_cast<uint32_t>(block.ranges.size());
+        block.ranges.emplace_back();
+    }
+
+    block.ranges[index] = { offset, size, NO_RANGE, NO_RANGE, NO_RANGE, NO_RANGE, false };
+
+    return index;
+}
+
+void MemoryAllocator::insertFree(Block& block, uint32_t rangeIndex) {
+    uint32_t fl, sl;
+    getSizeClass(block.ranges[rangeIndex].size, SL_BITS, fl, sl);
+
+    uint32_t& head = block.heads[fl * SL_COUNT + sl];
+    Range& range = block.ranges[rangeIndex];
+
+    range.free = true;
+    range.prevFree = NO_RANGE;
+    range.nextFree = head;
+
+    if (head != NO_RANGE) {
+        block.ranges[head].prevFree = rangeIndex;
+    }
+
+    head = rangeIndex;
+
+    block.flBitmap |= uint64_t(1) << fl;
+    block.slBitmaps[fl] |= 1u << sl;
+}
+
+void MemoryAllocator::removeFree(Block& block, uint32_t rangeIndex) {
+    uint32_t fl, sl;
+    getSizeClass(block.ranges[rangeIndex].size, SL_BITS, fl, sl);
+
+    Range& range = block.ranges[rangeIndex];
+
+    if (range.prevFree != NO_RANGE) {
+        block.ranges[range.prevFree].nextFree = range.nextFree;
+    } else {
+        block.heads[fl * SL_COUNT + sl] = range.nextFree;
+    }
+
+    if (range.nextFree != NO_RANGE) {
+        block.ranges[range.nextFree].prevFree = range.prevFree;
+    }
+
+    range.free = false;
+
+    if (block.heads[fl * SL_COUNT + sl] == NO_RANGE) {
+        block.slBitmaps[fl] &= ~(1u << sl);
+
+        if (block.slBitmaps[fl] == 0) {
+            block.flBitmap &= ~(uint64_t(1) << fl);
+        }
+    }
+}
+
+// a free range of at least size, from the smallest size class that's sure to fit it
+uint32_t MemoryAllocator::findFree(const Block& block, VkDeviceSize size) const {
+    size += (VkDeviceSize(1) << (highestBit(size) - SL_BITS)) - 1;
+
+    uint32_t fl, sl;
+    getSizeClass(size, SL_BITS, fl, sl);
+
+    if (fl >= FL_COUNT) {
+        return NO_RANGE;
+    }
+
+    uint32_t slMap = block.slBitmaps[fl] & (~0u << sl);
+
+    if (slMap == 0) {
+        uint64_t flMap = block.flBitmap & (~uint64_t(0) << (fl + 1));
+
+        if (flMap == 0) {
+            return NO_RANGE;
+        }
+
+        fl = lowestBit(flMap);
+        slMap = block.slBitmaps[fl];
+    }
+
+    return block.heads[fl * SL_COUNT + lowestBit(slMap)];
+}
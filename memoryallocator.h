@@ -0,0 +1,154 @@
+#ifndef _MEMORY_ALLOCATOR_H
+#define _MEMORY_ALLOCATOR_H
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// where a buffer or image lives, bound at offset into memory
+struct MemoryAllocation {
+    enum class Source : uint8_t {
+        NONE,
+        BLOCK,
+        DEDICATED,
+        TRANSIENT
+    };
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    // at offset, null unless the memory is host visible (those are mapped for as long as they live)
+    char* mapped = nullptr;
+
+    // what free needs to give it back
+    Source source = Source::NONE;
+    uint32_t pool = 0;
+    uint32_t block = 0;
+    uint32_t range = 0;
+};
+
+// Sub-allocates buffers and images out of a few big VkDeviceMemory blocks, instead of one
+// vkAllocateMemory each (drivers can limit them to as few as 4096). Every memory type has
+// its own pools, one for buffers and linear images and one for optimal images, so the two
+// never have to be kept bufferImageGranularity apart. The ranges in a block are managed
+// with TLSF (Masmoudi et al. 2004): free ranges are kept in lists by size class, found
+// through two levels of bitmaps and merged with their free neighbours, so allocating from
+// and freeing to a block are constant time. allocate still tries the pool's blocks in turn,
+// so its cost grows with the number of blocks. Anything bigger than half a block gets its
+// own memory.
+// Transient allocations (staging) are bumped out of their own blocks and all freed at once.
+class MemoryAllocator {
+public:
+
+    enum class Kind {
+        LINEAR,
+        OPTIMAL
+    };
+
+    static const VkDeviceSize BLOCK_SIZE = 64 * 1024 * 1024;
+
+    void init(VkPhysicalDevice physicalDevice, VkDevice device);
+
+    // frees every block, whatever is still allocated out of them
+    void destroy();
+
+    MemoryAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, Kind kind);
+
+    // leaves allocation empty, transient allocations are left for resetTransient
+    void free(MemoryAllocation& allocation);
+
+    // only for linear resources, they all stay valid until resetTransient
+    MemoryAllocation allocateTransient(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties);
+
+    // the blocks are kept for the next transient allocations
+    void resetTransient();
+
+    // usage and fragmentation of every pool
+    void dump(std::ostream& out) const;
+
+private:
+
+    static const uint32_t SL_BITS = 4;
+    static const uint32_t SL_COUNT = 1 << SL_BITS;
+    static const uint32_t FL_COUNT = 48;
+    static const uint32_t NO_RANGE = UINT32_MAX;
+
+    // a piece of a block, in order with its neighbours, and in its size class's list if it's free
+    struct Range {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+        uint32_t prevPhysical;
+        uint32_t nextPhysical;
+        uint32_t prevFree;
+        uint32_t nextFree;
+        bool free;
+    };
+
+    struct Block {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        char* mapped = nullptr;
+
+        std::vector<Range> ranges;
+        std::vector<uint32_t> unusedRanges;
+
+        uint64_t flBitmap = 0;
+        std::array<uint32_t, FL_COUNT> slBitmaps{};
+        std::array<uint32_t, FL_COUNT * SL_COUNT> heads{};
+
+        VkDeviceSize used = 0;
+        uint32_t allocationCount = 0;
+    };
+
+    struct Pool {
+        uint32_t memoryType;
+        Kind kind;
+        VkDeviceSize blockSize;
+        // an empty one is freed, and its slot reused
+        std::vector<Block> blocks;
+        // the ones with memory
+        uint32_t liveBlocks = 0;
+        uint32_t dedicatedCount = 0;
+        VkDeviceSize dedicatedSize = 0;
+    };
+
+    struct TransientBlock {
+        VkDeviceMemory memory;
+        VkDeviceSize size;
+        char* mapped;
+    };
+
+    struct TransientPool {
+        uint32_t memoryType;
+        std::vector<TransientBlock> blocks;
+        // bumped through the blocks in order
+        size_t current = 0;
+        VkDeviceSize offset = 0;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memProperties{};
+    uint32_t maxAllocationCount = 0;
+    uint32_t allocationCount = 0;
+
+    std::vector<Pool> pools;
+    std::vector<TransientPool> transientPools;
+
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+    VkDeviceMemory allocateMemory(uint32_t memoryType, VkDeviceSize size, char*& mapped);
+    void freeMemory(VkDeviceMemory memory);
+
+    void initBlock(Block& block, VkDeviceSize size);
+    bool allocateFromBlock(Block& block, VkDeviceSize size, VkDeviceSize alignment, uint32_t& rangeIndex);
+    void freeToBlock(Block& block, uint32_t rangeIndex);
+
+    uint32_t newRange(Block& block, VkDeviceSize offset, VkDeviceSize size);
+    void insertFree(Block& block, uint32_t rangeIndex);
+    void removeFree(Block& block, uint32_t rangeIndex);
+    uint32_t findFree(const Block& block, VkDeviceSize size) const;
+};
+
+#endif // _MEMORY_ALLOCATOR_H
@@ -0,0 +1,109 @@
+#include "meshindexer.h"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+const uint32_t EMPTY_SLOT = std::numeric_limits<uint32_t>::max();
+
+// hashes the raw bytes, so only vertices that are bit for bit the same get welded
+uint32_t hashVertex(const char* vertex, size_t size) {
+    uint32_t hash = 2166136261u;
+    size_t i = 0;
+
+    for (; i + sizeof(uint32_t) <= size; i += sizeof(uint32_t)) {
+        uint32_t word;
+        std::memcpy(&word, vertex + i, sizeof(word));
+
+        hash = (hash ^ word) * 16777619u;
+        hash ^= hash >> 15;
+    }
+
+    for (; i < size; i++) {
+        hash = (hash ^ static_cast<uint8_t>(vertex[i])) * 16777619u;
+    }
+
+    return hash;
+}
+
+} // namespace
+
+void MeshIndexer::weldVertices(Mesh& mesh) {
+    size_t stride = mesh.layout.stride;
+    size_t count = mesh.vertexDataCount;
+
+    const char* source = mesh.getVertexData();
+
+    if (count > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("Mesh " + mesh.name + " has too many vertices to index");
+    }
+
+    // open addressing at a load factor of at most a half, each slot holds an index into unique
+    size_t tableSize = 16;
+    while (tableSize < count * 2) {
+        tableSize *= 2;
+    }
+
+    std::vector<uint32_t> table(tableSize, EMPTY_SLOT);
+    size_t mask = tableSize - 1;
+
+    std::vector<char> unique;
+    unique.reserve(count * stride);
+    uint32_t uniqueCount = 0;
+
+    std::vector<uint32_t> indices(count);
+
+    for (size_t i = 0; i < count; i++) {
+        const char* vertex = source + i * stride;
+        size_t slot = hashVertex(vertex, stride) & mask;
+
+        while (table[slot] != EMPTY_SLOT && std::memcmp(unique.data() + table[slot] * stride, vertex, stride) != 0) {
+            slot = (slot + 1) & mask;
+        }
+
+        if (table[slot] == EMPTY_SLOT) {
+            table[slot] = uniqueCount++;
+            unique.insert(unique.end(), vertex, vertex + stride);
+        }
+
+        indices[i] = table[slot];
+    }
+
+    unique.shrink_to_fit();
+
+    mesh.vertexData = std::move(unique);
+    mesh.vertexDataCount = uniqueCount;
+    mesh.mappedVertices = nullptr;
+
+    mesh.indices = std::move(indices);
+    mesh.indexCount = static_cast<uint32_t>(mesh.indices.size());
+    mesh.indexType = getIndexType(uniqueCount);
+}
+
+VkIndexType MeshIndexer::getIndexType(size_t vertexCount) {
+    // 0xFFFF is left out, it's the restart index if primitive restart is ever turned on
+    if (vertexCount <= std::numeric_limits<uint16_t>::max()) {
+        return VK_INDEX_TYPE_UINT16;
+    }
+
+    return VK_INDEX_TYPE_UINT32;
+}
+
+size_t MeshIndexer::getIndexSize(VkIndexType indexType) {
+    return indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+void MeshIndexer::packIndices(const uint32_t* indices, size_t count, VkIndexType indexType, void* dst) {
+    if (indexType == VK_INDEX_TYPE_UINT32) {
+        std::memcpy(dst, indices, count * sizeof(uint32_t));
+        return;
+    }
+
+    uint16_t* out = static_cast<uint16_t*>(dst);
+
+    for (size_t i = 0; i < count; i++) {
+        out[i] = static_cast<uint16_t>(indices[i]);
+    }
+}
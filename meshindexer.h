@@ -0,0 +1,30 @@
+#ifndef _MESH_INDEXER_H
+#define _MESH_INDEXER_H
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "scene.h"
+
+// Turns the flat vertex list read from the .b72 files into an indexed mesh. Vertices
+// with exactly the same bytes in the mesh's layout are welded into one through a hash
+// table, the draw order is kept, and the index type is the smallest one that can address
+// what's left.
+class MeshIndexer {
+public:
+
+    // replaces the vertices with the unique ones in mesh.vertexData and fills mesh.indices and mesh.indexType
+    static void weldVertices(Mesh& mesh);
+
+    // VK_INDEX_TYPE_UINT16 if every index fits in 16 bits, VK_INDEX_TYPE_UINT32 otherwise
+    static VkIndexType getIndexType(size_t vertexCount);
+
+    static size_t getIndexSize(VkIndexType indexType);
+
+    // writes count indices to dst at the size of indexType
+    static void packIndices(const uint32_t* indices, size_t count, VkIndexType indexType, void* dst);
+};
+
+#endif // _MESH_INDEXER_H
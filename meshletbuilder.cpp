@@ -0,0 +1,148 @@
+#include "meshletbuilder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace {
+
+glm::vec3 getPosition(const Mesh& mesh, uint32_t vertex) {
+    glm::vec3 pos;
+    std::memcpy(&pos, mesh.getVertexData() + static_cast<size_t>(vertex) * mesh.layout.stride + mesh.layout.offsets[0], sizeof(pos));
+
+    return pos;
+}
+
+// bounding sphere around the middle of the AABB, and the cone around the triangle normals
+void computeBounds(const Mesh& mesh, const std::vector<uint32_t>& vertices, Meshlet& meshlet) {
+    glm::vec3 minimum(std::numeric_limits<float>::max());
+    glm::vec3 maximum(std::numeric_limits<float>::lowest());
+
+    for (uint32_t vertex : vertices) {
+        glm::vec3 pos = getPosition(mesh, vertex);
+
+        minimum = glm::min(minimum, pos);
+        maximum = glm::max(maximum, pos);
+    }
+
+    meshlet.center = (minimum + maximum) * 0.5f;
+    meshlet.radius = 0.0f;
+
+    for (uint32_t vertex : vertices) {
+        meshlet.radius = std::max(meshlet.radius, glm::length(getPosition(mesh, vertex) - meshlet.center));
+    }
+
+    std::vector<glm::vec3> normals;
+    normals.reserve(meshlet.indexCount / 3);
+
+    glm::vec3 axis(0.0f);
+
+    for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3) {
+        glm::vec3 a = getPosition(mesh, mesh.getIndex(i));
+        glm::vec3 b = getPosition(mesh, mesh.getIndex(i + 1));
+        glm::vec3 c = getPosition(mesh, mesh.getIndex(i + 2));
+
+        // counter clockwise is the front, like the pipeline
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+
+        // degenerate triangles are never drawn, so they don't count
+        if (length > 0.0f) {
+            normals.push_back(normal / length);
+            axis += normals.back();
+        }
+    }
+
+    meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+    meshlet.coneCutoff = 1.0f;
+
+    float axisLength = glm::length(axis);
+
+    if (normals.empty() || axisLength == 0.0f) {
+        return;
+    }
+
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+
+    for (const glm::vec3& normal : normals) {
+        minDot = std::min(minDot, glm::dot(axis, normal));
+    }
+
+    // a cone wider than a half space can't be behind the camera
+    if (minDot <= 0.0f) {
+        return;
+    }
+
+    meshlet.coneAxis = axis;
+    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+} // namespace
+
+void MeshletBuilder::buildMeshlets(Mesh& mesh) {
+    mesh.meshlets.clear();
+
+    if (mesh.topology != "TRIANGLE_LIST" || mesh.indexCount < 3 || mesh.layout.formats[0] != VK_FORMAT_R32G32B32_SFLOAT) {
+        return;
+    }
+
+    uint32_t triangleCount = mesh.indexCount / 3;
+
+    // the meshlet each vertex was last added to, so it's only counted once per meshlet
+    std::vector<uint32_t> lastMeshlet(mesh.vertexDataCount, std::numeric_limits<uint32_t>::max());
+    std::vector<uint32_t> vertices;
+
+    Meshlet meshlet{};
+
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        uint32_t corners[3] = { mesh.getIndex(3 * t), mesh.getIndex(3 * t + 1), mesh.getIndex(3 * t + 2) };
+        uint32_t meshletIndex = static_cast<uint32_t>(mesh.meshlets.size());
+
+        uint32_t newVertices = 0;
+
+        for (size_t c = 0; c < 3; c++) {
+            bool repeated = (c > 0 && corners[c] == corners[0]) || (c > 1 && corners[c] == corners[1]);
+
+            if (lastMeshlet[corners[c]] != meshletIndex && !repeated) {
+                newVertices++;
+            }
+        }
+
+        if (meshlet.indexCount > 0
+            && (vertices.size() + newVertices > MAX_VERTICES || meshlet.indexCount / 3 + 1 > MAX_TRIANGLES)) {
+            computeBounds(mesh, vertices, meshlet);
+            mesh.meshlets.push_back(meshlet);
+
+            meshletIndex++;
+            meshlet = Meshlet{};
+            meshlet.firstIndex = 3 * t;
+            vertices.clear();
+        }
+
+        for (uint32_t corner : corners) {
+            if (lastMeshlet[corner] != meshletIndex) {
+                lastMeshlet[corner] = meshletIndex;
+                vertices.push_back(corner);
+            }
+        }
+
+        meshlet.indexCount += 3;
+    }
+
+    computeBounds(mesh, vertices, meshlet);
+    mesh.meshlets.push_back(meshlet);
+}
+
+bool MeshletBuilder::isBackFacing(const Meshlet& meshlet, const glm::vec3& cameraPosition) {
+    if (meshlet.coneCutoff >= 1.0f) {
+        return false;
+    }
+
+    glm::vec3 toCenter = meshlet.center - cameraPosition;
+
+    return glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+}
@@ -0,0 +1,25 @@
+#ifndef _MESHLET_BUILDER_H
+#define _MESHLET_BUILDER_H
+
+#include <cstdint>
+
+#include "scene.h"
+
+// Cuts the index buffer of a mesh into meshlets, so a mesh that's only partly on screen
+// (or mostly facing away) doesn't have to be drawn whole. The triangles are taken in the
+// order they are drawn, so every meshlet is a contiguous range of the index buffer and
+// the index buffer itself doesn't change (run MeshOptimizer first for tighter meshlets).
+class MeshletBuilder {
+public:
+
+    static const uint32_t MAX_VERTICES = 64;
+    static const uint32_t MAX_TRIANGLES = 124;
+
+    // fills mesh.meshlets, leaves it empty unless the mesh is a TRIANGLE_LIST with float positions
+    static void buildMeshlets(Mesh& mesh);
+
+    // every triangle of the meshlet faces away from the camera, cameraPosition is in the mesh's own space
+    static bool isBackFacing(const Meshlet& meshlet, const glm::vec3& cameraPosition);
+};
+
+#endif // _MESHLET_BUILDER_H
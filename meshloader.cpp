@@ -0,0 +1,229 @@
+#include "meshloader.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "meshindexer.h"
+#include "vertexkernels.h"
+
+namespace {
+
+// points the mesh at its authored indices and returns how many vertices they address
+uint32_t mapIndices(Mesh& mesh, SourceFileCache& sourceFiles) {
+    const Indices& indices = mesh.indicesData;
+
+    if (indices.format == "UINT16") {
+        mesh.indexType = VK_INDEX_TYPE_UINT16;
+    } else if (indices.format == "UINT32") {
+        mesh.indexType = VK_INDEX_TYPE_UINT32;
+    } else {
+        throw std::runtime_error("Unexpected index format " + indices.format + " for mesh " + mesh.name);
+    }
+
+    mesh.indexCount = mesh.vertexCount;
+
+    if (mesh.indexCount == 0) {
+        return 0;
+    }
+
+    const MappedFile& file = sourceFiles.acquire(indices.src);
+
+    uint64_t end = indices.offset + static_cast<uint64_t>(mesh.indexCount) * MeshIndexer::getIndexSize(mesh.indexType);
+
+    if (end > file.size()) {
+        throw std::runtime_error("The indices of mesh " + mesh.name + " read past the end of " + indices.src);
+    }
+
+    mesh.mappedIndices = file.data() + indices.offset;
+
+    uint32_t maxIndex = 0;
+
+    for (uint32_t i = 0; i < mesh.indexCount; i++) {
+        maxIndex = std::max(maxIndex, mesh.getIndex(i));
+    }
+
+    if (maxIndex == std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("Mesh " + mesh.name + " uses the restart index, which isn't supported");
+    }
+
+    return maxIndex + 1;
+}
+
+} // namespace
+
+void MeshLoader::loadVertices(Mesh& mesh, SourceFileCache& sourceFiles) {
+    uint32_t vertexCount = mesh.vertexCount;
+
+    if (mesh.indicesData.src != "") {
+        vertexCount = mapIndices(mesh, sourceFiles);
+    }
+
+    mesh.vertexDataCount = vertexCount;
+    mesh.vertexData.clear();
+    mesh.mappedVertices = nullptr;
+
+    // where each attribute's first vertex is, nullptr if the mesh doesn't have it
+    std::array<const char*, 3> sources{};
+
+    for (size_t i = 0; i < mesh.attributes.size(); i++) {
+        const Attribute& attr = mesh.attributes[i];
+
+        // a mesh without normals or colors has an empty slot for them
+        if (attr.name == "") {
+            continue;
+        }
+
+        size_t size = getFormatSize(attr.format);
+
+        if (size == 0) {
+            std::cout << "Unexpected input format: " << attr.format << std::endl;
+            continue;
+        }
+
+        bool isVec3 = attr.name == "POSITION" || attr.name == "NORMAL";
+
+        if ((isVec3 && attr.format != "R32G32B32_SFLOAT") || (attr.name == "COLOR" && attr.format != "R8G8B8A8_UNORM")) {
+            throw std::runtime_error("Unexpected format " + attr.format + " for the " + attr.name + " attribute of mesh " + mesh.name);
+        }
+
+        if (vertexCount == 0) {
+            continue;
+        }
+
+        const MappedFile& file = sourceFiles.acquire(attr.src);
+
+        // where the last vertex of this attribute ends
+        uint64_t end = attr.offset + static_cast<uint64_t>(attr.stride) * (vertexCount - 1) + size;
+
+        if (end > file.size()) {
+            throw std::runtime_error("The " + attr.name + " attribute of mesh " + mesh.name + " reads past the end of " + attr.src);
+        }
+
+        sources[i] = file.data() + attr.offset;
+    }
+
+    if (mapNativeVertices(mesh, sourceFiles)) {
+        return;
+    }
+
+    mesh.layout = VertexLayout::getDecoded();
+    mesh.vertexData.assign(static_cast<size_t>(vertexCount) * mesh.layout.stride, 0);
+
+    VertexKernels::Kernel kernel = VertexKernels::getKernel();
+
+    for (size_t i = 0; i < mesh.attributes.size(); i++) {
+        const Attribute& attr = mesh.attributes[i];
+
+        if (sources[i] == nullptr) {
+            continue;
+        }
+
+        char* dst = mesh.vertexData.data() + mesh.layout.offsets[i];
+
+        if (attr.name == "POSITION" || attr.name == "NORMAL") {
+            VertexKernels::gatherFloat3(kernel, sources[i], attr.stride, vertexCount, dst, mesh.layout.stride);
+        } else if (attr.name == "COLOR") {
+            VertexKernels::convertColors(kernel, sources[i], attr.stride, vertexCount, dst, mesh.layout.stride);
+        } else {
+            std::cout << "Unexpected attribute name: " << attr.name << std::endl;
+        }
+    }
+}
+
+bool MeshLoader::mapNativeVertices(Mesh& mesh, SourceFileCache& sourceFiles) {
+    if (mesh.vertexDataCount == 0 || mesh.attributes.size() != 3) {
+        return false;
+    }
+
+    const Attribute& first = mesh.attributes[0];
+    uint32_t base = first.offset;
+
+    for (const Attribute& attr : mesh.attributes) {
+        // the shader reads all three, and they have to be interleaved in the same records
+        if (attr.name == "" || attr.src != first.src || attr.stride != first.stride) {
+            return false;
+        }
+
+        base = std::min(base, attr.offset);
+    }
+
+    uint32_t stride = first.stride;
+
+    if (stride == 0 || stride % 4 != 0 || stride > MAX_NATIVE_STRIDE) {
+        return false;
+    }
+
+    VertexLayout layout;
+    layout.stride = stride;
+
+    for (size_t i = 0; i < mesh.attributes.size(); i++) {
+        const Attribute& attr = mesh.attributes[i];
+        uint32_t offset = attr.offset - base;
+
+        // the components have to be aligned for the vertex fetch
+        if (offset % 4 != 0 || offset + getFormatSize(attr.format) > stride) {
+            return false;
+        }
+
+        layout.formats[i] = getVkFormat(attr.format);
+        layout.offsets[i] = offset;
+    }
+
+    const MappedFile& file = sourceFiles.acquire(first.src);
+
+    // the whole of the last record has to be in the file too, it's uploaded with the rest
+    if (base + static_cast<uint64_t>(stride) * mesh.vertexDataCount > file.size()) {
+        return false;
+    }
+
+    mesh.layout = layout;
+    mesh.mappedVertices = file.data() + base;
+
+    return true;
+}
+
+void MeshLoader::copyMappedData(Mesh& mesh) {
+    if (mesh.mappedVertices != nullptr) {
+        mesh.vertexData.assign(mesh.mappedVertices, mesh.mappedVertices + static_cast<size_t>(mesh.vertexDataCount) * mesh.layout.stride);
+        mesh.mappedVertices = nullptr;
+    }
+
+    if (mesh.mappedIndices != nullptr) {
+        std::vector<uint32_t> indices(mesh.indexCount);
+
+        for (uint32_t i = 0; i < mesh.indexCount; i++) {
+            indices[i] = mesh.getIndex(i);
+        }
+
+        mesh.indices = std::move(indices);
+
+        mesh.mappedIndices = nullptr;
+    }
+}
+
+size_t MeshLoader::getFormatSize(std::string_view format) {
+    if (format == "R32G32B32_SFLOAT") {
+        return 12;
+    } else if (format == "R8G8B8A8_UNORM") {
+        return 4;
+    }
+
+    return 0;
+}
+
+VkFormat MeshLoader::getVkFormat(std::string_view format) {
+    if (format == "R32G32B32_SFLOAT") {
+        return VK_FORMAT_R32G32B32_SFLOAT;
+    } else if (format == "R8G8B8A8_UNORM") {
+        return VK_FORMAT_R8G8B8A8_UNORM;
+    }
+
+    return VK_FORMAT_UNDEFINED;
+}
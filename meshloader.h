@@ -0,0 +1,50 @@
+#ifndef _MESH_LOADER_H
+#define _MESH_LOADER_H
+
+#include <cstddef>
+#include <string_view>
+
+#include "scene.h"
+#include "sourcefilecache.h"
+
+// Reads the vertices of a mesh out of its .b72 files. The files are mapped through a
+// SourceFileCache and read in place.
+//
+// When POSITION, NORMAL and COLOR are interleaved in the same records of one file, in
+// formats the vertex fetch can read, the records are the vertices: mesh.layout describes
+// them and mesh.mappedVertices points at them in the mapped file, and their bytes go to
+// the GPU unchanged. Otherwise every attribute is read from its own src at its own
+// offset and stride and decoded into Vertex structs in mesh.vertexData.
+//
+// A mesh with an "indices" block draws count indices, and has as many vertices as the
+// largest of them addresses. Its indices are left where they are in the mapped file,
+// mesh.mappedIndices points at them, and they are copied straight into the staging
+// buffer when the mesh is uploaded.
+class MeshLoader {
+public:
+
+    // Vulkan only guarantees strides up to this, anything wider is decoded
+    static const uint32_t MAX_NATIVE_STRIDE = 2048;
+
+    // fills mesh.layout and mesh.vertexData or mappedVertices, and for authored indices
+    // mappedIndices, indexType and indexCount as well, without authored indices there is
+    // one vertex per count and MeshIndexer welds them afterwards, throws if an attribute or
+    // the indices read past the end of their file
+    static void loadVertices(Mesh& mesh, SourceFileCache& sourceFiles);
+
+    // copies the mapped vertices and indices into mesh.vertexData and mesh.indices, for when they have to outlive the file
+    static void copyMappedData(Mesh& mesh);
+
+    // bytes per vertex of an attribute format, 0 if it isn't supported
+    static size_t getFormatSize(std::string_view format);
+
+    // VK_FORMAT_UNDEFINED if it isn't supported
+    static VkFormat getVkFormat(std::string_view format);
+
+private:
+
+    // points the mesh at its records if they can be uploaded as they are
+    static bool mapNativeVertices(Mesh& mesh, SourceFileCache& sourceFiles);
+};
+
+#endif // _MESH_LOADER_H
@@ -0,0 +1,343 @@
+#include "meshoptimizer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "meshindexer.h"
+
+namespace {
+
+const uint32_t NO_VERTEX = std::numeric_limits<uint32_t>::max();
+
+// clusters are only cut once they have at least this many triangles, and only where the
+// cluster so far has an ACMR within this factor of the whole Tipsify output (with the
+// cache flushed at the start of the cluster, so sorting them can't make it worse)
+const uint32_t MIN_CLUSTER_TRIANGLES = 64;
+const float CLUSTER_ACMR_SLACK = 1.05f;
+
+// Tipsify, returns the reordered indices, the triangle each hard cluster starts at goes in clusterStarts
+std::vector<uint32_t> tipsify(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize, std::vector<uint32_t>& clusterStarts) {
+    size_t triangleCount = indices.size() / 3;
+
+    // the triangles of every vertex, as offsets into one array
+    std::vector<uint32_t> live(vertexCount, 0);
+
+    for (uint32_t v : indices) {
+        live[v]++;
+    }
+
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+
+    for (size_t v = 0; v < vertexCount; v++) {
+        offsets[v + 1] = offsets[v] + live[v];
+    }
+
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+
+    for (size_t i = 0; i < indices.size(); i++) {
+        adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    // a vertex is in the cache if it was last added fewer than cacheSize misses ago
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    size_t cursor = 0;
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    auto skipDeadEnd = [&]() -> uint32_t {
+        while (!deadEnds.empty()) {
+            uint32_t v = deadEnds.back();
+            deadEnds.pop_back();
+
+            if (live[v] > 0) {
+                return v;
+            }
+        }
+
+        while (cursor < vertexCount) {
+            if (live[cursor] > 0) {
+                return static_cast<uint32_t>(cursor);
+            }
+
+            cursor++;
+        }
+
+        return NO_VERTEX;
+    };
+
+    uint32_t fanning = skipDeadEnd();
+
+    while (fanning != NO_VERTEX) {
+        candidates.clear();
+
+        for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; a++) {
+            uint32_t t = adjacency[a];
+
+            if (emitted[t]) {
+                continue;
+            }
+
+            for (size_t c = 0; c < 3; c++) {
+                uint32_t v = indices[3 * t + c];
+
+                result.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+
+                if (time - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = time++;
+                }
+            }
+
+            emitted[t] = true;
+        }
+
+        // the candidate that will still be in the cache after its remaining triangles, and is the oldest there
+        uint32_t next = NO_VERTEX;
+        int64_t bestPriority = -1;
+
+        for (uint32_t v : candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+
+            int64_t priority = 0;
+
+            if (time - cacheTime[v] + 2 * live[v] <= cacheSize) {
+                priority = time - cacheTime[v];
+            }
+
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+
+        if (next == NO_VERTEX) {
+            next = skipDeadEnd();
+
+            if (next != NO_VERTEX) {
+                clusterStarts.push_back(static_cast<uint32_t>(result.size() / 3));
+            }
+        }
+
+        fanning = next;
+    }
+
+    return result;
+}
+
+// cuts the hard clusters further where the cache is doing well, see CLUSTER_ACMR_SLACK
+std::vector<uint32_t> splitClusters(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize, const std::vector<uint32_t>& hardStarts, float targetACMR) {
+    size_t triangleCount = indices.size() / 3;
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+
+    std::vector<uint32_t> starts;
+    size_t nextHard = 0;
+
+    uint32_t clusterTriangles = 0;
+    uint32_t clusterMisses = 0;
+
+    for (size_t t = 0; t < triangleCount; t++) {
+        bool hard = nextHard < hardStarts.size() && hardStarts[nextHard] == t;
+
+        if (hard || t == 0) {
+            if (hard) {
+                nextHard++;
+            }
+
+            starts.push_back(static_cast<uint32_t>(t));
+
+            // flush the cache
+            time += cacheSize + 1;
+            clusterTriangles = 0;
+            clusterMisses = 0;
+        }
+
+        for (size_t c = 0; c < 3; c++) {
+            uint32_t v = indices[3 * t + c];
+
+            if (time - cacheTime[v] > cacheSize) {
+                cacheTime[v] = time++;
+                clusterMisses++;
+            }
+        }
+
+        clusterTriangles++;
+
+        bool nextIsHard = nextHard < hardStarts.size() && hardStarts[nextHard] == t + 1;
+
+        if (!nextIsHard && t + 1 < triangleCount && clusterTriangles >= MIN_CLUSTER_TRIANGLES
+            && static_cast<float>(clusterMisses) <= targetACMR * clusterTriangles) {
+            starts.push_back(static_cast<uint32_t>(t + 1));
+
+            time += cacheSize + 1;
+            clusterTriangles = 0;
+            clusterMisses = 0;
+        }
+    }
+
+    return starts;
+}
+
+glm::vec3 getPosition(const Mesh& mesh, uint32_t vertex) {
+    glm::vec3 pos;
+    std::memcpy(&pos, mesh.vertexData.data() + static_cast<size_t>(vertex) * mesh.layout.stride + mesh.layout.offsets[0], sizeof(pos));
+
+    return pos;
+}
+
+// sorts the clusters so the ones facing away from the middle of the mesh are drawn first
+std::vector<uint32_t> sortClusters(const std::vector<uint32_t>& indices, const Mesh& mesh, const std::vector<uint32_t>& starts) {
+    size_t triangleCount = indices.size() / 3;
+
+    struct Cluster {
+        uint32_t first;
+        uint32_t end;
+        glm::vec3 centroid;
+        glm::vec3 normal;
+        float sortKey;
+    };
+
+    std::vector<Cluster> clusters(starts.size());
+
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+
+    for (size_t c = 0; c < clusters.size(); c++) {
+        Cluster& cluster = clusters[c];
+
+        cluster.first = starts[c];
+        cluster.end = c + 1 < starts.size() ? starts[c + 1] : static_cast<uint32_t>(triangleCount);
+        cluster.centroid = glm::vec3(0.0f);
+        cluster.normal = glm::vec3(0.0f);
+
+        float area = 0.0f;
+
+        for (uint32_t t = cluster.first; t < cluster.end; t++) {
+            glm::vec3 a = getPosition(mesh, indices[3 * t]);
+            glm::vec3 b = getPosition(mesh, indices[3 * t + 1]);
+            glm::vec3 d = getPosition(mesh, indices[3 * t + 2]);
+
+            // twice the area, pointing along the face normal
+            glm::vec3 n = glm::cross(b - a, d - a);
+            float triangleArea = glm::length(n);
+
+            cluster.normal += n;
+            cluster.centroid += (a + b + d) * (triangleArea / 3.0f);
+            area += triangleArea;
+        }
+
+        meshCentroid += cluster.centroid;
+        meshArea += area;
+
+        if (area > 0.0f) {
+            cluster.centroid /= area;
+        }
+    }
+
+    if (meshArea > 0.0f) {
+        meshCentroid /= meshArea;
+    }
+
+    for (Cluster& cluster : clusters) {
+        float length = glm::length(cluster.normal);
+
+        cluster.sortKey = length > 0.0f ? glm::dot(cluster.centroid - meshCentroid, cluster.normal / length) : 0.0f;
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+        return a.sortKey > b.sortKey;
+    });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    for (const Cluster& cluster : clusters) {
+        result.insert(result.end(), indices.begin() + 3 * cluster.first, indices.begin() + 3 * cluster.end);
+    }
+
+    return result;
+}
+
+} // namespace
+
+MeshOptimizer::Stats MeshOptimizer::optimize(Mesh& mesh) {
+    Stats stats;
+
+    stats.acmrBefore = computeACMR(mesh.indices, mesh.vertexDataCount);
+    stats.acmrAfter = stats.acmrBefore;
+
+    // the cluster order needs float positions
+    if (mesh.topology != "TRIANGLE_LIST" || mesh.indices.size() % 3 != 0 || mesh.indices.empty()
+        || mesh.mappedVertices != nullptr || mesh.layout.formats[0] != VK_FORMAT_R32G32B32_SFLOAT) {
+        return stats;
+    }
+
+    std::vector<uint32_t> hardStarts;
+    std::vector<uint32_t> indices = tipsify(mesh.indices, mesh.vertexDataCount, CACHE_SIZE, hardStarts);
+
+    float tipsifyACMR = computeACMR(indices, mesh.vertexDataCount);
+
+    std::vector<uint32_t> starts = splitClusters(indices, mesh.vertexDataCount, CACHE_SIZE, hardStarts, tipsifyACMR * CLUSTER_ACMR_SLACK);
+    indices = sortClusters(indices, mesh, starts);
+
+    // renumber the vertices in the order they are first used
+    size_t stride = mesh.layout.stride;
+
+    std::vector<uint32_t> remap(mesh.vertexDataCount, NO_VERTEX);
+    std::vector<char> vertexData;
+    vertexData.reserve(mesh.vertexData.size());
+    uint32_t vertexCount = 0;
+
+    for (uint32_t& index : indices) {
+        if (remap[index] == NO_VERTEX) {
+            remap[index] = vertexCount++;
+
+            const char* vertex = mesh.vertexData.data() + index * stride;
+            vertexData.insert(vertexData.end(), vertex, vertex + stride);
+        }
+
+        index = remap[index];
+    }
+
+    mesh.vertexData = std::move(vertexData);
+    mesh.vertexDataCount = vertexCount;
+    mesh.indices = std::move(indices);
+    mesh.indexType = MeshIndexer::getIndexType(vertexCount);
+
+    stats.acmrAfter = computeACMR(mesh.indices, mesh.vertexDataCount);
+    stats.clusterCount = static_cast<uint32_t>(starts.size());
+
+    return stats;
+}
+
+float MeshOptimizer::computeACMR(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize) {
+    if (indices.size() < 3) {
+        return 0.0f;
+    }
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    size_t misses = 0;
+
+    for (uint32_t v : indices) {
+        if (time - cacheTime[v] > cacheSize) {
+            cacheTime[v] = time++;
+            misses++;
+        }
+    }
+
+    return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+}
@@ -0,0 +1,36 @@
+#ifndef _MESH_OPTIMIZER_H
+#define _MESH_OPTIMIZER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "scene.h"
+
+// Reorders an indexed triangle list for the GPU, without changing what's drawn:
+//   1. the triangles are reordered with Tipsify (Sander et al. 2007) so that consecutive
+//      triangles share vertices that are still in the post-transform cache,
+//   2. the Tipsify output is cut into clusters, which are sorted so the ones facing out
+//      from the middle of the mesh come first and occlude the rest (less overdraw),
+//   3. the vertices are renumbered in the order the indices first use them, so vertex
+//      fetches walk forward through the vertex buffer.
+class MeshOptimizer {
+public:
+
+    // entries of the FIFO cache the optimizer and the ACMR are measured against
+    static const uint32_t CACHE_SIZE = 16;
+
+    struct Stats {
+        // average cache miss ratio, vertex shader runs per triangle, 0.5 at best and 3 at worst
+        float acmrBefore = 0.0f;
+        float acmrAfter = 0.0f;
+        uint32_t clusterCount = 0;
+    };
+
+    // mesh has to be indexed, with its vertices copied out of the file and float positions,
+    // only meshes with TRIANGLE_LIST topology are changed
+    static Stats optimize(Mesh& mesh);
+
+    static float computeACMR(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+};
+
+#endif // _MESH_OPTIMIZER_H
@@ -0,0 +1,83 @@
+#include "meshpipeline.h"
+
+#include <algorithm>
+
+MeshPipeline::MeshPipeline(size_t meshCount, std::function<void(size_t)> prepare)
+    : meshCount(meshCount), handedBack(0), prepare(std::move(prepare)), nextMesh(0), stopping(false) {
+    size_t threadCount = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), meshCount);
+
+    for (size_t i = 0; i < threadCount; i++) {
+        workers.emplace_back(&MeshPipeline::work, this);
+    }
+}
+
+MeshPipeline::~MeshPipeline() {
+    stopping = true;
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+bool MeshPipeline::nextReadyMesh(size_t& meshIndex) {
+    return takeReadyMesh(meshIndex, true);
+}
+
+bool MeshPipeline::pollReadyMesh(size_t& meshIndex) {
+    return takeReadyMesh(meshIndex, false);
+}
+
+bool MeshPipeline::isDone() const {
+    return handedBack == meshCount;
+}
+
+bool MeshPipeline::takeReadyMesh(size_t& meshIndex, bool wait) {
+    if (handedBack == meshCount) {
+        return false;
+    }
+
+    ReadyMesh mesh;
+
+    {
+        std::unique_lock<std::mutex> lock(readyMutex);
+
+        if (wait) {
+            readyCondition.wait(lock, [this]() { return !ready.empty(); });
+        } else if (ready.empty()) {
+            return false;
+        }
+
+        mesh = ready.front();
+        ready.pop_front();
+    }
+
+    handedBack++;
+
+    if (mesh.error) {
+        stopping = true;
+        std::rethrow_exception(mesh.error);
+    }
+
+    meshIndex = mesh.index;
+
+    return true;
+}
+
+void MeshPipeline::work() {
+    for (size_t i = nextMesh++; i < meshCount && !stopping; i = nextMesh++) {
+        ReadyMesh mesh = { i, nullptr };
+
+        try {
+            prepare(i);
+        } catch (...) {
+            mesh.error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(readyMutex);
+            ready.push_back(mesh);
+        }
+
+        readyCondition.notify_one();
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef _MESH_PIPELINE_H
+#define _MESH_PIPELINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs the CPU side of getting meshes ready (reading and decoding the vertices, the
+// AABB, the indices) on worker threads, and hands each mesh back as soon as it's done
+// so the caller can upload it while the others are still being prepared. Everything
+// that touches Vulkan stays on the thread that calls nextReadyMesh() or pollReadyMesh(),
+// which can go on drawing frames in between.
+class MeshPipeline {
+public:
+
+    // starts preparing right away, prepare is called once for every index in [0, meshCount)
+    MeshPipeline(size_t meshCount, std::function<void(size_t)> prepare);
+    // stops handing out work and waits for the workers
+    ~MeshPipeline();
+
+    MeshPipeline(const MeshPipeline&) = delete;
+    MeshPipeline& operator=(const MeshPipeline&) = delete;
+
+    // Blocks until another mesh is ready. Returns false once every mesh has been handed
+    // back, and rethrows the exception if preparing a mesh failed.
+    bool nextReadyMesh(size_t& meshIndex);
+
+    // Like nextReadyMesh, but returns false straight away if no mesh is ready yet.
+    bool pollReadyMesh(size_t& meshIndex);
+
+    // whether every mesh has been handed back
+    bool isDone() const;
+
+private:
+
+    struct ReadyMesh {
+        size_t index;
+        std::exception_ptr error;
+    };
+
+    size_t meshCount;
+    size_t handedBack;
+    std::function<void(size_t)> prepare;
+
+    std::atomic<size_t> nextMesh;
+    std::atomic<bool> stopping;
+    std::vector<std::thread> workers;
+
+    std::mutex readyMutex;
+    std::condition_variable readyCondition;
+    std::deque<ReadyMesh> ready;
+
+    bool takeReadyMesh(size_t& meshIndex, bool wait);
+    void work();
+};
+
+#endif // _MESH_PIPELINE_H
@@ -0,0 +1,421 @@
+#include "meshsimplifier.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+
+// each LOD keeps at most this fraction of the triangles of the one before it, and it's
+// thrown away if it can't get under MIN_REDUCTION of them
+const float LOD_REDUCTION = 0.5f;
+const float MIN_REDUCTION = 0.9f;
+
+// no collapse moves the surface further than this fraction of the AABB diagonal
+const float MAX_ERROR = 0.25f;
+
+// symmetric 4x4 matrix, the upper triangle row by row
+struct Quadric {
+    std::array<double, 10> q{};
+
+    void addPlane(const glm::dvec3& normal, double d) {
+        const glm::dvec4 p(normal, d);
+
+        q[0] += p.x * p.x; q[1] += p.x * p.y; q[2] += p.x * p.z; q[3] += p.x * p.w;
+        q[4] += p.y * p.y; q[5] += p.y * p.z; q[6] += p.y * p.w;
+        q[7] += p.z * p.z; q[8] += p.z * p.w;
+        q[9] += p.w * p.w;
+    }
+
+    Quadric operator+(const Quadric& other) const {
+        Quadric sum;
+
+        for (size_t i = 0; i < q.size(); i++) {
+            sum.q[i] = q[i] + other.q[i];
+        }
+
+        return sum;
+    }
+
+    // sum of the squared distances from pos to the planes
+    double evaluate(const glm::vec3& pos) const {
+        double x = pos.x, y = pos.y, z = pos.z;
+
+        double error = q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+            + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+            + q[7] * z * z + 2 * q[8] * z
+            + q[9];
+
+        return std::max(error, 0.0);
+    }
+};
+
+struct Collapse {
+    double cost;
+    uint32_t from;
+    uint32_t to;
+    // of both positions when this was queued, it's stale once either quadric has changed
+    uint32_t fromVersion;
+    uint32_t toVersion;
+
+    bool operator>(const Collapse& other) const {
+        return cost > other.cost;
+    }
+};
+
+uint64_t getEdgeKey(uint32_t a, uint32_t b) {
+    return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+}
+
+class Simplifier {
+public:
+
+    Simplifier(const Mesh& mesh, uint32_t indexCount) : mesh(mesh) {
+        weldPositions();
+
+        // triangles with two corners at one position are never seen, so they're left out of every LOD
+        for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+            std::array<uint32_t, 3> corners = { mesh.getIndex(i), mesh.getIndex(i + 1), mesh.getIndex(i + 2) };
+            std::array<uint32_t, 3> triangle = { vertexPositions[corners[0]], vertexPositions[corners[1]], vertexPositions[corners[2]] };
+
+            if (triangle[0] != triangle[1] && triangle[1] != triangle[2] && triangle[0] != triangle[2]) {
+                triangles.push_back(triangle);
+                triangleCorners.push_back(corners);
+            }
+        }
+
+        aliveCount = static_cast<uint32_t>(triangles.size());
+        removed.assign(triangles.size(), false);
+        collapsed.assign(positions.size(), false);
+        positionTriangles.resize(positions.size());
+        quadrics.resize(positions.size());
+
+        lockBorders();
+
+        for (uint32_t t = 0; t < triangles.size(); t++) {
+            const std::array<uint32_t, 3>& triangle = triangles[t];
+            glm::dvec3 a(positions[triangle[0]]), b(positions[triangle[1]]), c(positions[triangle[2]]);
+            glm::dvec3 normal = glm::cross(b - a, c - a);
+            double length = glm::length(normal);
+
+            if (length > 0.0) {
+                normal /= length;
+
+                for (uint32_t p : triangle) {
+                    quadrics[p].addPlane(normal, -glm::dot(normal, a));
+                }
+            }
+
+            for (uint32_t p : triangle) {
+                positionTriangles[p].push_back(t);
+            }
+        }
+
+        versions.assign(positions.size(), 0);
+
+        // an edge between two triangles is in them once each way round, and the others are locked
+        for (const std::array<uint32_t, 3>& triangle : triangles) {
+            for (size_t corner = 0; corner < 3; corner++) {
+                if (triangle[corner] < triangle[(corner + 1) % 3]) {
+                    pushEdge(triangle[corner], triangle[(corner + 1) % 3]);
+                }
+            }
+        }
+    }
+
+    uint32_t getTriangleCount() const {
+        return aliveCount;
+    }
+
+    // collapses edges until there are at most targetCount triangles, or nothing is left
+    // that can be collapsed under maxCost, returns the largest cost so far
+    double simplify(uint32_t targetCount, double maxCost) {
+        while (aliveCount > targetCount && !queue.empty()) {
+            Collapse collapse = queue.top();
+            queue.pop();
+
+            // every edge around a position that changed was queued again with its new cost
+            if (collapsed[collapse.from] || collapsed[collapse.to] || versions[collapse.from] != collapse.fromVersion || versions[collapse.to] != collapse.toVersion) {
+                continue;
+            }
+
+            double cost = collapse.cost;
+
+            if (cost > maxCost) {
+                break;
+            }
+
+            if (!isEdge(collapse.from, collapse.to) || flipsTriangle(collapse.from, collapse.to)) {
+                continue;
+            }
+
+            apply(collapse.from, collapse.to);
+            error = std::max(error, cost);
+        }
+
+        return error;
+    }
+
+    // the triangles that are left, in the order they were in the full mesh
+    void appendIndices(std::vector<uint32_t>& indices) const {
+        for (uint32_t t = 0; t < triangles.size(); t++) {
+            if (removed[t]) {
+                continue;
+            }
+
+            for (size_t corner = 0; corner < 3; corner++) {
+                indices.push_back(getVertex(triangleCorners[t][corner], triangles[t][corner]));
+            }
+        }
+    }
+
+private:
+
+    const Mesh& mesh;
+
+    // every distinct position once, and where each vertex is in it
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> vertexPositions;
+    std::vector<std::vector<uint32_t>> positionVertices;
+
+    // over the positions, with the vertex each corner had in the full mesh
+    std::vector<std::array<uint32_t, 3>> triangles;
+    std::vector<std::array<uint32_t, 3>> triangleCorners;
+    std::vector<bool> removed;
+    uint32_t aliveCount = 0;
+
+    std::vector<bool> locked;
+    std::vector<bool> collapsed;
+    std::vector<uint32_t> versions;
+    std::vector<std::vector<uint32_t>> positionTriangles;
+    std::vector<Quadric> quadrics;
+
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+    double error = 0.0;
+
+    // scratch for apply
+    std::vector<uint32_t> neighbours;
+
+    glm::vec3 readFloat3(uint32_t vertex, size_t attribute) const {
+        glm::vec3 value;
+        std::memcpy(&value, mesh.getVertexData() + static_cast<size_t>(vertex) * mesh.layout.stride + mesh.layout.offsets[attribute], sizeof(value));
+
+        return value;
+    }
+
+    void weldPositions() {
+        std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+
+        vertexPositions.resize(mesh.vertexDataCount);
+
+        for (uint32_t v = 0; v < mesh.vertexDataCount; v++) {
+            glm::vec3 pos = readFloat3(v, 0);
+
+            uint32_t bits[3];
+            std::memcpy(bits, &pos, sizeof(bits));
+
+            uint64_t key = (static_cast<uint64_t>(bits[0]) * 0x9e3779b97f4a7c15ull) ^ (static_cast<uint64_t>(bits[1]) * 0xc2b2ae3d27d4eb4full) ^ bits[2];
+            std::vector<uint32_t>& bucket = buckets[key];
+
+            std::vector<uint32_t>::iterator match = std::find_if(bucket.begin(), bucket.end(), [&](uint32_t p) {
+                return positions[p] == pos;
+            });
+
+            if (match != bucket.end()) {
+                vertexPositions[v] = *match;
+                positionVertices[*match].push_back(v);
+            } else {
+                vertexPositions[v] = static_cast<uint32_t>(positions.size());
+                bucket.push_back(vertexPositions[v]);
+                positions.push_back(pos);
+                positionVertices.push_back({ v });
+            }
+        }
+    }
+
+    // an edge of only one triangle is on a border, more than two is non manifold
+    void lockBorders() {
+        locked.assign(positions.size(), false);
+
+        std::unordered_map<uint64_t, uint32_t> edgeTriangles;
+
+        for (const std::array<uint32_t, 3>& triangle : triangles) {
+            for (size_t corner = 0; corner < 3; corner++) {
+                edgeTriangles[getEdgeKey(triangle[corner], triangle[(corner + 1) % 3])]++;
+            }
+        }
+
+        for (const std::pair<const uint64_t, uint32_t>& edge : edgeTriangles) {
+            if (edge.second != 2) {
+                locked[static_cast<uint32_t>(edge.first >> 32)] = true;
+                locked[static_cast<uint32_t>(edge.first)] = true;
+            }
+        }
+    }
+
+    // the vertex for a corner that had vertex in the full mesh and is now at position
+    uint32_t getVertex(uint32_t vertex, uint32_t position) const {
+        if (vertexPositions[vertex] == position) {
+            return vertex;
+        }
+
+        const std::vector<uint32_t>& candidates = positionVertices[position];
+
+        if (mesh.layout.formats[1] != VK_FORMAT_R32G32B32_SFLOAT) {
+            return candidates.front();
+        }
+
+        glm::vec3 normal = readFloat3(vertex, 1);
+
+        return *std::max_element(candidates.begin(), candidates.end(), [&](uint32_t a, uint32_t b) {
+            return glm::dot(normal, readFloat3(a, 1)) < glm::dot(normal, readFloat3(b, 1));
+        });
+    }
+
+    double getCost(uint32_t from, uint32_t to) const {
+        return (quadrics[from] + quadrics[to]).evaluate(positions[to]);
+    }
+
+    // queues whichever way round the edge is cheaper to collapse
+    void pushEdge(uint32_t a, uint32_t b) {
+        double costAB = locked[a] ? std::numeric_limits<double>::infinity() : getCost(a, b);
+        double costBA = locked[b] ? std::numeric_limits<double>::infinity() : getCost(b, a);
+
+        if (costAB <= costBA && !locked[a]) {
+            queue.push({ costAB, a, b, versions[a], versions[b] });
+        } else if (!locked[b]) {
+            queue.push({ costBA, b, a, versions[b], versions[a] });
+        }
+    }
+
+    bool isEdge(uint32_t from, uint32_t to) const {
+        for (uint32_t t : positionTriangles[from]) {
+            if (!removed[t] && std::find(triangles[t].begin(), triangles[t].end(), to) != triangles[t].end()) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // moving from onto to would turn one of the other triangles around from over
+    bool flipsTriangle(uint32_t from, uint32_t to) const {
+        for (uint32_t t : positionTriangles[from]) {
+            const std::array<uint32_t, 3>& triangle = triangles[t];
+
+            if (removed[t] || std::find(triangle.begin(), triangle.end(), to) != triangle.end()) {
+                continue;
+            }
+
+            std::array<glm::vec3, 3> corners = { positions[triangle[0]], positions[triangle[1]], positions[triangle[2]] };
+            glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+
+            for (size_t corner = 0; corner < 3; corner++) {
+                if (triangle[corner] == from) {
+                    corners[corner] = positions[to];
+                }
+            }
+
+            glm::vec3 after = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+
+            if (glm::dot(before, after) <= 0.0f) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void apply(uint32_t from, uint32_t to) {
+        collapsed[from] = true;
+        quadrics[to] = quadrics[to] + quadrics[from];
+        versions[to]++;
+
+        for (uint32_t t : positionTriangles[from]) {
+            std::array<uint32_t, 3>& triangle = triangles[t];
+
+            if (removed[t]) {
+                continue;
+            }
+
+            if (std::find(triangle.begin(), triangle.end(), to) != triangle.end()) {
+                removed[t] = true;
+                aliveCount--;
+                continue;
+            }
+
+            std::replace(triangle.begin(), triangle.end(), from, to);
+            positionTriangles[to].push_back(t);
+        }
+
+        positionTriangles[from].clear();
+
+        std::vector<uint32_t>& around = positionTriangles[to];
+        around.erase(std::remove_if(around.begin(), around.end(), [&](uint32_t t) { return removed[t]; }), around.end());
+
+        // every edge around to has a new cost
+        neighbours.clear();
+
+        for (uint32_t t : around) {
+            for (uint32_t p : triangles[t]) {
+                if (p != to && std::find(neighbours.begin(), neighbours.end(), p) == neighbours.end()) {
+                    neighbours.push_back(p);
+                }
+            }
+        }
+
+        for (uint32_t p : neighbours) {
+            pushEdge(to, p);
+        }
+    }
+};
+
+} // namespace
+
+void MeshSimplifier::buildLods(Mesh& mesh) {
+    mesh.lods.clear();
+
+    if (mesh.topology != "TRIANGLE_LIST" || mesh.indexCount < 3 || mesh.layout.formats[0] != VK_FORMAT_R32G32B32_SFLOAT) {
+        return;
+    }
+
+    uint32_t fullCount = mesh.indexCount;
+    float diagonal = glm::length(mesh.aabb[1] - mesh.aabb[0]);
+
+    if (!(diagonal > 0.0f)) {
+        return;
+    }
+
+    Simplifier simplifier(mesh, fullCount);
+
+    double maxCost = static_cast<double>(MAX_ERROR) * diagonal * MAX_ERROR * diagonal;
+    std::vector<MeshLod> lods = { { 0, fullCount, 0.0f } };
+
+    while (lods.size() < MAX_LODS) {
+        uint32_t previousCount = lods.back().indexCount / 3;
+        uint32_t targetCount = static_cast<uint32_t>(previousCount * LOD_REDUCTION);
+
+        double cost = simplifier.simplify(targetCount, maxCost);
+
+        if (simplifier.getTriangleCount() == 0 || simplifier.getTriangleCount() > previousCount * MIN_REDUCTION) {
+            break;
+        }
+
+        MeshLod lod;
+        lod.firstIndex = static_cast<uint32_t>(mesh.indices.size());
+        simplifier.appendIndices(mesh.indices);
+        lod.indexCount = static_cast<uint32_t>(mesh.indices.size()) - lod.firstIndex;
+        lod.error = static_cast<float>(std::sqrt(cost)) / diagonal;
+
+        lods.push_back(lod);
+    }
+
+    if (lods.size() > 1) {
+        mesh.indexCount = static_cast<uint32_t>(mesh.indices.size());
+        mesh.lods = std::move(lods);
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef _MESH_SIMPLIFIER_H
+#define _MESH_SIMPLIFIER_H
+
+#include <cstdint>
+
+#include "scene.h"
+
+// Builds the levels of detail of a mesh by quadric edge collapse (Garland and Heckbert
+// 1997). The collapses are done on the positions, so flat shaded meshes and seams collapse
+// like the rest, and every collapse moves a position onto one of its neighbours. That way
+// the LODs only need new indices into the vertices the mesh already has (a moved corner
+// takes the vertex at its new position with the closest normal), and they're appended to
+// its index buffer after the full mesh. Positions on open borders are never moved, so the
+// outline of a mesh stays where it is.
+class MeshSimplifier {
+public:
+
+    // including the full mesh
+    static const uint32_t MAX_LODS = 4;
+
+    // mesh has to be indexed, with its indices copied out of the file and float positions,
+    // lods is left empty for anything but a TRIANGLE_LIST, or a mesh with nothing to collapse
+    static void buildLods(Mesh& mesh);
+};
+
+#endif // _MESH_SIMPLIFIER_H
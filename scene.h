@@ -0,0 +1,374 @@
+#ifndef _SCENE_H
+#define _SCENE_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_FORCE_RADIANS
+#define GLM_ENABLE_EXPERIMENTAL
+#include "glm/glm.hpp"
+#include "glm/gtx/quaternion.hpp"
+#include "glm/gtx/string_cast.hpp"
+
+#include "memoryallocator.h"
+
+// a vertex decoded to floats, what meshes whose files can't be uploaded as they are use
+struct Vertex {
+    glm::vec3 pos;
+    glm::vec3 normal;
+    glm::vec3 color;
+};
+
+// Where POSITION, NORMAL and COLOR (shader locations 0, 1 and 2) are in one interleaved
+// vertex, and in what format. Either the Vertex struct above, or the record of a .b72
+// file when its bytes are uploaded as they are.
+struct VertexLayout {
+    uint32_t stride = 0;
+    std::array<VkFormat, 3> formats{};
+    std::array<uint32_t, 3> offsets{};
+
+    static VertexLayout getDecoded() {
+        VertexLayout layout;
+
+        layout.stride = sizeof(Vertex);
+        layout.formats = { VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT };
+        layout.offsets = { offsetof(Vertex, pos), offsetof(Vertex, normal), offsetof(Vertex, color) };
+
+        return layout;
+    }
+
+    // the pipelines are kept in a map keyed by layout
+    bool operator<(const VertexLayout& other) const {
+        return std::tie(stride, formats, offsets) < std::tie(other.stride, other.formats, other.offsets);
+    }
+
+    bool operator==(const VertexLayout& other) const {
+        return stride == other.stride && formats == other.formats && offsets == other.offsets;
+    }
+
+    std::array<VkVertexInputBindingDescription, 1> getBindingDescriptions() const {
+        std::array<VkVertexInputBindingDescription, 1> bindingDescriptions{};
+
+        bindingDescriptions[0].binding = 0;
+        bindingDescriptions[0].stride = stride;
+        bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return bindingDescriptions;
+    }
+
+    std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() const {
+        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
+
+        for (uint32_t i = 0; i < 3; i++) {
+            attributeDescriptions[i].binding = 0;
+            attributeDescriptions[i].location = i;
+            attributeDescriptions[i].format = formats[i];
+            attributeDescriptions[i].offset = offsets[i];
+        }
+
+        return attributeDescriptions;
+    }
+};
+
+struct Attribute {
+    std::string name;
+    std::string src;
+    uint32_t offset;
+    uint32_t stride;
+    std::string format;
+
+    void print() {
+        std::cout << "Attribute Name: " << name << std::endl;
+        std::cout << "    Src: " << src << std::endl;
+        std::cout << "    Offset: " << offset << std::endl;
+        std::cout << "    Stride: " << stride << std::endl;
+        std::cout << "    Format: " << format << std::endl;
+    }
+};
+
+struct Indices {
+    std::string src;
+    uint32_t offset;
+    std::string format;
+};
+
+// A run of at most MeshletBuilder::MAX_VERTICES vertices and MAX_TRIANGLES triangles of
+// a mesh's index buffer, with what's needed to cull it on its own. The cone holds the
+// normals of all its triangles, coneCutoff is the sine of its half angle, or 1 if the
+// normals are spread too far for the cone to ever cull the meshlet.
+struct Meshlet {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    glm::vec3 center;
+    float radius;
+    glm::vec3 coneAxis;
+    float coneCutoff;
+};
+
+// One level of detail of a mesh, a range of its index buffer over the same vertices.
+// error is how far it can be from the full mesh, as a fraction of the AABB diagonal.
+struct MeshLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;
+};
+
+struct Node {
+    std::string name;
+    glm::vec3 translation;
+    glm::quat rotation;
+    glm::vec3 scale;
+    std::vector<uint32_t> children;
+    std::optional<uint32_t> camera;
+    std::optional<uint32_t> mesh;
+
+    void print() {
+        std::cout << "Name: " << name << std::endl;
+
+        std::cout << "Translation: " << glm::to_string(translation) << std::endl;
+        std::cout << "Rotation: " << glm::to_string(rotation) << std::endl;
+        std::cout << "Scale: " << glm::to_string(scale) << std::endl;
+
+        std::cout << "Children: ";
+        for (uint32_t child : children) {
+            std:: cout << child << " ";
+        }
+        std::cout << std::endl;
+
+        if (camera.has_value()) {
+            std::cout << "Camera: " << camera.value() << std::endl;
+        }
+        
+        if (mesh.has_value()) {
+            std::cout << "Mesh: " << mesh.value() << std::endl;
+        }
+    }
+};
+
+struct Mesh {
+    std::string name;
+    std::string topology;
+    uint32_t vertexCount;
+    // of the first attribute, the attributes are each read from their own src
+    std::string src;
+    uint32_t stride;
+    Indices indicesData;
+    std::vector<Attribute> attributes;
+
+    // vertexDataCount vertices in layout, in vertexData, or read in place from their mapped
+    // .b72 file until the mesh is released (like the indices below)
+    VertexLayout layout;
+    std::vector<char> vertexData;
+    const char* mappedVertices = nullptr;
+    uint32_t vertexDataCount = 0;
+
+    // always 32 bit here, narrowed to indexType when they're uploaded
+    std::vector<uint32_t> indices;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+    // all of them (with every LOD), indices.size() unless the authored indices are still in their file
+    uint32_t indexCount = 0;
+    // the authored indices, read in place from their mapped .b72 file until the mesh is released
+    const char* mappedIndices = nullptr;
+
+    // of the full mesh, empty if the mesh is always drawn whole
+    std::vector<Meshlet> meshlets;
+
+    // the full mesh first and then coarser and coarser ones, empty if the mesh has no LODs
+    std::vector<MeshLod> lods;
+
+    // owned by the viewer, shared by every mesh with the same layout
+    VkPipeline pipeline = VK_NULL_HANDLE;
+
+    // where it is in Scene::meshBuffers[meshBuffer], the meshlets' and LODs' firstIndex count from firstIndex
+    uint32_t meshBuffer = 0;
+    uint32_t firstIndex = 0;
+    int32_t vertexOffset = 0;
+    // set by the viewer once its copy is done, it isn't drawn before that
+    bool resident = false;
+
+    std::array<glm::vec3, 2> aabb; // define min point and max point for AABB
+
+    // wherever the vertices are at the moment
+    const char* getVertexData() const {
+        return mappedVertices != nullptr ? mappedVertices : vertexData.data();
+    }
+
+    // wherever the indices are at the moment, mapped ones can be at any offset so they're read a byte at a time
+    uint32_t getIndex(size_t i) const {
+        if (mappedIndices == nullptr) {
+            return indices[i];
+        }
+
+        if (indexType == VK_INDEX_TYPE_UINT16) {
+            uint16_t index;
+            std::memcpy(&index, mappedIndices + i * sizeof(uint16_t), sizeof(index));
+
+            return index;
+        }
+
+        uint32_t index;
+        std::memcpy(&index, mappedIndices + i * sizeof(uint32_t), sizeof(index));
+
+        return index;
+    }
+
+    void print() {
+        std::cout << "Name: " << name << std::endl;
+        std::cout << "Topology: " << topology << std::endl;
+        std::cout << "Vertex Count: " << vertexCount << std::endl;
+        std::cout << "Src: " << src << std::endl;
+        std::cout << "Stride: " << stride << std::endl;
+
+        if (indicesData.src != "") {
+            std::cout << "indices.Src: " << indicesData.src << std::endl;
+            std::cout << "indices.Offset: " << indicesData.offset << std::endl;
+            std::cout << "indices.Format: " << indicesData.format << std::endl;
+        }
+
+        for (Attribute& attr : attributes) {
+            attr.print();
+        }
+    }
+};
+
+// assume perspective camera
+struct Camera {
+    std::string name;
+    float vfov;
+    float aspect;
+    float near;
+    float far;
+    glm::mat4 viewMat;
+
+    void print() {
+        std::cout << "Name: " << name << std::endl;
+        std::cout << "Aspect: " << aspect << std::endl;
+        std::cout << "Vfov: " << vfov << std::endl;
+        std::cout << "Near: " << near << std::endl;
+        std::cout << "Far: " << far << std::endl;
+        std::cout << "View Mat: " << glm::to_string(viewMat) << std::endl;
+    }
+};
+
+struct Driver {
+    std::string name;
+    uint32_t node;
+    std::string channel;
+    std::vector<float> times;
+    std::vector<float> values;
+    std::string interpolation;
+    uint32_t animIndex;
+
+    void print() {
+        std::cout << "Name: " << name << std::endl;
+
+        std::cout << "Node: " << node << std::endl;
+        std::cout << "Channel: " << channel << std::endl;
+        std::cout << "Interpolation: " << interpolation << std::endl;
+
+        std::cout << "Times: ";
+        for (float time : times) {
+            std::cout << time << " ";
+        }
+        std::cout << std::endl;
+
+        std::cout << "Values: ";
+        for (float value : values) {
+            std::cout << value << " ";
+        }
+        std::cout << std::endl;
+    }
+};
+
+struct Animation {
+    std::chrono::high_resolution_clock::time_point startTime;
+    uint16_t curFrameIndex;
+};
+
+// The vertices and indices of every mesh with the same vertex layout and index type, one
+// mesh after another, so they're bound once for all of those meshes.
+struct MeshBuffer {
+    VertexLayout layout;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+    // in use, out of what the buffers were made for
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+    uint32_t vertexCapacity = 0;
+    uint32_t indexCapacity = 0;
+
+    VkBuffer vertexBuffer = VK_NULL_HANDLE;
+    MemoryAllocation vertexAllocation;
+
+    VkBuffer indexBuffer = VK_NULL_HANDLE;
+    MemoryAllocation indexAllocation;
+
+    void cleanup(VkDevice device, MemoryAllocator& allocator) {
+        vkDestroyBuffer(device, indexBuffer, nullptr);
+        allocator.free(indexAllocation);
+
+        vkDestroyBuffer(device, vertexBuffer, nullptr);
+        allocator.free(vertexAllocation);
+    }
+};
+
+struct Scene {
+    std::vector<Node> nodes;
+    std::vector<Mesh> meshes;
+    // made by the viewer as the meshes are streamed
+    std::vector<MeshBuffer> meshBuffers;
+    std::vector<Camera> cameras;
+    std::vector<Driver> drivers;
+    std::vector<Animation> anims;
+    std::vector<uint32_t> roots;
+
+    // maps indices of JSON nodes to the index of the corresponding struct in one of the arrays of the Scene object
+    // EXAMPLE: If the first mesh is at index 5 in the JSON array, then typeIndices[5] == 0.
+    //          Similary, if the first node is at index 3, then typeIndices[3] == 0 as well
+    std::vector<uint32_t> typeIndices;
+
+    void print() {
+        std::cout << "Scene:" << std::endl;
+        
+        std::cout << std::endl << "ROOTS:" << std::endl;
+        for (uint32_t& root : roots) {
+            std::cout << root << " ";
+        }
+        std::cout << std::endl;
+
+        std::cout << std::endl << "CAMERAS:" << std::endl;
+        for (Camera& camera : cameras) {
+            camera.print();
+        }
+        std::cout << std::endl;
+
+        std::cout << std::endl << "NODES:" << std::endl;
+        for (Node& node : nodes) {
+            node.print();
+        }
+        std::cout << std::endl;
+
+        std::cout << std::endl << "MESHES:" << std::endl;
+        for (Mesh& mesh : meshes) {
+            mesh.print();
+        }
+        std::cout << std::endl;
+
+        std::cout << std::endl << "DRIVERS:" << std::endl;
+        for (Driver& driver : drivers) {
+            driver.print();
+        }
+        std::cout << std::endl;
+    }
+};
+
+#endif // _SCENE_H
@@ -0,0 +1,582 @@
+#include "scenecache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <set>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "mappedfile.h"
+#include "meshindexer.h"
+
+// bump whenever the layout below or any of the cached structs change
+static const uint32_t SCENE_CACHE_VERSION = 10;
+static const char SCENE_CACHE_MAGIC[4] = { 'S', '7', '2', 'C' };
+// vertex and index data starts at a multiple of this in the file, so it can be used in place
+static const size_t SCENE_CACHE_ALIGNMENT = 16;
+
+namespace {
+
+struct SourceStamp {
+    std::string path;
+    uint64_t size;
+    int64_t modified;
+};
+
+// returns false if the file doesn't exist
+bool getSourceStamp(const std::string& path, SourceStamp& stamp) {
+    std::error_code error;
+
+    uint64_t size = std::filesystem::file_size(path, error);
+    if (error) {
+        return false;
+    }
+
+    std::filesystem::file_time_type modified = std::filesystem::last_write_time(path, error);
+    if (error) {
+        return false;
+    }
+
+    stamp.path = path;
+    stamp.size = size;
+    stamp.modified = static_cast<int64_t>(modified.time_since_epoch().count());
+
+    return true;
+}
+
+// writes straight to the file, so the meshes don't have to be copied into one big buffer first
+class CacheWriter {
+public:
+
+    explicit CacheWriter(std::ostream& out) : out(out) {}
+
+    template<typename T>
+    void put(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain data can be written as is");
+
+        write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    void putArray(const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain data can be written as is");
+
+        put(static_cast<uint64_t>(values.size()));
+        write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    void putString(const std::string& str) {
+        put(static_cast<uint64_t>(str.size()));
+        write(str.data(), str.size());
+    }
+
+    // size bytes, aligned to SCENE_CACHE_ALIGNMENT in the file
+    void putBytes(const char* data, size_t size) {
+        put(static_cast<uint64_t>(size));
+
+        static const char padding[SCENE_CACHE_ALIGNMENT] = {};
+        write(padding, (SCENE_CACHE_ALIGNMENT - position % SCENE_CACHE_ALIGNMENT) % SCENE_CACHE_ALIGNMENT);
+
+        write(data, size);
+    }
+
+private:
+
+    std::ostream& out;
+    size_t position = 0;
+
+    void write(const char* data, size_t size) {
+        out.write(data, static_cast<std::streamsize>(size));
+        position += size;
+    }
+};
+
+// throws if it would read past the end, load() turns that into a cache miss
+class CacheReader {
+public:
+
+    CacheReader(const char* data, size_t size) : begin(data), cursor(data), end(data + size) {}
+
+    template<typename T>
+    T get() {
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+
+        return value;
+    }
+
+    template<typename T>
+    void getArray(std::vector<T>& values) {
+        uint64_t count = get<uint64_t>();
+
+        if (count > static_cast<uint64_t>(end - cursor) / sizeof(T)) {
+            throw std::runtime_error("Scene cache is truncated");
+        }
+
+        values.resize(static_cast<size_t>(count));
+
+        if (count > 0) {
+            std::memcpy(values.data(), take(values.size() * sizeof(T)), values.size() * sizeof(T));
+        }
+    }
+
+    // of the records that follow, each of which takes at least a byte, so a bad count can't allocate much
+    size_t getCount() {
+        uint64_t count = get<uint64_t>();
+
+        if (count > static_cast<uint64_t>(end - cursor)) {
+            throw std::runtime_error("Scene cache is truncated");
+        }
+
+        return static_cast<size_t>(count);
+    }
+
+    // what putBytes wrote, left where it is in the file
+    const char* getBytes(size_t& size) {
+        uint64_t count = get<uint64_t>();
+
+        take((SCENE_CACHE_ALIGNMENT - static_cast<size_t>(cursor - begin) % SCENE_CACHE_ALIGNMENT) % SCENE_CACHE_ALIGNMENT);
+
+        if (count > static_cast<uint64_t>(end - cursor)) {
+            throw std::runtime_error("Scene cache is truncated");
+        }
+
+        size = static_cast<size_t>(count);
+
+        return take(size);
+    }
+
+    std::string getString() {
+        uint64_t size = get<uint64_t>();
+
+        if (size > static_cast<uint64_t>(end - cursor)) {
+            throw std::runtime_error("Scene cache is truncated");
+        }
+
+        return std::string(take(static_cast<size_t>(size)), static_cast<size_t>(size));
+    }
+
+private:
+
+    const char* begin;
+    const char* cursor;
+    const char* end;
+
+    const char* take(size_t size) {
+        if (size > static_cast<size_t>(end - cursor)) {
+            throw std::runtime_error("Scene cache is truncated");
+        }
+
+        const char* result = cursor;
+        cursor += size;
+
+        return result;
+    }
+};
+
+void writeAttribute(CacheWriter& writer, const Attribute& attribute) {
+    writer.putString(attribute.name);
+    writer.putString(attribute.src);
+    writer.put(attribute.offset);
+    writer.put(attribute.stride);
+    writer.putString(attribute.format);
+}
+
+Attribute readAttribute(CacheReader& reader) {
+    Attribute attribute;
+
+    attribute.name = reader.getString();
+    attribute.src = reader.getString();
+    attribute.offset = reader.get<uint32_t>();
+    attribute.stride = reader.get<uint32_t>();
+    attribute.format = reader.getString();
+
+    return attribute;
+}
+
+// the viewer follows the cached indices without checking them, so a bad one has to fail the load
+void checkIndex(uint64_t index, size_t count, const char* error) {
+    if (index >= count) {
+        throw std::runtime_error(error);
+    }
+}
+
+} // namespace
+
+std::string SceneCache::getCachePath(const std::string& sceneFile) {
+    return sceneFile + "c";
+}
+
+bool SceneCache::load(const std::string& cachePath, Scene& scene, const MeshOptions& options, MappedFile& cacheFile) {
+    MappedFile file;
+
+    if (!file.open(cachePath)) {
+        return false;
+    }
+
+    try {
+        CacheReader reader(file.data(), file.size());
+
+        char magic[4];
+        for (char& c : magic) {
+            c = reader.get<char>();
+        }
+
+        if (std::memcmp(magic, SCENE_CACHE_MAGIC, sizeof(magic)) != 0
+            || reader.get<uint32_t>() != SCENE_CACHE_VERSION
+            || reader.get<uint32_t>() != sizeof(Vertex)) {
+            std::cout << "Scene cache " << cachePath << " is from another version, rebuilding it" << std::endl;
+            return false;
+        }
+
+        bool optimized = reader.get<uint8_t>() != 0;
+        bool quantized = reader.get<uint8_t>() != 0;
+        bool lods = reader.get<uint8_t>() != 0;
+        bool meshlets = reader.get<uint8_t>() != 0;
+
+        if (optimized != options.optimize || quantized != options.quantize || lods != options.lods || meshlets != options.meshlets) {
+            std::cout << "Scene cache " << cachePath << " was built with other mesh options, rebuilding it" << std::endl;
+            return false;
+        }
+
+        uint64_t sourceCount = reader.get<uint64_t>();
+
+        for (uint64_t i = 0; i < sourceCount; i++) {
+            SourceStamp cached;
+            cached.path = reader.getString();
+            cached.size = reader.get<uint64_t>();
+            cached.modified = reader.get<int64_t>();
+
+            SourceStamp current;
+
+            if (!getSourceStamp(cached.path, current) || current.size != cached.size || current.modified != cached.modified) {
+                std::cout << "Scene cache " << cachePath << " is out of date (" << cached.path << " changed), rebuilding it" << std::endl;
+                return false;
+            }
+        }
+
+        Scene cachedScene;
+
+        reader.getArray(cachedScene.roots);
+        reader.getArray(cachedScene.typeIndices);
+
+        cachedScene.nodes.resize(reader.getCount());
+
+        for (Node& node : cachedScene.nodes) {
+            node.name = reader.getString();
+            node.translation = reader.get<glm::vec3>();
+            node.rotation = reader.get<glm::quat>();
+            node.scale = reader.get<glm::vec3>();
+            reader.getArray(node.children);
+
+            if (reader.get<uint8_t>()) {
+                node.camera = reader.get<uint32_t>();
+            }
+
+            if (reader.get<uint8_t>()) {
+                node.mesh = reader.get<uint32_t>();
+            }
+        }
+
+        cachedScene.meshes.resize(reader.getCount());
+
+        for (Mesh& mesh : cachedScene.meshes) {
+            mesh.name = reader.getString();
+            mesh.topology = reader.getString();
+            mesh.vertexCount = reader.get<uint32_t>();
+            mesh.src = reader.getString();
+            mesh.stride = reader.get<uint32_t>();
+
+            mesh.indicesData.src = reader.getString();
+            mesh.indicesData.offset = reader.get<uint32_t>();
+            mesh.indicesData.format = reader.getString();
+
+            mesh.attributes.resize(reader.getCount());
+
+            for (Attribute& attribute : mesh.attributes) {
+                attribute = readAttribute(reader);
+            }
+
+            mesh.layout = reader.get<VertexLayout>();
+
+            size_t vertexSize;
+            mesh.mappedVertices = reader.getBytes(vertexSize);
+
+            if (mesh.layout.stride == 0 || vertexSize % mesh.layout.stride != 0 || vertexSize / mesh.layout.stride > UINT32_MAX) {
+                throw std::runtime_error("Scene cache has a bad vertex layout");
+            }
+
+            mesh.vertexDataCount = static_cast<uint32_t>(vertexSize / mesh.layout.stride);
+            mesh.indexType = reader.get<VkIndexType>();
+
+            if (mesh.indexType != VK_INDEX_TYPE_UINT16 && mesh.indexType != VK_INDEX_TYPE_UINT32) {
+                throw std::runtime_error("Scene cache has an unknown index type");
+            }
+
+            // already narrowed to indexType, like authored indices in a .b72 file
+            size_t indexSize;
+            mesh.mappedIndices = reader.getBytes(indexSize);
+
+            if (indexSize % MeshIndexer::getIndexSize(mesh.indexType) != 0 || indexSize / MeshIndexer::getIndexSize(mesh.indexType) > UINT32_MAX) {
+                throw std::runtime_error("Scene cache has a bad index buffer");
+            }
+
+            mesh.indexCount = static_cast<uint32_t>(indexSize / MeshIndexer::getIndexSize(mesh.indexType));
+
+            // they're narrowed to indexType when they're uploaded, so 16 bit ones can't go past 65535 either
+            size_t vertexLimit = mesh.vertexDataCount;
+
+            if (mesh.indexType == VK_INDEX_TYPE_UINT16) {
+                vertexLimit = std::min<size_t>(vertexLimit, size_t(std::numeric_limits<uint16_t>::max()) + 1);
+            }
+
+            for (uint32_t i = 0; i < mesh.indexCount; i++) {
+                checkIndex(mesh.getIndex(i), vertexLimit, "Scene cache has an index outside the vertices");
+            }
+
+            mesh.aabb = reader.get<std::array<glm::vec3, 2>>();
+            reader.getArray(mesh.meshlets);
+
+            for (const Meshlet& meshlet : mesh.meshlets) {
+                if (static_cast<uint64_t>(meshlet.firstIndex) + meshlet.indexCount > mesh.indexCount) {
+                    throw std::runtime_error("Scene cache has a meshlet outside the index buffer");
+                }
+            }
+
+            reader.getArray(mesh.lods);
+
+            for (const MeshLod& lod : mesh.lods) {
+                if (static_cast<uint64_t>(lod.firstIndex) + lod.indexCount > mesh.indexCount) {
+                    throw std::runtime_error("Scene cache has a LOD outside the index buffer");
+                }
+            }
+        }
+
+        cachedScene.cameras.resize(reader.getCount());
+
+        for (Camera& camera : cachedScene.cameras) {
+            camera.name = reader.getString();
+            camera.vfov = reader.get<float>();
+            camera.aspect = reader.get<float>();
+            camera.near = reader.get<float>();
+            camera.far = reader.get<float>();
+            camera.viewMat = reader.get<glm::mat4>();
+        }
+
+        cachedScene.drivers.resize(reader.getCount());
+
+        for (Driver& driver : cachedScene.drivers) {
+            driver.name = reader.getString();
+            driver.node = reader.get<uint32_t>();
+            driver.channel = reader.getString();
+            reader.getArray(driver.times);
+            reader.getArray(driver.values);
+            driver.interpolation = reader.getString();
+            driver.animIndex = reader.get<uint32_t>();
+
+            // the animation state isn't cached, it always starts out the same
+            cachedScene.anims.push_back({});
+            cachedScene.anims.back().curFrameIndex = std::numeric_limits<uint16_t>::max();
+        }
+
+        for (uint32_t root : cachedScene.roots) {
+            checkIndex(root, cachedScene.nodes.size(), "Scene cache has a root that isn't a node");
+        }
+
+        for (const Node& node : cachedScene.nodes) {
+            for (uint32_t child : node.children) {
+                checkIndex(child, cachedScene.nodes.size(), "Scene cache has a child that isn't a node");
+            }
+
+            if (node.camera.has_value()) {
+                checkIndex(node.camera.value(), cachedScene.cameras.size(), "Scene cache has a node with a missing camera");
+            }
+
+            if (node.mesh.has_value()) {
+                checkIndex(node.mesh.value(), cachedScene.meshes.size(), "Scene cache has a node with a missing mesh");
+            }
+        }
+
+        for (const Driver& driver : cachedScene.drivers) {
+            checkIndex(driver.node, cachedScene.nodes.size(), "Scene cache has a driver of a missing node");
+            checkIndex(driver.animIndex, cachedScene.anims.size(), "Scene cache has a driver with a missing animation");
+        }
+
+        scene = std::move(cachedScene);
+        cacheFile = std::move(file);
+    } catch (const std::exception& e) {
+        std::cout << "Scene cache " << cachePath << " is unreadable (" << e.what() << "), rebuilding it" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void SceneCache::save(const std::string& cachePath, const std::string& sceneFile, const Scene& scene, const MeshOptions& options) {
+    // the scene file and every file a mesh reads from
+    std::vector<SourceStamp> sources;
+    std::set<std::string> sourcePaths = { sceneFile };
+
+    for (const Mesh& mesh : scene.meshes) {
+        for (const Attribute& attribute : mesh.attributes) {
+            if (attribute.src != "") {
+                sourcePaths.insert(attribute.src);
+            }
+        }
+
+        if (mesh.indicesData.src != "") {
+            sourcePaths.insert(mesh.indicesData.src);
+        }
+    }
+
+    for (const std::string& path : sourcePaths) {
+        SourceStamp stamp;
+
+        if (!getSourceStamp(path, stamp)) {
+            std::cout << "Not writing the scene cache, " << path << " doesn't exist" << std::endl;
+            return;
+        }
+
+        sources.push_back(stamp);
+    }
+
+    // write next to it and rename, so a crash never leaves a half written cache behind
+    std::string tempPath = cachePath + ".tmp";
+    std::ofstream out(tempPath, std::ios::binary | std::ios::out | std::ios::trunc);
+
+    if (!out) {
+        std::cout << "Couldn't write the scene cache to " << tempPath << std::endl;
+        return;
+    }
+
+    CacheWriter writer(out);
+
+    for (char c : SCENE_CACHE_MAGIC) {
+        writer.put(c);
+    }
+
+    writer.put(SCENE_CACHE_VERSION);
+    writer.put(static_cast<uint32_t>(sizeof(Vertex)));
+    writer.put(static_cast<uint8_t>(options.optimize));
+    writer.put(static_cast<uint8_t>(options.quantize));
+    writer.put(static_cast<uint8_t>(options.lods));
+    writer.put(static_cast<uint8_t>(options.meshlets));
+
+    writer.put(static_cast<uint64_t>(sources.size()));
+
+    for (const SourceStamp& source : sources) {
+        writer.putString(source.path);
+        writer.put(source.size);
+        writer.put(source.modified);
+    }
+
+    writer.putArray(scene.roots);
+    writer.putArray(scene.typeIndices);
+
+    writer.put(static_cast<uint64_t>(scene.nodes.size()));
+
+    for (const Node& node : scene.nodes) {
+        writer.putString(node.name);
+        writer.put(node.translation);
+        writer.put(node.rotation);
+        writer.put(node.scale);
+        writer.putArray(node.children);
+
+        writer.put(static_cast<uint8_t>(node.camera.has_value()));
+        if (node.camera.has_value()) {
+            writer.put(node.camera.value());
+        }
+
+        writer.put(static_cast<uint8_t>(node.mesh.has_value()));
+        if (node.mesh.has_value()) {
+            writer.put(node.mesh.value());
+        }
+    }
+
+    writer.put(static_cast<uint64_t>(scene.meshes.size()));
+
+    for (const Mesh& mesh : scene.meshes) {
+        writer.putString(mesh.name);
+        writer.putString(mesh.topology);
+        writer.put(mesh.vertexCount);
+        writer.putString(mesh.src);
+        writer.put(mesh.stride);
+
+        writer.putString(mesh.indicesData.src);
+        writer.put(mesh.indicesData.offset);
+        writer.putString(mesh.indicesData.format);
+
+        writer.put(static_cast<uint64_t>(mesh.attributes.size()));
+
+        for (const Attribute& attribute : mesh.attributes) {
+            writeAttribute(writer, attribute);
+        }
+
+        // from wherever the mesh has them, its mapped .b72 file or its own copy
+        writer.put(mesh.layout);
+        writer.putBytes(mesh.getVertexData(), static_cast<size_t>(mesh.vertexDataCount) * mesh.layout.stride);
+        writer.put(mesh.indexType);
+
+        size_t indexSize = MeshIndexer::getIndexSize(mesh.indexType);
+
+        if (mesh.mappedIndices != nullptr) {
+            writer.putBytes(mesh.mappedIndices, static_cast<size_t>(mesh.indexCount) * indexSize);
+        } else {
+            std::vector<char> packed(mesh.indices.size() * indexSize);
+            MeshIndexer::packIndices(mesh.indices.data(), mesh.indices.size(), mesh.indexType, packed.data());
+
+            writer.putBytes(packed.data(), packed.size());
+        }
+
+        writer.put(mesh.aabb);
+        writer.putArray(mesh.meshlets);
+        writer.putArray(mesh.lods);
+    }
+
+    writer.put(static_cast<uint64_t>(scene.cameras.size()));
+
+    for (const Camera& camera : scene.cameras) {
+        writer.putString(camera.name);
+        writer.put(camera.vfov);
+        writer.put(camera.aspect);
+        writer.put(camera.near);
+        writer.put(camera.far);
+        writer.put(camera.viewMat);
+    }
+
+    writer.put(static_cast<uint64_t>(scene.drivers.size()));
+
+    for (const Driver& driver : scene.drivers) {
+        writer.putString(driver.name);
+        writer.put(driver.node);
+        writer.putString(driver.channel);
+        writer.putArray(driver.times);
+        writer.putArray(driver.values);
+        writer.putString(driver.interpolation);
+        writer.put(driver.animIndex);
+    }
+
+    out.close();
+
+    if (!out) {
+        std::cout << "Couldn't write the scene cache to " << tempPath << std::endl;
+        std::remove(tempPath.c_str());
+        return;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, cachePath, error);
+
+    if (error) {
+        std::cout << "Couldn't write the scene cache to " << cachePath << ": " << error.message() << std::endl;
+        std::remove(tempPath.c_str());
+        return;
+    }
+
+    std::cout << "Wrote the scene cache to " << cachePath << std::endl;
+}
@@ -0,0 +1,38 @@
+#ifndef _SCENE_CACHE_H
+#define _SCENE_CACHE_H
+
+#include <string>
+
+#include "mappedfile.h"
+#include "scene.h"
+
+// Compiled scene cache (.s72c). Holds the flattened Scene with its indices already
+// resolved, plus the vertices (in their VertexLayout), indices, AABB, meshlets and LODs of every mesh,
+// so a later run can map it and skip the JSON and the .b72 files entirely. The vertices and
+// indices are used where they are in the mapping, like native records in a .b72 file. The size and
+// modification time of every source file are stored in it, and it is thrown away if any
+// of them changed.
+class SceneCache {
+public:
+
+    // what was done to the meshes after they were read, a cache built with other options is rebuilt
+    struct MeshOptions {
+        bool optimize = false;
+        bool quantize = false;
+        bool lods = false;
+        bool meshlets = false;
+    };
+
+    // e.g. "scenes/sg-Grouping.s72" -> "scenes/sg-Grouping.s72c"
+    static std::string getCachePath(const std::string& sceneFile);
+
+    // returns false if there is no cache, or it's stale, corrupt or from another version,
+    // or its meshes were built with other options. The meshes' mappedVertices and mappedIndices
+    // point into cacheFile, which has to stay open until they've been uploaded.
+    static bool load(const std::string& cachePath, Scene& scene, const MeshOptions& options, MappedFile& cacheFile);
+
+    // call once the meshes have their vertices, indices and AABBs, and before mapped ones are released
+    static void save(const std::string& cachePath, const std::string& sceneFile, const Scene& scene, const MeshOptions& options);
+};
+
+#endif // _SCENE_CACHE_H
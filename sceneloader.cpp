@@ -0,0 +1,939 @@
+#include "sceneloader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+// below this the threads cost more than they save
+static const size_t MIN_PARALLEL_BYTES = 1024 * 1024;
+
+static void checkKey(bool found, const char* key) {
+    if (!found) {
+        throw std::runtime_error(std::string("Error reading JSON: Missing key \"") + key + "\"");
+    }
+}
+
+// indices, counts and offsets are read as integers so they stay exact past 2^24
+static uint32_t toUnsigned(int64_t value) {
+    if (value < 0 || value > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("Error reading JSON: Expected an unsigned 32-bit integer, got " + std::to_string(value));
+    }
+
+    return static_cast<uint32_t>(value);
+}
+
+// vectors and quaternions have exactly their number of components, whichever parser reads them
+static void checkComponentCount(size_t count, size_t expected) {
+    if (count != expected) {
+        throw std::runtime_error("Error reading JSON: Expected " + std::to_string(expected) + " numbers, got " + std::to_string(count));
+    }
+}
+
+SceneLoader::SceneLoader(std::string filename, Parser parser, JsonLoader::Backend backend) {
+    this->filename = filename;
+    this->parser = parser;
+    this->backend = backend;
+}
+
+void SceneLoader::loadScene(Scene& scene) {
+    JsonLoader sceneLoader(filename, backend);
+
+    if (parser == Parser::STREAMING) {
+        std::cout << "STREAMING SCENE (" << sceneLoader.getBackendName() << ")..." << std::endl << std::endl;
+        streamSceneFromJson(scene, sceneLoader);
+
+        sceneLoader.close();
+    } else if (parser == Parser::PARALLEL) {
+        std::cout << "STREAMING SCENE IN PARALLEL (" << sceneLoader.getBackendName() << ")..." << std::endl << std::endl;
+        streamSceneInParallel(scene, sceneLoader);
+
+        sceneLoader.close();
+    } else {
+        std::cout << "LOADING JSON (" << sceneLoader.getBackendName() << ")..." << std::endl << std::endl;
+        sceneLoader.setLazyArrays(true);
+        JsonLoader::JsonNode* sceneJson = sceneLoader.parseJson();
+
+        std::cout << "CONSTRUCTING SCENE..." << std::endl;
+        constructSceneFromJson(scene, sceneJson);
+
+        // the lazy arrays are decoded from the file, so it has to stay open until now
+        sceneLoader.close();
+
+        // the scene holds copies of everything it needs, so drop the whole JSON tree at once
+        sceneLoader.release();
+    }
+
+    resolveSceneIndices(scene);
+}
+
+void SceneLoader::constructSceneFromJson(Scene& scene, const JsonLoader::JsonNode* json) {
+    if (json->type != JsonLoader::JsonNode::Type::ARRAY) {
+        throw std::runtime_error("The root of the scene json should be an array");
+    }
+
+    // the keyframes are decoded once it's known which nodes they animate
+    std::vector<const JsonLoader::JsonNode*> driverJsons;
+
+    std::vector<int64_t> integers;
+
+    for (const JsonLoader::JsonNode& node : json->getArray()) {
+        if (node.type == JsonLoader::JsonNode::Type::STRING && node.getString() == "s72-v1") {
+            // This will be the first element of the array, ignore it
+
+            scene.typeIndices.push_back(std::numeric_limits<uint32_t>::max());
+        } else if (node.type == JsonLoader::JsonNode::Type::OBJECT) {
+            std::string_view sceneType = node.at(JsonLoader::Key::TYPE).getString();
+
+            if (sceneType == "SCENE") {
+                scene.typeIndices.push_back(std::numeric_limits<uint32_t>::max());
+
+                const JsonLoader::JsonNode& roots = node.at(JsonLoader::Key::ROOTS);
+
+                integers.resize(roots.count);
+                roots.getIntegers(integers.data(), integers.size());
+
+                for (int64_t root : integers) {
+                    scene.roots.push_back(toUnsigned(root));
+                }
+            } else if (sceneType == "NODE") {
+                scene.typeIndices.push_back(scene.nodes.size());
+                scene.nodes.push_back({});
+
+                scene.nodes.back().name = node.at(JsonLoader::Key::NAME).getString();
+
+                if (const JsonLoader::JsonNode* translation = node.find(JsonLoader::Key::TRANSLATION)) {
+                    scene.nodes.back().translation = parseVec3(*translation);
+                } else {
+                    scene.nodes.back().translation = glm::vec3(0, 0, 0);
+                }
+
+                if (const JsonLoader::JsonNode* rotation = node.find(JsonLoader::Key::ROTATION)) {
+                    scene.nodes.back().rotation = parseQuat(*rotation);
+                } else {
+                    scene.nodes.back().rotation = glm::quat(1, 0, 0, 0);
+                }
+
+                if (const JsonLoader::JsonNode* scale = node.find(JsonLoader::Key::SCALE)) {
+                    scene.nodes.back().scale = parseVec3(*scale);
+                } else {
+                    scene.nodes.back().scale = glm::vec3(1, 1, 1);
+                }
+
+                if (const JsonLoader::JsonNode* children = node.find(JsonLoader::Key::CHILDREN)) {
+                    integers.resize(children->count);
+                    children->getIntegers(integers.data(), integers.size());
+
+                    scene.nodes.back().children.reserve(integers.size());
+                    for (int64_t child : integers) {
+                        scene.nodes.back().children.push_back(toUnsigned(child));
+                    }
+                }
+
+                if (const JsonLoader::JsonNode* camera = node.find(JsonLoader::Key::CAMERA)) {
+                    scene.nodes.back().camera = toUnsigned(camera->getInteger());
+                }
+
+                if (const JsonLoader::JsonNode* mesh = node.find(JsonLoader::Key::MESH)) {
+                    scene.nodes.back().mesh = toUnsigned(mesh->getInteger());
+                }
+            } else if (sceneType == "MESH") {
+                scene.typeIndices.push_back(scene.meshes.size());
+                scene.meshes.push_back({});
+
+                scene.meshes.back().name = node.at(JsonLoader::Key::NAME).getString();
+                scene.meshes.back().topology = node.at(JsonLoader::Key::TOPOLOGY).getString();
+                scene.meshes.back().vertexCount = toUnsigned(node.at(JsonLoader::Key::COUNT).getInteger());
+
+                if (const JsonLoader::JsonNode* indices = node.find(JsonLoader::Key::INDICES)) {
+                    scene.meshes.back().indicesData.src = indices->at(JsonLoader::Key::SRC).getString();
+                    scene.meshes.back().indicesData.offset = toUnsigned(indices->at(JsonLoader::Key::OFFSET).getInteger());
+                    scene.meshes.back().indicesData.format = indices->at(JsonLoader::Key::FORMAT).getString();
+                } else {
+                    scene.meshes.back().indicesData = { "", 0, ""};
+                }
+
+                scene.meshes.back().attributes.resize(3);
+
+                for (const JsonLoader::JsonMember& attr : node.at(JsonLoader::Key::ATTRIBUTES).getObject()) {
+                    const JsonLoader::JsonNode& attrVal = attr.value;
+
+                    Attribute a = {
+                        std::string(attr.key),
+                        std::string(attrVal.at(JsonLoader::Key::SRC).getString()),
+                        toUnsigned(attrVal.at(JsonLoader::Key::OFFSET).getInteger()),
+                        toUnsigned(attrVal.at(JsonLoader::Key::STRIDE).getInteger()),
+                        std::string(attrVal.at(JsonLoader::Key::FORMAT).getString())
+                    };
+
+                    setMeshAttribute(scene.meshes.back(), a);
+                }
+
+                // Assume that the src and stride for all attributes are the same
+                scene.meshes.back().src = scene.meshes.back().attributes[0].src;
+                scene.meshes.back().stride = scene.meshes.back().attributes[0].stride;
+            } else if (sceneType == "CAMERA") {
+                scene.typeIndices.push_back(scene.cameras.size());
+                scene.cameras.push_back({});
+
+                scene.cameras.back().name = node.at(JsonLoader::Key::NAME).getString();
+
+                const JsonLoader::JsonNode& perspective = node.at(JsonLoader::Key::PERSPECTIVE);
+
+                scene.cameras.back().aspect = perspective.at(JsonLoader::Key::ASPECT).getNumber();
+                scene.cameras.back().vfov = perspective.at(JsonLoader::Key::VFOV).getNumber();
+                scene.cameras.back().near = perspective.at(JsonLoader::Key::NEAR_PLANE).getNumber();
+                scene.cameras.back().far = perspective.at(JsonLoader::Key::FAR_PLANE).getNumber();
+            } else if (sceneType == "DRIVER") {
+                scene.typeIndices.push_back(scene.drivers.size());
+                scene.drivers.push_back({});
+
+                scene.drivers.back().name = node.at(JsonLoader::Key::NAME).getString();
+                scene.drivers.back().node = toUnsigned(node.at(JsonLoader::Key::NODE).getInteger());
+                scene.drivers.back().channel = node.at(JsonLoader::Key::CHANNEL).getString();
+
+                if (const JsonLoader::JsonNode* interpolation = node.find(JsonLoader::Key::INTERPOLATION)) {
+                    scene.drivers.back().interpolation = interpolation->getString();
+                } else {
+                    scene.drivers.back().interpolation = "LINEAR";
+                }
+
+                // check for them now so a missing key is reported the same way as before
+                node.at(JsonLoader::Key::TIMES);
+                node.at(JsonLoader::Key::VALUES);
+
+                driverJsons.push_back(&node);
+
+                scene.drivers.back().animIndex = scene.anims.size();
+
+                // Also initialize the corresponding Animation objects
+
+                scene.anims.push_back({});
+                scene.anims.back().curFrameIndex = std::numeric_limits<uint16_t>::max();
+            } else {
+                // every element needs an entry, otherwise the indices of everything after it are off by one
+                scene.typeIndices.push_back(std::numeric_limits<uint32_t>::max());
+            }
+        } else {
+            scene.typeIndices.push_back(std::numeric_limits<uint32_t>::max());
+
+            std::cout << "UNEXPECTED JSON TYPE!" << std::endl;
+        }
+    }
+
+    // drivers of nodes that aren't in the scene graph get dropped by resolveSceneIndices(), don't bother decoding them
+    std::vector<bool> reachable = findReachableNodes(scene);
+
+    for (size_t i = 0; i < scene.drivers.size(); i++) {
+        Driver& driver = scene.drivers[i];
+
+        if (driver.node >= scene.typeIndices.size() || scene.typeIndices[driver.node] >= reachable.size() || !reachable[scene.typeIndices[driver.node]]) {
+            continue;
+        }
+
+        const JsonLoader::JsonNode& times = driverJsons[i]->at(JsonLoader::Key::TIMES);
+        driver.times.resize(times.count);
+        times.getNumbers(driver.times.data(), driver.times.size());
+
+        const JsonLoader::JsonNode& values = driverJsons[i]->at(JsonLoader::Key::VALUES);
+        driver.values.resize(values.count);
+        values.getNumbers(driver.values.data(), driver.values.size());
+    }
+}
+
+std::vector<bool> SceneLoader::findReachableNodes(const Scene& scene) {
+    std::vector<bool> reachable(scene.nodes.size(), false);
+
+    // top level array indices, walked without recursion so deep hierarchies are fine
+    std::vector<uint32_t> pending(scene.roots.rbegin(), scene.roots.rend());
+
+    while (!pending.empty()) {
+        uint32_t element = pending.back();
+        pending.pop_back();
+
+        if (element >= scene.typeIndices.size()) {
+            continue;
+        }
+
+        uint32_t node = scene.typeIndices[element];
+
+        if (node >= scene.nodes.size() || reachable[node]) {
+            continue;
+        }
+
+        reachable[node] = true;
+
+        pending.insert(pending.end(), scene.nodes[node].children.rbegin(), scene.nodes[node].children.rend());
+    }
+
+    return reachable;
+}
+
+void SceneLoader::resolveSceneIndices(Scene& scene) {
+    // a driver of a node that isn't in the scene graph would animate something that's never drawn
+    std::vector<bool> reachable = findReachableNodes(scene);
+
+    std::vector<Driver> drivers;
+    std::vector<Animation> anims;
+
+    for (Driver& driver : scene.drivers) {
+        if (driver.node >= scene.typeIndices.size() || scene.typeIndices[driver.node] >= reachable.size() || !reachable[scene.typeIndices[driver.node]]) {
+            continue;
+        }
+
+        anims.push_back(scene.anims[driver.animIndex]);
+        driver.animIndex = anims.size() - 1;
+
+        drivers.push_back(std::move(driver));
+    }
+
+    scene.drivers = std::move(drivers);
+    scene.anims = std::move(anims);
+
+    for (size_t i = 0; i < scene.roots.size(); i++) {
+        scene.roots[i] = scene.typeIndices[scene.roots[i]];
+    }
+
+    for (Node& sceneNode : scene.nodes) {
+        for (size_t i = 0; i < sceneNode.children.size(); i++) {
+            sceneNode.children[i] = scene.typeIndices[sceneNode.children[i]];
+        }
+
+        if (sceneNode.camera.has_value()) {
+            sceneNode.camera = scene.typeIndices[sceneNode.camera.value()];
+        }
+
+        if (sceneNode.mesh.has_value()) {
+            sceneNode.mesh = scene.typeIndices[sceneNode.mesh.value()];
+        }
+    }
+
+    for (Driver& driver : scene.drivers) {
+        driver.node = scene.typeIndices[driver.node];
+    }
+
+    // Generate view mats for cameras
+    for (uint32_t root : scene.roots) {
+        generateCameraViewMatsInNode(scene.nodes[root], glm::mat4(1), scene);
+    }
+}
+
+void SceneLoader::streamSceneFromJson(Scene& scene, JsonLoader& json) {
+    if (json.peekToken() != JsonLoader::Token::Type::ARRAY_OPEN) {
+        throw std::runtime_error("The root of the scene json should be an array");
+    }
+
+    json.beginArray();
+
+    while (json.nextElement()) {
+        streamSceneElement(scene, json);
+    }
+}
+
+void SceneLoader::streamSceneInParallel(Scene& scene, JsonLoader& json) {
+    if (json.peekToken() != JsonLoader::Token::Type::ARRAY_OPEN) {
+        throw std::runtime_error("The root of the scene json should be an array");
+    }
+
+    size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<JsonLoader::Position> boundaries = json.splitTopLevelArray();
+    size_t elementCount = boundaries.size() - 1;
+
+    const char* first = boundaries.front().cursor;
+    size_t byteCount = boundaries.back().cursor - first;
+
+    // a few chunks per thread so that one with a couple of huge drivers doesn't hold everything up
+    size_t chunkCount = std::min(elementCount, threadCount * 4);
+
+    if (threadCount == 1 || chunkCount < 2 || byteCount < MIN_PARALLEL_BYTES) {
+        streamSceneFromJson(scene, json);
+        return;
+    }
+
+    // split by size rather than by element count, the elements can be very different in size
+    std::vector<size_t> chunkStarts = { 0 };
+
+    for (size_t i = 1; i < chunkCount; i++) {
+        const char* target = first + byteCount * i / chunkCount;
+
+        size_t element = std::lower_bound(boundaries.begin(), boundaries.end() - 1, target,
+            [](const JsonLoader::Position& position, const char* offset) {
+                return position.cursor < offset;
+            }) - boundaries.begin();
+
+        if (element > chunkStarts.back() && element < elementCount) {
+            chunkStarts.push_back(element);
+        }
+    }
+
+    chunkStarts.push_back(elementCount);
+    chunkCount = chunkStarts.size() - 1;
+
+    std::vector<SceneChunk> chunks(chunkCount);
+    std::atomic<size_t> nextChunk(0);
+
+    auto worker = [&]() {
+        for (size_t i = nextChunk++; i < chunkCount; i = nextChunk++) {
+            try {
+                JsonLoader chunkJson(json, boundaries[chunkStarts[i]], boundaries[chunkStarts[i + 1]]);
+
+                while (chunkJson.nextElement()) {
+                    chunks[i].elementTypes.push_back(streamSceneElement(chunks[i].scene, chunkJson));
+                }
+            } catch (...) {
+                chunks[i].error = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (size_t i = 1; i < std::min(threadCount, chunkCount); i++) {
+        threads.emplace_back(worker);
+    }
+
+    worker();
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    for (SceneChunk& chunk : chunks) {
+        if (chunk.error) {
+            std::rethrow_exception(chunk.error);
+        }
+
+        mergeSceneChunk(scene, chunk);
+    }
+}
+
+void SceneLoader::mergeSceneChunk(Scene& scene, SceneChunk& chunk) {
+    // the chunk's typeIndices point into its own arrays, offset them by what came before it
+    uint32_t nodeOffset = static_cast<uint32_t>(scene.nodes.size());
+    uint32_t meshOffset = static_cast<uint32_t>(scene.meshes.size());
+    uint32_t cameraOffset = static_cast<uint32_t>(scene.cameras.size());
+    uint32_t driverOffset = static_cast<uint32_t>(scene.drivers.size());
+    uint32_t animOffset = static_cast<uint32_t>(scene.anims.size());
+
+    for (size_t i = 0; i < chunk.elementTypes.size(); i++) {
+        ElementType elementType = chunk.elementTypes[i];
+        uint32_t index = chunk.scene.typeIndices[i];
+
+        if (elementType == ElementType::NODE) {
+            index += nodeOffset;
+        } else if (elementType == ElementType::MESH) {
+            index += meshOffset;
+        } else if (elementType == ElementType::CAMERA) {
+            index += cameraOffset;
+        } else if (elementType == ElementType::DRIVER) {
+            index += driverOffset;
+        }
+
+        scene.typeIndices.push_back(index);
+    }
+
+    for (Driver& driver : chunk.scene.drivers) {
+        driver.animIndex += animOffset;
+    }
+
+    // everything else refers to elements of the top level array, which doesn't change
+    scene.roots.insert(scene.roots.end(), chunk.scene.roots.begin(), chunk.scene.roots.end());
+
+    scene.nodes.insert(scene.nodes.end(), std::make_move_iterator(chunk.scene.nodes.begin()), std::make_move_iterator(chunk.scene.nodes.end()));
+    scene.meshes.insert(scene.meshes.end(), std::make_move_iterator(chunk.scene.meshes.begin()), std::make_move_iterator(chunk.scene.meshes.end()));
+    scene.cameras.insert(scene.cameras.end(), std::make_move_iterator(chunk.scene.cameras.begin()), std::make_move_iterator(chunk.scene.cameras.end()));
+    scene.drivers.insert(scene.drivers.end(), std::make_move_iterator(chunk.scene.drivers.begin()), std::make_move_iterator(chunk.scene.drivers.end()));
+    scene.anims.insert(scene.anims.end(), chunk.scene.anims.begin(), chunk.scene.anims.end());
+
+    chunk.scene = {};
+}
+
+SceneLoader::ElementType SceneLoader::streamSceneElement(Scene& scene, JsonLoader& json) {
+    JsonLoader::Token::Type type = json.peekToken();
+
+    if (type == JsonLoader::Token::Type::STRING) {
+        if (json.readString() != "s72-v1") {
+            std::cout << "UNEXPECTED JSON TYPE!" << std::endl;
+        }
+    } else if (type == JsonLoader::Token::Type::CURLY_OPEN) {
+        JsonLoader::Position start = json.tell();
+        std::string_view key;
+
+        json.beginObject();
+
+        // the type decides where everything else goes, it's almost always the first key
+        if (json.nextMember(key) && key == "type") {
+            return streamSceneObject(scene, json, json.readString());
+        }
+
+        // otherwise look ahead for it and then stream the object from the start
+        json.seek(start);
+        json.beginObject();
+
+        std::string_view sceneType;
+        bool foundType = false;
+
+        while (json.nextMember(key)) {
+            if (key == "type") {
+                sceneType = json.readString();
+                foundType = true;
+            } else {
+                json.skipValue();
+            }
+        }
+
+        checkKey(foundType, "type");
+
+        json.seek(start);
+        json.beginObject();
+
+        return streamSceneObject(scene, json, sceneType);
+    } else {
+        json.skipValue();
+
+        std::cout << "UNEXPECTED JSON TYPE!" << std::endl;
+    }
+
+    scene.typeIndices.push_back(std::numeric_limits<uint32_t>::max());
+
+    return ElementType::UNMAPPED;
+}
+
+SceneLoader::ElementType SceneLoader::streamSceneObject(Scene& scene, JsonLoader& json, std::string_view sceneType) {
+    std::string_view key;
+
+    if (sceneType == "SCENE") {
+        scene.typeIndices.push_back(std::numeric_limits<uint32_t>::max());
+
+        bool foundRoots = false;
+
+        while (json.nextMember(key)) {
+            if (key == "roots") {
+                json.beginArray();
+
+                while (json.nextElement()) {
+                    scene.roots.push_back(toUnsigned(json.readInteger()));
+                }
+
+                foundRoots = true;
+            } else {
+                json.skipValue();
+            }
+        }
+
+        checkKey(foundRoots, "roots");
+
+        return ElementType::UNMAPPED;
+    } else if (sceneType == "NODE") {
+        scene.typeIndices.push_back(scene.nodes.size());
+        scene.nodes.push_back({});
+
+        streamNode(scene.nodes.back(), json);
+
+        return ElementType::NODE;
+    } else if (sceneType == "MESH") {
+        scene.typeIndices.push_back(scene.meshes.size());
+        scene.meshes.push_back({});
+
+        streamMesh(scene.meshes.back(), json);
+
+        return ElementType::MESH;
+    } else if (sceneType == "CAMERA") {
+        scene.typeIndices.push_back(scene.cameras.size());
+        scene.cameras.push_back({});
+
+        streamCamera(scene.cameras.back(), json);
+
+        return ElementType::CAMERA;
+    } else if (sceneType == "DRIVER") {
+        scene.typeIndices.push_back(scene.drivers.size());
+        scene.drivers.push_back({});
+
+        streamDriver(scene.drivers.back(), json);
+
+        scene.drivers.back().animIndex = scene.anims.size();
+
+        scene.anims.push_back({});
+        scene.anims.back().curFrameIndex = std::numeric_limits<uint16_t>::max();
+
+        return ElementType::DRIVER;
+    } else {
+        scene.typeIndices.push_back(std::numeric_limits<uint32_t>::max());
+
+        while (json.nextMember(key)) {
+            json.skipValue();
+        }
+
+        return ElementType::UNMAPPED;
+    }
+}
+
+void SceneLoader::streamNode(Node& node, JsonLoader& json) {
+    node.translation = glm::vec3(0, 0, 0);
+    node.rotation = glm::quat(1, 0, 0, 0);
+    node.scale = glm::vec3(1, 1, 1);
+
+    bool foundName = false;
+    std::string_view key;
+
+    while (json.nextMember(key)) {
+        if (key == "name") {
+            node.name = json.readString();
+            foundName = true;
+        } else if (key == "translation") {
+            node.translation = streamVec3(json);
+        } else if (key == "rotation") {
+            node.rotation = streamQuat(json);
+        } else if (key == "scale") {
+            node.scale = streamVec3(json);
+        } else if (key == "children") {
+            json.beginArray();
+
+            while (json.nextElement()) {
+                node.children.push_back(toUnsigned(json.readInteger()));
+            }
+        } else if (key == "camera") {
+            node.camera = toUnsigned(json.readInteger());
+        } else if (key == "mesh") {
+            node.mesh = toUnsigned(json.readInteger());
+        } else {
+            json.skipValue();
+        }
+    }
+
+    checkKey(foundName, "name");
+}
+
+void SceneLoader::streamMesh(Mesh& mesh, JsonLoader& json) {
+    mesh.indicesData = { "", 0, "" };
+    mesh.attributes.resize(3);
+
+    bool foundName = false;
+    bool foundTopology = false;
+    bool foundCount = false;
+    bool foundAttributes = false;
+    std::string_view key;
+
+    while (json.nextMember(key)) {
+        if (key == "name") {
+            mesh.name = json.readString();
+            foundName = true;
+        } else if (key == "topology") {
+            mesh.topology = json.readString();
+            foundTopology = true;
+        } else if (key == "count") {
+            mesh.vertexCount = toUnsigned(json.readInteger());
+            foundCount = true;
+        } else if (key == "indices") {
+            mesh.indicesData = streamIndices(json);
+        } else if (key == "attributes") {
+            std::string_view attributeName;
+
+            json.beginObject();
+
+            while (json.nextMember(attributeName)) {
+                setMeshAttribute(mesh, streamAttribute(attributeName, json));
+            }
+
+            foundAttributes = true;
+        } else {
+            json.skipValue();
+        }
+    }
+
+    checkKey(foundName, "name");
+    checkKey(foundTopology, "topology");
+    checkKey(foundCount, "count");
+    checkKey(foundAttributes, "attributes");
+
+    // Assume that the src and stride for all attributes are the same
+    mesh.src = mesh.attributes[0].src;
+    mesh.stride = mesh.attributes[0].stride;
+}
+
+void SceneLoader::streamCamera(Camera& camera, JsonLoader& json) {
+    bool foundName = false;
+    bool foundPerspective = false;
+    std::string_view key;
+
+    while (json.nextMember(key)) {
+        if (key == "name") {
+            camera.name = json.readString();
+            foundName = true;
+        } else if (key == "perspective") {
+            bool foundAspect = false;
+            bool foundVfov = false;
+            bool foundNear = false;
+            bool foundFar = false;
+
+            json.beginObject();
+
+            while (json.nextMember(key)) {
+                if (key == "aspect") {
+                    camera.aspect = json.readNumber();
+                    foundAspect = true;
+                } else if (key == "vfov") {
+                    camera.vfov = json.readNumber();
+                    foundVfov = true;
+                } else if (key == "near") {
+                    camera.near = json.readNumber();
+                    foundNear = true;
+                } else if (key == "far") {
+                    camera.far = json.readNumber();
+                    foundFar = true;
+                } else {
+                    json.skipValue();
+                }
+            }
+
+            checkKey(foundAspect, "aspect");
+            checkKey(foundVfov, "vfov");
+            checkKey(foundNear, "near");
+            checkKey(foundFar, "far");
+
+            foundPerspective = true;
+        } else {
+            json.skipValue();
+        }
+    }
+
+    checkKey(foundName, "name");
+    checkKey(foundPerspective, "perspective");
+}
+
+void SceneLoader::streamDriver(Driver& driver, JsonLoader& json) {
+    driver.interpolation = "LINEAR";
+
+    bool foundName = false;
+    bool foundNode = false;
+    bool foundChannel = false;
+    bool foundTimes = false;
+    bool foundValues = false;
+    std::string_view key;
+
+    while (json.nextMember(key)) {
+        if (key == "name") {
+            driver.name = json.readString();
+            foundName = true;
+        } else if (key == "node") {
+            driver.node = toUnsigned(json.readInteger());
+            foundNode = true;
+        } else if (key == "channel") {
+            driver.channel = json.readString();
+            foundChannel = true;
+        } else if (key == "interpolation") {
+            driver.interpolation = json.readString();
+        } else if (key == "times") {
+            // the keyframes go straight into the driver, there's no intermediate array
+            json.beginArray();
+
+            while (json.nextElement()) {
+                driver.times.push_back(json.readNumber());
+            }
+
+            foundTimes = true;
+        } else if (key == "values") {
+            json.beginArray();
+
+            while (json.nextElement()) {
+                driver.values.push_back(json.readNumber());
+            }
+
+            foundValues = true;
+        } else {
+            json.skipValue();
+        }
+    }
+
+    checkKey(foundName, "name");
+    checkKey(foundNode, "node");
+    checkKey(foundChannel, "channel");
+    checkKey(foundTimes, "times");
+    checkKey(foundValues, "values");
+}
+
+Attribute SceneLoader::streamAttribute(std::string_view name, JsonLoader& json) {
+    Attribute attribute{};
+    attribute.name = name;
+
+    bool foundSrc = false;
+    bool foundOffset = false;
+    bool foundStride = false;
+    bool foundFormat = false;
+    std::string_view key;
+
+    json.beginObject();
+
+    while (json.nextMember(key)) {
+        if (key == "src") {
+            attribute.src = json.readString();
+            foundSrc = true;
+        } else if (key == "offset") {
+            attribute.offset = toUnsigned(json.readInteger());
+            foundOffset = true;
+        } else if (key == "stride") {
+            attribute.stride = toUnsigned(json.readInteger());
+            foundStride = true;
+        } else if (key == "format") {
+            attribute.format = json.readString();
+            foundFormat = true;
+        } else {
+            json.skipValue();
+        }
+    }
+
+    checkKey(foundSrc, "src");
+    checkKey(foundOffset, "offset");
+    checkKey(foundStride, "stride");
+    checkKey(foundFormat, "format");
+
+    return attribute;
+}
+
+Indices SceneLoader::streamIndices(JsonLoader& json) {
+    Indices indices{};
+
+    bool foundSrc = false;
+    bool foundOffset = false;
+    bool foundFormat = false;
+    std::string_view key;
+
+    json.beginObject();
+
+    while (json.nextMember(key)) {
+        if (key == "src") {
+            indices.src = json.readString();
+            foundSrc = true;
+        } else if (key == "offset") {
+            indices.offset = toUnsigned(json.readInteger());
+            foundOffset = true;
+        } else if (key == "format") {
+            indices.format = json.readString();
+            foundFormat = true;
+        } else {
+            json.skipValue();
+        }
+    }
+
+    checkKey(foundSrc, "src");
+    checkKey(foundOffset, "offset");
+    checkKey(foundFormat, "format");
+
+    return indices;
+}
+
+glm::vec3 SceneLoader::streamVec3(JsonLoader& json) {
+    glm::vec3 vec(0.0f);
+    size_t i = 0;
+
+    json.beginArray();
+
+    while (json.nextElement()) {
+        float component = json.readNumber();
+
+        if (i < 3) {
+            vec[i] = component;
+        }
+
+        i++;
+    }
+
+    checkComponentCount(i, 3);
+
+    return vec;
+}
+
+glm::quat SceneLoader::streamQuat(JsonLoader& json) {
+    // s72 stores quaternions as x, y, z, w
+    float components[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    size_t i = 0;
+
+    json.beginArray();
+
+    while (json.nextElement()) {
+        float component = json.readNumber();
+
+        if (i < 4) {
+            components[i] = component;
+        }
+
+        i++;
+    }
+
+    checkComponentCount(i, 4);
+
+    return glm::quat(components[3], components[0], components[1], components[2]);
+}
+
+glm::vec3 SceneLoader::parseVec3(const JsonLoader::JsonNode& node) {
+    float components[3];
+    node.getNumbers(components, 3);
+    checkComponentCount(node.count, 3);
+
+    return glm::vec3(
+        components[0],
+        components[1],
+        components[2]
+    );
+}
+
+glm::vec4 SceneLoader::parseVec4(const JsonLoader::JsonNode& node) {
+    float components[4];
+    node.getNumbers(components, 4);
+    checkComponentCount(node.count, 4);
+
+    return glm::vec4(
+        components[0],
+        components[1],
+        components[2],
+        components[3]
+    );
+}
+
+glm::quat SceneLoader::parseQuat(const JsonLoader::JsonNode& node) {
+    float components[4];
+    node.getNumbers(components, 4);
+    checkComponentCount(node.count, 4);
+
+    return glm::quat(
+        components[3],
+        components[0],
+        components[1],
+        components[2]
+    );
+}
+
+void SceneLoader::setMeshAttribute(Mesh& mesh, const Attribute& attribute) {
+    // hack to get attributes in the right order, should really sort by offset
+    if (attribute.name == "POSITION") {
+        mesh.attributes[0] = attribute;
+    } else if (attribute.name == "NORMAL") {
+        mesh.attributes[1] = attribute;
+    } else if (attribute.name == "COLOR") {
+        mesh.attributes[2] = attribute;
+    }
+}
+
+void SceneLoader::generateCameraViewMatsInNode(const Node& node, glm::mat4 transform, Scene& scene) {
+    glm::mat4 scaleMat = glm::scale(glm::mat4(1.0), node.scale);
+    glm::mat4 rotMat = glm::toMat4(node.rotation);
+    glm::mat4 transMat = glm::translate(glm::mat4(1.0), node.translation);
+
+    transform *= transMat * rotMat * scaleMat;
+
+    if (node.camera.has_value()) {
+        scene.cameras[node.camera.value()].viewMat = glm::inverse(transform);
+    }
+
+    for (uint32_t child : node.children) {
+        Node childNode = scene.nodes[child];
+
+        generateCameraViewMatsInNode(childNode, transform, scene);
+    }
+}
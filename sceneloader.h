@@ -0,0 +1,88 @@
+#ifndef _SCENE_LOADER_H
+#define _SCENE_LOADER_H
+
+#include <exception>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "jsonloader.h"
+#include "scene.h"
+
+// Builds a Scene from an s72 file. The DOM parser builds the whole JsonNode tree
+// first and then walks it, the streaming parser fills the Scene straight from the
+// tokens so that nothing bigger than the Scene itself is ever kept in memory. The
+// parallel parser streams chunks of the top level array on several threads and then
+// stitches the partial scenes together.
+class SceneLoader {
+public:
+
+    enum class Parser {
+        DOM,
+        STREAMING,
+        PARALLEL
+    };
+
+    SceneLoader(std::string filename, Parser parser, JsonLoader::Backend backend = JsonLoader::Backend::AUTO);
+
+    void loadScene(Scene& scene);
+
+    // Builds the scene from a tree returned by JsonLoader::parseJson(). The tree may have
+    // lazy arrays, so the loader has to stay open until this returns. The keyframes of
+    // drivers whose node isn't reachable from the roots are never decoded.
+    static void constructSceneFromJson(Scene& scene, const JsonLoader::JsonNode* json);
+
+    // Turns the indices into the top level JSON array (roots, children, cameras, meshes
+    // and driver nodes) into indices into the Scene arrays, then generates the camera
+    // view matrices. Drivers of nodes that aren't reachable from the roots are dropped.
+    // Every parser finishes with this.
+    static void resolveSceneIndices(Scene& scene);
+
+private:
+
+    // which array the typeIndices entry of a top level element points into, so that partial scenes can be merged
+    enum class ElementType {
+        UNMAPPED, // the version string, SCENE objects and anything unknown
+        NODE,
+        MESH,
+        CAMERA,
+        DRIVER
+    };
+
+    // the result of streaming a range of the top level array on its own
+    struct SceneChunk {
+        Scene scene;
+        std::vector<ElementType> elementTypes;
+        std::exception_ptr error;
+    };
+
+    std::string filename;
+    Parser parser;
+    JsonLoader::Backend backend;
+
+    static void streamSceneFromJson(Scene& scene, JsonLoader& json);
+    static void streamSceneInParallel(Scene& scene, JsonLoader& json);
+    static void mergeSceneChunk(Scene& scene, SceneChunk& chunk);
+    // indexed by node, works on the indices before they are resolved
+    static std::vector<bool> findReachableNodes(const Scene& scene);
+    static ElementType streamSceneElement(Scene& scene, JsonLoader& json);
+    static ElementType streamSceneObject(Scene& scene, JsonLoader& json, std::string_view sceneType);
+    static void streamNode(Node& node, JsonLoader& json);
+    static void streamMesh(Mesh& mesh, JsonLoader& json);
+    static void streamCamera(Camera& camera, JsonLoader& json);
+    static void streamDriver(Driver& driver, JsonLoader& json);
+    static Attribute streamAttribute(std::string_view name, JsonLoader& json);
+    static Indices streamIndices(JsonLoader& json);
+    static glm::vec3 streamVec3(JsonLoader& json);
+    static glm::quat streamQuat(JsonLoader& json);
+
+    static glm::vec3 parseVec3(const JsonLoader::JsonNode& node);
+    static glm::vec4 parseVec4(const JsonLoader::JsonNode& node);
+    static glm::quat parseQuat(const JsonLoader::JsonNode& node);
+
+    static void setMeshAttribute(Mesh& mesh, const Attribute& attribute);
+
+    static void generateCameraViewMatsInNode(const Node& node, glm::mat4 transform, Scene& scene);
+};
+
+#endif // _SCENE_LOADER_H
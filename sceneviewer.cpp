@@ -13,6 +13,8 @@
 #include <fstream>
 #include <iostream>
 #include <limits>
+#include <map>
+#include <memory>
 #include <optional>
 #include <set>
 #include <stdexcept>
@@ -32,7 +34,19 @@
 #include "glm/gtx/string_cast.hpp"
 #include "glm/gtc/matrix_inverse.hpp"
 
-#include "jsonloader.h"
+#include "scene.h"
+#include "sceneloader.h"
+#include "meshindexer.h"
+#include "meshloader.h"
+#include "meshoptimizer.h"
+#include "meshpipeline.h"
+#include "vertexkernels.h"
+#include "vertexquantizer.h"
+#include "meshletbuilder.h"
+#include "meshsimplifier.h"
+#include "scenecache.h"
+#include "uploadbatcher.h"
+#include "memoryallocator.h"
 #include "eventloader.h"
 #include "rg_WindowManager.h"
 #include "OrbitCamera.h"
@@ -44,6 +58,12 @@ const uint32_t HEIGHT = 600;
 
 const uint32_t MAX_FRAMES_IN_FLIGHT = 2;
 
+// the first mesh buffer of a vertex layout and index type holds this much of each, every
+// one after it twice as much as the one before, up to the max (or one mesh, if that's bigger).
+// The max is the most the allocator sub-allocates from a block, bigger ones get their own memory.
+const VkDeviceSize MIN_MESH_BUFFER_SIZE = 1024 * 1024;
+const VkDeviceSize MAX_MESH_BUFFER_SIZE = MemoryAllocator::BLOCK_SIZE / 2;
+
 const std::vector<const char*> validationLayers = {
     "VK_LAYER_KHRONOS_validation"
 };
@@ -61,6 +81,8 @@ const bool enableValidationLayers = true;
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    // a family that can only copy if the device has one, the graphics family otherwise
+    std::optional<uint32_t> transferFamily;
 
     bool isComplete() {
         return graphicsFamily.has_value() && presentFamily.has_value();
@@ -101,41 +123,11 @@ void DestroyDebugUtilsMessengerEXT(
     }
 }
 
-struct Vertex {
-    glm::vec3 pos;
-    glm::vec3 normal;
-    glm::vec3 color;
-
-    static std::array<VkVertexInputBindingDescription, 1> getBindingDescriptions() {
-        std::array<VkVertexInputBindingDescription, 1> bindingDescriptions{};
-
-        bindingDescriptions[0].binding = 0;
-        bindingDescriptions[0].stride = sizeof(Vertex);
-        bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-        return bindingDescriptions;
-    }
-
-    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
-        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
-
-        attributeDescriptions[0].binding = 0;
-        attributeDescriptions[0].location = 0;
-        attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[0].offset = offsetof(Vertex, pos);
-
-        attributeDescriptions[1].binding = 0;
-        attributeDescriptions[1].location = 1;
-        attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[1].offset = offsetof(Vertex, normal);
-
-        attributeDescriptions[2].binding = 0;
-        attributeDescriptions[2].location = 2;
-        attributeDescriptions[2].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[2].offset = offsetof(Vertex, color);
-
-        return attributeDescriptions;
-    }
+// the quantized vertex shader reads all of it, the other one only the model matrix
+struct PushConstants {
+    glm::mat4 model;
+    glm::vec4 positionMin;
+    glm::vec4 positionExtent;
 };
 
 struct UniformBufferObject {
@@ -144,208 +136,6 @@ struct UniformBufferObject {
     alignas(16) glm::mat4 proj;
 };
 
-struct Attribute {
-    std::string name;
-    std::string src;
-    uint32_t offset;
-    uint32_t stride;
-    std::string format;
-
-    void print() {
-        std::cout << "Attribute Name: " << name << std::endl;
-        std::cout << "    Src: " << src << std::endl;
-        std::cout << "    Offset: " << offset << std::endl;
-        std::cout << "    Stride: " << stride << std::endl;
-        std::cout << "    Format: " << format << std::endl;
-    }
-};
-
-struct Indices {
-    std::string src;
-    uint32_t offset;
-    std::string format;
-};
-
-struct Node {
-    std::string name;
-    glm::vec3 translation;
-    glm::quat rotation;
-    glm::vec3 scale;
-    std::vector<uint16_t> children;
-    std::optional<uint16_t> camera;
-    std::optional<uint16_t> mesh;
-
-    void print() {
-        std::cout << "Name: " << name << std::endl;
-
-        std::cout << "Translation: " << glm::to_string(translation) << std::endl;
-        std::cout << "Rotation: " << glm::to_string(rotation) << std::endl;
-        std::cout << "Scale: " << glm::to_string(scale) << std::endl;
-
-        std::cout << "Children: ";
-        for (uint16_t child : children) {
-            std:: cout << child << " ";
-        }
-        std::cout << std::endl;
-
-        if (camera.has_value()) {
-            std::cout << "Camera: " << camera.value() << std::endl;
-        }
-        
-        if (mesh.has_value()) {
-            std::cout << "Mesh: " << mesh.value() << std::endl;
-        }
-    }
-};
-
-struct Mesh {
-    std::string name;
-    std::string topology;
-    uint32_t vertexCount;
-    std::string src;
-    uint32_t stride;
-    Indices indicesData;
-    std::vector<Attribute> attributes;
-
-    std::vector<Vertex> vertices;
-    std::vector<uint16_t> indices;
-
-    VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
-
-    VkBuffer indexBuffer;
-    VkDeviceMemory indexBufferMemory;
-    std::array<glm::vec3, 2> aabb; // define min point and max point for AABB
-
-    void cleanupBuffers(VkDevice device) {
-        vkDestroyBuffer(device, indexBuffer, nullptr);
-        vkFreeMemory(device, indexBufferMemory, nullptr);
-
-        vkDestroyBuffer(device, vertexBuffer, nullptr);
-        vkFreeMemory(device, vertexBufferMemory, nullptr);
-    }
-
-    void print() {
-        std::cout << "Name: " << name << std::endl;
-        std::cout << "Topology: " << topology << std::endl;
-        std::cout << "Vertex Count: " << vertexCount << std::endl;
-        std::cout << "Src: " << src << std::endl;
-        std::cout << "Stride: " << stride << std::endl;
-
-        if (indicesData.src != "") {
-            std::cout << "indices.Src: " << indicesData.src << std::endl;
-            std::cout << "indices.Offset: " << indicesData.offset << std::endl;
-            std::cout << "indices.Format: " << indicesData.format << std::endl;
-        }
-
-        for (Attribute& attr : attributes) {
-            attr.print();
-        }
-    }
-};
-
-// assume perspective camera
-struct Camera {
-    std::string name;
-    float vfov;
-    float aspect;
-    float near;
-    float far;
-    glm::mat4 viewMat;
-
-    void print() {
-        std::cout << "Name: " << name << std::endl;
-        std::cout << "Aspect: " << aspect << std::endl;
-        std::cout << "Vfov: " << vfov << std::endl;
-        std::cout << "Near: " << near << std::endl;
-        std::cout << "Far: " << far << std::endl;
-        std::cout << "View Mat: " << glm::to_string(viewMat) << std::endl;
-    }
-};
-
-struct Driver {
-    std::string name;
-    uint16_t node;
-    std::string channel;
-    std::vector<float> times;
-    std::vector<float> values;
-    std::string interpolation;
-    uint16_t animIndex;
-
-    void print() {
-        std::cout << "Name: " << name << std::endl;
-
-        std::cout << "Node: " << node << std::endl;
-        std::cout << "Channel: " << channel << std::endl;
-        std::cout << "Interpolation: " << interpolation << std::endl;
-
-        std::cout << "Times: ";
-        for (float time : times) {
-            std::cout << time << " ";
-        }
-        std::cout << std::endl;
-
-        std::cout << "Values: ";
-        for (float value : values) {
-            std::cout << value << " ";
-        }
-        std::cout << std::endl;
-    }
-};
-
-struct Animation {
-    std::chrono::high_resolution_clock::time_point startTime;
-    uint16_t curFrameIndex;
-};
-
-struct Scene {
-    std::vector<Node> nodes;
-    std::vector<Mesh> meshes;
-    std::vector<Camera> cameras;
-    std::vector<Driver> drivers;
-    std::vector<Animation> anims;
-    std::vector<uint16_t> roots;
-
-    // maps indices of JSON nodes to the index of the corresponding struct in one of the arrays of the Scene object
-    // EXAMPLE: If the first mesh is at index 5 in the JSON array, then typeIndices[5] == 0.
-    //          Similary, if the first node is at index 3, then typeIndices[3] == 0 as well
-    std::vector<uint16_t> typeIndices;
-
-    void print() {
-        std::cout << "Scene:" << std::endl;
-        
-        std::cout << std::endl << "ROOTS:" << std::endl;
-        for (uint16_t& root : roots) {
-            std::cout << root << " ";
-        }
-        std::cout << std::endl;
-
-        std::cout << std::endl << "CAMERAS:" << std::endl;
-        for (Camera& camera : cameras) {
-            camera.print();
-        }
-        std::cout << std::endl;
-
-        std::cout << std::endl << "NODES:" << std::endl;
-        for (Node& node : nodes) {
-            node.print();
-        }
-        std::cout << std::endl;
-
-        std::cout << std::endl << "MESHES:" << std::endl;
-        for (Mesh& mesh : meshes) {
-            mesh.print();
-        }
-        std::cout << std::endl;
-
-        std::cout << std::endl << "DRIVERS:" << std::endl;
-        for (Driver& driver : drivers) {
-            driver.print();
-        }
-        std::cout << std::endl;
-    }
-};
-
 // the vec4 culling planes represent the plane equation: Ax+By+Cz+D = 0, where the vec4 is (A, B, C, D)
 struct Frustum {
     glm::vec4 nearPlane;
@@ -366,6 +156,15 @@ struct CLIArguments {
     std::string eventsFile = "";
     bool headless = false;
     std::string culling = "none";
+    std::string sceneParser = "parallel";
+    // opt in, the cache is a copy of every mesh next to the scene
+    std::string sceneCache = "off";
+    bool optimizeMeshes = false;
+    bool quantizeVertices = false;
+    // LODs are only built when this is set, the most an LOD may be off on screen, in pixels
+    std::optional<float> lodError;
+    bool lodStats = false;
+    bool memoryStats = false;
 };
 
 // forward declarations, implementations at the end of this file
@@ -375,6 +174,8 @@ void glfwKeyCallback(GLFWwindow* window, int key, int scancode, int action, int
 class HelloTriangleApplication {
 public:
     void run(int argc, char* argv[]) {
+        launchTime = std::chrono::high_resolution_clock::now();
+
         processCLIArgs(argc, argv);
 
         if (args.headless) {
@@ -417,18 +218,26 @@ private:
     bool mousePressed = false;
 
     VkInstance instance = VK_NULL_HANDLE;
+    // what the instance was made with, 1.0 on an old loader
+    uint32_t instanceApiVersion = VK_API_VERSION_1_0;
     VkDebugUtilsMessengerEXT debugMessenger = VK_NULL_HANDLE;
     VkSurfaceKHR surface = VK_NULL_HANDLE;
 
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
     VkDevice device = VK_NULL_HANDLE;
+    // mesh uploads are tracked with one if the device has them, and with fences if it doesn't
+    bool timelineSemaphores = false;
+
+    // every buffer and image is bound to memory from here
+    MemoryAllocator memoryAllocator;
 
     VkQueue graphicsQueue = VK_NULL_HANDLE;
     VkQueue presentQueue = VK_NULL_HANDLE;
+    VkQueue transferQueue = VK_NULL_HANDLE;
 
     VkSwapchainKHR swapChain = VK_NULL_HANDLE;
     std::vector<VkImage> swapChainImages;
-    std::vector<VkDeviceMemory> swapChainImagesMemory;
+    std::vector<MemoryAllocation> swapChainImagesAllocations;
     VkFormat swapChainImageFormat;
     VkExtent2D swapChainExtent;
     std::vector<VkImageView> swapChainImageViews;
@@ -437,22 +246,30 @@ private:
     VkRenderPass renderPass;
     VkDescriptorSetLayout descriptorSetLayout;
     VkPipelineLayout pipelineLayout;
-    VkPipeline graphicsPipeline;
+    // one per vertex layout the meshes use, every mesh points at its own
+    std::map<VertexLayout, VkPipeline> graphicsPipelines;
+    // while recording, so meshes with the same layout don't bind it again
+    VkPipeline boundPipeline = VK_NULL_HANDLE;
+    // and meshes in the same mesh buffer don't bind its buffers again
+    uint32_t boundMeshBuffer = UINT32_MAX;
+    // how many meshes were drawn at each LOD in the frame being recorded
+    std::array<uint32_t, MeshSimplifier::MAX_LODS> lodDraws;
 
     VkCommandPool commandPool;
+    VkCommandPool transferCommandPool;
 
     VkImage depthImage;
-    VkDeviceMemory depthImageMemory;
+    MemoryAllocation depthImageAllocation;
     VkImageView depthImageView;
 
     VkImage textureImage;
-    VkDeviceMemory textureImageMemory;
+    MemoryAllocation textureImageAllocation;
     VkImageView textureImageView;
 
     VkSampler textureSampler;
 
     std::vector<VkBuffer> uniformBuffers;
-    std::vector<VkDeviceMemory> uniformBuffersMemory;
+    std::vector<MemoryAllocation> uniformBuffersAllocations;
     std::vector<void*> uniformBuffersMapped;
 
     VkDescriptorPool descriptorPool;
@@ -470,9 +287,44 @@ private:
     UniformBufferObject ubo{};
 
     Scene scene;
+    // every .b72 file the meshes read from, mapped until its meshes are streamed (or the cache is written from them)
+    SourceFileCache sourceFiles;
+    bool releaseSourceFiles = false;
+    // the meshes loaded from the scene cache point into it, it's closed once they're all streamed
+    MappedFile sceneCacheFile;
+    bool meshesCached = false;
+    // written once every mesh is streamed, if saveSceneCache
+    std::string sceneCachePath;
+    SceneCache::MeshOptions meshOptions;
+    bool saveSceneCache = false;
+
+    // reads and decodes the meshes on worker threads while frames are drawn, gone once every mesh is staged
+    std::unique_ptr<MeshPipeline> meshPipeline;
+    // filled in by the workers, printed as each mesh is staged so the lines don't interleave
+    std::vector<MeshOptimizer::Stats> optimizerStats;
+    // the last mesh buffer of each vertex layout and index type, meshes go into it until it's full
+    std::map<std::pair<VertexLayout, VkIndexType>, uint32_t> openMeshBuffers;
+
+    // the meshes after the first frames, gone once they're all resident
+    std::unique_ptr<UploadBatcher> meshUploads;
+    // the meshes in the order they were staged, and the batcher's semaphore value each one is done at
+    std::vector<size_t> stagedMeshes;
+    std::vector<uint64_t> meshUploadValues;
+    // the staged meshes before this are drawn
+    size_t residentMeshCount = 0;
+    uint64_t acquiredUploadValue = 0;
+    // what the frame being recorded has to wait for, 0 if it doesn't use anything new
+    uint64_t meshUploadWaitValue = 0;
+
+    std::chrono::high_resolution_clock::time_point launchTime;
+    bool firstFrameSubmitted = false;
+
     OrbitCamera orbitCamera;
     uint32_t curCamera = 0; // 0 is the user-controlled orbit camera, values greater than 0 are scene cameras
     Frustum frustum;
+    glm::vec3 cameraPosition;
+    // how many pixels an angle of one radian covers at the center of the screen, for selectLod
+    float pixelsPerRadian = 0.0f;
 
     static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
         VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -530,6 +382,20 @@ private:
                     handleArgDrawingSize(std::array<std::string, 3>{ argv[i], argv[i+1], argv[i+2] });
                 } else if (arg == "--culling") {
                     handleArgCulling(std::array<std::string, 2>{ argv[i], argv[i+1] });
+                } else if (arg == "--scene-parser") {
+                    handleArgSceneParser(std::array<std::string, 2>{ argv[i], argv[i+1] });
+                } else if (arg == "--scene-cache") {
+                    handleArgSceneCache(std::array<std::string, 2>{ argv[i], argv[i+1] });
+                } else if (arg == "--optimize-meshes") {
+                    handleArgOptimizeMeshes(std::array<std::string, 1>{ argv[i] });
+                } else if (arg == "--quantize-vertices") {
+                    handleArgQuantizeVertices(std::array<std::string, 1>{ argv[i] });
+                } else if (arg == "--lod-error") {
+                    handleArgLodError(std::array<std::string, 2>{ argv[i], argv[i+1] });
+                } else if (arg == "--lod-stats") {
+                    handleArgLodStats(std::array<std::string, 1>{ argv[i] });
+                } else if (arg == "--memory-stats") {
+                    handleArgMemoryStats(std::array<std::string, 1>{ argv[i] });
                 } else if (arg == "--headless") {
                     handleArgHeadless(std::array<std::string, 2>{ argv[i], argv[i+1] });
                 } else{
@@ -575,11 +441,75 @@ private:
 
         args.culling = arr[1];
 
-        if (args.culling != "frustum" && args.culling != "none") {
-            throw std::runtime_error("Unexpected culling mode: " + args.culling + " (must be \"none\" or \"frustum\")");
+        if (args.culling != "frustum" && args.culling != "meshlet" && args.culling != "none") {
+            throw std::runtime_error("Unexpected culling mode: " + args.culling + " (must be \"none\", \"frustum\" or \"meshlet\")");
+        }
+    }
+
+    void handleArgSceneParser(const std::array<std::string, 2> &arr) {
+        std::cout << std::endl << "Handling " << arr[0] << std::endl;
+        std::cout << "scene parser: " << arr[1] << std::endl;
+
+        args.sceneParser = arr[1];
+
+        if (args.sceneParser != "parallel" && args.sceneParser != "streaming" && args.sceneParser != "dom") {
+            throw std::runtime_error("Unexpected scene parser: " + args.sceneParser + " (must be \"parallel\", \"streaming\" or \"dom\")");
+        }
+    }
+
+    void handleArgSceneCache(const std::array<std::string, 2> &arr) {
+        std::cout << std::endl << "Handling " << arr[0] << std::endl;
+        std::cout << "scene cache: " << arr[1] << std::endl;
+
+        args.sceneCache = arr[1];
+
+        if (args.sceneCache != "on" && args.sceneCache != "off" && args.sceneCache != "rebuild") {
+            throw std::runtime_error("Unexpected scene cache mode: " + args.sceneCache + " (must be \"on\", \"off\" or \"rebuild\")");
         }
     }
 
+    void handleArgOptimizeMeshes(const std::array<std::string, 1> &arr) {
+        std::cout << std::endl << "Handling " << arr[0] << std::endl;
+        args.optimizeMeshes = true;
+    }
+
+    void handleArgQuantizeVertices(const std::array<std::string, 1> &arr) {
+        std::cout << std::endl << "Handling " << arr[0] << std::endl;
+
+        // the shader isn't checked in, compile.sh builds it (with glslc)
+        if (!std::ifstream("vert_quantized.spv")) {
+            std::cout << "vert_quantized.spv not found, run compile.sh to build it; drawing unquantized vertices" << std::endl;
+            return;
+        }
+
+        args.quantizeVertices = true;
+    }
+
+    void handleArgLodError(const std::array<std::string, 2> &arr) {
+        std::cout << std::endl << "Handling " << arr[0] << std::endl;
+        std::cout << "LOD error: " << arr[1] << " pixels" << std::endl;
+
+        try {
+            args.lodError = stof(arr[1]);
+        } catch (const std::invalid_argument& e) {
+            throw std::invalid_argument("The argument for --lod-error is invalid: " + arr[1]);
+        }
+
+        if (!(args.lodError.value() >= 0.0f)) {
+            throw std::invalid_argument("The argument for --lod-error can't be negative: " + arr[1]);
+        }
+    }
+
+    void handleArgLodStats(const std::array<std::string, 1> &arr) {
+        std::cout << std::endl << "Handling " << arr[0] << std::endl;
+        args.lodStats = true;
+    }
+
+    void handleArgMemoryStats(const std::array<std::string, 1> &arr) {
+        std::cout << std::endl << "Handling " << arr[0] << std::endl;
+        args.memoryStats = true;
+    }
+
     void handleArgHeadless(const std::array<std::string, 2> &arr) {
         std::cout << std::endl << "Handling " << arr[0] << std::endl;
         std::cout << "event file: " << arr[1] << std::endl << std::endl;
@@ -638,6 +568,8 @@ private:
         pickPhysicalDevice();
         createLogicalDevice();
 
+        memoryAllocator.init(physicalDevice, device);
+
         if (args.headless) {
             createHeadlessSwapChain(3);
         } else {
@@ -658,7 +590,7 @@ private:
 
         createUniformBuffers();
 
-        createGraphicsPipeline();
+        createPipelineLayout();
         //createTextureImage();
         //createTextureImageView();
         //createTextureSampler();
@@ -669,6 +601,18 @@ private:
         createCommandBuffers();
 
         createSyncObjects();
+
+        // saved frames have to show the whole scene, so headless runs wait for every mesh instead of streaming them
+        if (args.headless) {
+            size_t meshIndex;
+
+            while (meshPipeline->nextReadyMesh(meshIndex)) {
+                stageMesh(meshIndex);
+            }
+
+            finishLoading();
+            meshUploads->flush();
+        }
     }
 
     void createInstance() {
@@ -682,7 +626,15 @@ private:
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         appInfo.pEngineName = "No Engine";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        // timeline semaphores need 1.2, but a 1.0 loader rejects anything newer than 1.0 (and doesn't have vkEnumerateInstanceVersion)
+        PFN_vkEnumerateInstanceVersion enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+
+        if (enumerateInstanceVersion != nullptr) {
+            enumerateInstanceVersion(&instanceApiVersion);
+        }
+
+        instanceApiVersion = std::min<uint32_t>(instanceApiVersion, VK_API_VERSION_1_2);
+        appInfo.apiVersion = instanceApiVersion;
 
         VkInstanceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -912,9 +864,44 @@ private:
             i++;
         }
 
+        // a family that can only copy is usually a DMA engine, which uploads while the graphics queue draws
+        for (uint32_t j = 0; j < queueFamilyCount; j++) {
+            VkQueueFlags flags = queueFamilies[j].queueFlags;
+
+            if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+                indices.transferFamily = j;
+                break;
+            }
+        }
+
+        if (!indices.transferFamily.has_value()) {
+            indices.transferFamily = indices.graphicsFamily;
+        }
+
         return indices;
     }
 
+    bool supportsTimelineSemaphores(VkPhysicalDevice device) {
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(device, &deviceProperties);
+
+        // vkGetPhysicalDeviceFeatures2 and the feature struct are only there from 1.2 on both sides
+        if (instanceApiVersion < VK_API_VERSION_1_2 || deviceProperties.apiVersion < VK_API_VERSION_1_2) {
+            return false;
+        }
+
+        VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+        timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &timelineFeatures;
+
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        return timelineFeatures.timelineSemaphore == VK_TRUE;
+    }
+
     bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
         uint32_t extensionCount;
         vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
@@ -963,12 +950,14 @@ private:
 
         if (args.headless) {
             uniqueQueueFamilies = {
-                indices.graphicsFamily.value()
+                indices.graphicsFamily.value(),
+                indices.transferFamily.value()
             };
         } else {
             uniqueQueueFamilies = {
                 indices.graphicsFamily.value(),
-                indices.presentFamily.value()
+                indices.presentFamily.value(),
+                indices.transferFamily.value()
             };
         }
 
@@ -987,9 +976,19 @@ private:
         VkPhysicalDeviceFeatures deviceFeatures{};
         deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+        timelineSemaphores = supportsTimelineSemaphores(physicalDevice);
+
+        VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+        timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+        timelineFeatures.timelineSemaphore = VK_TRUE;
+
         VkDeviceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
+        if (timelineSemaphores) {
+            createInfo.pNext = &timelineFeatures;
+        }
+
         createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
@@ -1014,12 +1013,14 @@ private:
             "failed to create logical device");
 
         vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
+        vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &transferQueue);
 
         if (!args.headless) {
             vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
         }
 
         std::cout << "Graphics queue index: " << indices.graphicsFamily.value() << std::endl;
+        std::cout << "Mesh uploads tracked with " << (timelineSemaphores ? "a timeline semaphore" : "fences") << std::endl;
 
         if (!args.headless) {
             std::cout << "Present queue index: " << indices.presentFamily.value() << std::endl;
@@ -1037,12 +1038,12 @@ private:
         };
 
         swapChainImages.resize(imageCount);
-        swapChainImagesMemory.resize(imageCount);
+        swapChainImagesAllocations.resize(imageCount);
 
         for (size_t i = 0; i < swapChainImages.size(); i++) {
             createImage(swapChainExtent.width, swapChainExtent.height, swapChainImageFormat,
                 VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                swapChainImages[i], swapChainImagesMemory[i]);
+                swapChainImages[i], swapChainImagesAllocations[i]);
         }
     }
 
@@ -1263,8 +1264,38 @@ private:
             "failed to create descriptor set layou");
     }
 
-    void createGraphicsPipeline() {
-        std::vector<char> vertShaderCode = readFile("vert.spv");
+    void createPipelineLayout() {
+        VkPushConstantRange range = {};
+        range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        range.offset = 0;
+        range.size = sizeof(PushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &range;
+
+        vkCheckResult(
+            vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout),
+            "failed to create pipeline layout");
+    }
+
+    // the one for meshes with this vertex layout, made the first time a mesh with it is streamed
+    VkPipeline getGraphicsPipeline(const VertexLayout& layout) {
+        auto found = graphicsPipelines.find(layout);
+
+        if (found == graphicsPipelines.end()) {
+            found = graphicsPipelines.emplace(layout, createGraphicsPipeline(layout)).first;
+        }
+
+        return found->second;
+    }
+
+    // everything but the vertex input (and the vertex shader for quantized vertices) is the same for every layout
+    VkPipeline createGraphicsPipeline(const VertexLayout& layout) {
+        std::vector<char> vertShaderCode = readFile(VertexQuantizer::isQuantized(layout) ? "vert_quantized.spv" : "vert.spv");
         std::vector<char> fragShaderCode = readFile("frag.spv");
 
         VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
@@ -1284,16 +1315,6 @@ private:
 
         VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
 
-        std::array<VkVertexInputBindingDescription, 1> bindingDescriptions = Vertex::getBindingDescriptions();
-        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = Vertex::getAttributeDescriptions();
-
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());;
-        vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
-        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
         VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
         inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
         inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
@@ -1369,27 +1390,10 @@ private:
         dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
         dynamicState.pDynamicStates = dynamicStates.data();
 
-        VkPushConstantRange range = {};
-        range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-        range.offset = 0;
-        range.size = sizeof(glm::mat4);
-
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 1;
-        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-        pipelineLayoutInfo.pushConstantRangeCount = 1;
-        pipelineLayoutInfo.pPushConstantRanges = &range;
-
-        vkCheckResult(
-            vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout),
-            "failed to create pipeline layout");
-
         VkGraphicsPipelineCreateInfo pipelineInfo{};
         pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
         pipelineInfo.stageCount = 2;
         pipelineInfo.pStages = shaderStages;
-        pipelineInfo.pVertexInputState = &vertexInputInfo;
         pipelineInfo.pInputAssemblyState = &inputAssembly;
         pipelineInfo.pViewportState = &viewportState;
         pipelineInfo.pRasterizationState = &rasterizer;
@@ -1403,12 +1407,27 @@ private:
         pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
         pipelineInfo.basePipelineIndex = -1;
 
+        std::array<VkVertexInputBindingDescription, 1> bindingDescriptions = layout.getBindingDescriptions();
+        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = layout.getAttributeDescriptions();
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+        vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+
+        VkPipeline pipeline;
         vkCheckResult(
-            vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline),
+            vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline),
             "failed to created graphics pipeline");
 
         vkDestroyShaderModule(device, vertShaderModule, nullptr);
         vkDestroyShaderModule(device, fragShaderModule, nullptr);
+
+        return pipeline;
     }
 
     VkShaderModule createShaderModule(const std::vector<char>& code) {
@@ -1460,6 +1479,12 @@ private:
         vkCheckResult(
             vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool),
             "failed to create command pool");
+
+        poolInfo.queueFamilyIndex = queueFamilyIndices.transferFamily.value();
+
+        vkCheckResult(
+            vkCreateCommandPool(device, &poolInfo, nullptr, &transferCommandPool),
+            "failed to create transfer command pool");
     }
 
     void createDepthResources() {
@@ -1467,7 +1492,7 @@ private:
 
         createImage(swapChainExtent.width, swapChainExtent.height, depthFormat,
             VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            depthImage, depthImageMemory);
+            depthImage, depthImageAllocation);
         depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
     }
 
@@ -1510,17 +1535,14 @@ private:
         }
 
         VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
+        MemoryAllocation stagingBufferAllocation;
 
         createBuffer(imageSize,
             VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            stagingBuffer, stagingBufferMemory);
+            stagingBuffer, stagingBufferAllocation);
 
-        void* data;
-        vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-        memcpy(data, pixels, static_cast<size_t>(imageSize));
-        vkUnmapMemory(device, stagingBufferMemory);
+        memcpy(stagingBufferAllocation.mapped, pixels, static_cast<size_t>(imageSize));
 
         stbi_image_free(pixels);
 
@@ -1528,7 +1550,7 @@ private:
             VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
             VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            textureImage, textureImageMemory);
+            textureImage, textureImageAllocation);
 
         transitionImageLayout(textureImage,
             VK_FORMAT_R8G8B8A8_SRGB,
@@ -1542,12 +1564,12 @@ private:
             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
         vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
+        memoryAllocator.free(stagingBufferAllocation);
     }
     */
 
     void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
-        VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+        VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& imageAllocation, bool transient = false) {
         VkImageCreateInfo imageInfo{};
         imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
         imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -1571,16 +1593,14 @@ private:
         VkMemoryRequirements memRequirements;
         vkGetImageMemoryRequirements(device, image, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-        vkCheckResult(
-            vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory),
-            "failed to allocate image memory");
+        if (transient) {
+            imageAllocation = memoryAllocator.allocateTransient(memRequirements, properties);
+        } else {
+            imageAllocation = memoryAllocator.allocate(memRequirements, properties,
+                tiling == VK_IMAGE_TILING_LINEAR ? MemoryAllocator::Kind::LINEAR : MemoryAllocator::Kind::OPTIMAL);
+        }
 
-        vkBindImageMemory(device, image, imageMemory, 0);
+        vkBindImageMemory(device, image, imageAllocation.memory, imageAllocation.offset);
     }
 
     void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
@@ -1724,15 +1744,33 @@ private:
     }
 
     void loadSceneGraph() {
-        JsonLoader sceneLoader(args.sceneFile);
+        SceneLoader::Parser parser = SceneLoader::Parser::PARALLEL;
 
-        std::cout << "LOADING JSON..." << std::endl << std::endl;
-        JsonLoader::JsonNode* sceneJson = sceneLoader.parseJson();
+        if (args.sceneParser == "dom") {
+            parser = SceneLoader::Parser::DOM;
+        } else if (args.sceneParser == "streaming") {
+            parser = SceneLoader::Parser::STREAMING;
+        }
 
-        sceneLoader.close();
+        sceneCachePath = SceneCache::getCachePath(args.sceneFile);
 
-        std::cout << "CONSTRUCTING SCENE..." << std::endl;
-        constructSceneFromJson(scene, sceneJson);
+        meshOptions.optimize = args.optimizeMeshes;
+        meshOptions.quantize = args.quantizeVertices;
+        meshOptions.lods = args.lodError.has_value();
+        meshOptions.meshlets = args.culling == "meshlet";
+
+        if (args.sceneCache == "on") {
+            meshesCached = SceneCache::load(sceneCachePath, scene, meshOptions, sceneCacheFile);
+        }
+
+        saveSceneCache = !meshesCached && args.sceneCache != "off";
+
+        if (meshesCached) {
+            std::cout << "LOADED SCENE FROM CACHE " << sceneCachePath << std::endl;
+        } else {
+            SceneLoader sceneLoader(args.sceneFile, parser);
+            sceneLoader.loadScene(scene);
+        }
 
         //scene.print();
         std::cout << std::endl << "SHOWING SCENE CAMERAS" << std::endl;
@@ -1755,226 +1793,212 @@ private:
             throw std::runtime_error("No camera named \"" + args.cameraName + "\" was found in the scene");
         }
 
-        for (Mesh& mesh : scene.meshes) {
-            loadVertices(mesh);
-            createVertexBuffer(mesh);
-            createIndexBuffer(mesh);
-            mesh.aabb = getAABB(mesh);
+        // every .b72 file is mapped once, however many meshes read from it
+        if (!meshesCached) {
+            for (const Mesh& mesh : scene.meshes) {
+                sourceFiles.addMesh(mesh);
+            }
         }
-    }
 
-    void constructSceneFromJson(Scene& scene, JsonLoader::JsonNode* json) {
-        if (json->type != JsonLoader::JsonNode::Type::ARRAY) {
-            throw std::runtime_error("The root of the scene json should be an array");
-        }
+        optimizerStats.resize(scene.meshes.size());
 
-        std::vector<JsonLoader::JsonNode*>& nodes = *std::get<std::vector<JsonLoader::JsonNode*>*>(json->value);
+        // the meshes are read and decoded on worker threads, and streamed by the frames drawn meanwhile as each one is ready
+        meshPipeline = std::make_unique<MeshPipeline>(scene.meshes.size(), [this](size_t i) {
+            // the cache already has the vertices, the indices, the AABB, the meshlets and the LODs
+            if (!meshesCached) {
+                MeshLoader::loadVertices(scene.meshes[i], sourceFiles);
 
-        for (JsonLoader::JsonNode* n : nodes) {
-            JsonLoader::JsonNode& node = *n;
+                // authored indices are used as they are, and stay in the file until they're uploaded
+                if (scene.meshes[i].mappedIndices == nullptr) {
+                    MeshIndexer::weldVertices(scene.meshes[i]);
+                }
 
-            if (node.type == JsonLoader::JsonNode::Type::STRING && std::get<std::string>(node.value) == "s72-v1") {
-                // This will be the first element of the array, ignore it
+                if (args.optimizeMeshes) {
+                    MeshLoader::copyMappedData(scene.meshes[i]);
+                    optimizerStats[i] = MeshOptimizer::optimize(scene.meshes[i]);
+                }
 
-                scene.typeIndices.push_back(std::numeric_limits<uint16_t>::max());
-            } else if (node.type == JsonLoader::JsonNode::Type::OBJECT) {
-                std::map<std::string, JsonLoader::JsonNode*>& obj = *std::get<std::map<std::string, JsonLoader::JsonNode*>*>(node.value);
+                scene.meshes[i].aabb = getAABB(scene.meshes[i]);
 
-                std::string sceneType = std::get<std::string>(obj["type"]->value);
+                // only drawn with --culling meshlet, and built before quantizing while the positions are still floats
+                if (args.culling == "meshlet") {
+                    MeshletBuilder::buildMeshlets(scene.meshes[i]);
+                }
 
-                if (sceneType == "SCENE") {
-                    scene.typeIndices.push_back(std::numeric_limits<uint16_t>::max());
+                // appended after the full mesh, so the meshlets above only cover that
+                if (args.lodError.has_value()) {
+                    MeshLoader::copyMappedData(scene.meshes[i]);
+                    MeshSimplifier::buildLods(scene.meshes[i]);
+                }
 
-                    std::vector<JsonLoader::JsonNode*>& roots = *std::get<std::vector<JsonLoader::JsonNode*>*>(obj["roots"]->value);
+                // needs the AABB, the positions are stored relative to it
+                if (args.quantizeVertices) {
+                    MeshLoader::copyMappedData(scene.meshes[i]);
+                    VertexQuantizer::quantize(scene.meshes[i]);
+                }
+            }
+        });
 
-                    for (JsonLoader::JsonNode* root : roots) {
-                        scene.roots.push_back(static_cast<uint16_t>(std::get<float>(root->value)));
-                    }
-                } else if (sceneType == "NODE") {
-                    scene.typeIndices.push_back(scene.nodes.size());
-                    scene.nodes.push_back({});
+        // the meshes are still in their files (or the cache), which stay mapped until they're streamed, or until the cache is written from them
+        releaseSourceFiles = !meshesCached && !saveSceneCache;
 
-                    scene.nodes.back().name = std::get<std::string>(obj["name"]->value);
+        // the meshes are copied in on the transfer queue while frames are drawn, see streamMeshes
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        meshUploads = std::make_unique<UploadBatcher>(physicalDevice, device, transferQueue, indices.transferFamily.value(),
+            transferCommandPool, indices.graphicsFamily.value(), memoryAllocator, timelineSemaphores);
 
-                    if (obj.count("translation") > 0) {
-                        scene.nodes.back().translation = parseVec3(obj["translation"]);
-                    } else {
-                        scene.nodes.back().translation = glm::vec3(0, 0, 0);
-                    }
+        meshUploadValues.assign(scene.meshes.size(), 0);
+    }
 
-                    if (obj.count("rotation") > 0) {
-                        scene.nodes.back().rotation = parseQuat(obj["rotation"]);
-                    } else {
-                        scene.nodes.back().rotation = glm::quat(1, 0, 0, 0);
-                    }
+    // stages the meshes the workers are done with, about a batch of them each frame, so a frame never waits on the workers or on more than one batch of copies
+    void streamMeshes() {
+        if (!meshPipeline) {
+            return;
+        }
 
-                    if (obj.count("scale") > 0) {
-                        scene.nodes.back().scale = parseVec3(obj["scale"]);
-                    } else {
-                        scene.nodes.back().scale = glm::vec3(1, 1, 1);
-                    }
+        VkDeviceSize stagedSize = 0;
+        size_t meshIndex;
 
-                    if (obj.count("children") > 0) {
-                        std::vector<JsonLoader::JsonNode*>& children = *std::get<std::vector<JsonLoader::JsonNode*>*>(obj["children"]->value);
+        while (stagedSize < UploadBatcher::BATCH_SIZE && meshPipeline->pollReadyMesh(meshIndex)) {
+            stagedSize += stageMesh(meshIndex);
+        }
 
-                        for (JsonLoader::JsonNode* node : children) {
-                            scene.nodes.back().children.push_back(static_cast<uint16_t>(std::get<float>(node->value)));
-                        }
-                    }
+        if (meshPipeline->isDone()) {
+            finishLoading();
+        }
 
-                    if (obj.count("camera") > 0) {
-                        scene.nodes.back().camera = static_cast<uint16_t>(std::get<float>(obj["camera"]->value));
-                    }
+        meshUploads->submit();
+    }
 
-                    if (obj.count("mesh") > 0) {
-                        scene.nodes.back().mesh = static_cast<uint16_t>(std::get<float>(obj["mesh"]->value));
-                    }
-                } else if (sceneType == "MESH") {
-                    scene.typeIndices.push_back(scene.meshes.size());
-                    scene.meshes.push_back({});
-
-                    scene.meshes.back().name = std::get<std::string>(obj["name"]->value);
-                    scene.meshes.back().topology = std::get<std::string>(obj["topology"]->value);
-                    scene.meshes.back().vertexCount = static_cast<uint32_t>(std::get<float>(obj["count"]->value));
-
-                    if (obj.count("indices") > 0) {
-                        std::map<std::string, JsonLoader::JsonNode*>& indices = *std::get<std::map<std::string, JsonLoader::JsonNode*>*>(obj["indices"]->value);
-
-                        scene.meshes.back().indicesData.src = std::get<std::string>(indices["src"]->value);
-                        scene.meshes.back().indicesData.offset = static_cast<uint32_t>(std::get<float>(indices["offset"]->value));
-                        scene.meshes.back().indicesData.format = std::get<std::string>(indices["format"]->value);
-                    } else {
-                        scene.meshes.back().indicesData = { "", 0, ""};
-                    }
+    // puts the mesh in a mesh buffer and copies it into the staging ring, returns how many bytes that was
+    VkDeviceSize stageMesh(size_t meshIndex) {
+        Mesh& mesh = scene.meshes[meshIndex];
 
-                    std::map<std::string, JsonLoader::JsonNode*>& attributes = *std::get<std::map<std::string, JsonLoader::JsonNode*>*>(obj["attributes"]->value);
-
-                    scene.meshes.back().attributes.resize(3);
-
-                    for (const std::pair<const std::string, JsonLoader::JsonNode*>& attr : attributes) {
-                        std::map<std::string, JsonLoader::JsonNode*>& attrVal = *std::get<std::map<std::string, JsonLoader::JsonNode*>*>(attr.second->value);
-
-                        Attribute a = {
-                            attr.first,
-                            std::get<std::string>(attrVal["src"]->value),
-                            static_cast<uint32_t>(std::get<float>(attrVal["offset"]->value)),
-                            static_cast<uint32_t>(std::get<float>(attrVal["stride"]->value)),
-                            std::get<std::string>(attrVal["format"]->value)
-                        };
-
-                        // hack to get attributes in the right order, should really sort by offset
-                        if (a.name == "POSITION") {
-                            scene.meshes.back().attributes[0] = a;
-                        } else if (a.name == "NORMAL") {
-                            scene.meshes.back().attributes[1] = a;
-                        } else if (a.name == "COLOR") {
-                            scene.meshes.back().attributes[2] = a;
-                        }
-                    }
+        if (!meshesCached && args.optimizeMeshes) {
+            const MeshOptimizer::Stats& stats = optimizerStats[meshIndex];
 
-                    // Assume that the src and stride for all attributes are the same
-                    scene.meshes.back().src = scene.meshes.back().attributes[0].src;
-                    scene.meshes.back().stride = scene.meshes.back().attributes[0].stride;
-                } else if (sceneType == "CAMERA") {
-                    scene.typeIndices.push_back(scene.cameras.size());
-                    scene.cameras.push_back({});
-
-                    scene.cameras.back().name = std::get<std::string>(obj["name"]->value);
-
-                    std::map<std::string, JsonLoader::JsonNode*>& perspective = *std::get<std::map<std::string, JsonLoader::JsonNode*>*>(obj["perspective"]->value);
-
-                    scene.cameras.back().aspect = std::get<float>(perspective["aspect"]->value);
-                    scene.cameras.back().vfov = std::get<float>(perspective["vfov"]->value);
-                    scene.cameras.back().near = std::get<float>(perspective["near"]->value);
-                    scene.cameras.back().far = std::get<float>(perspective["far"]->value);
-                } else if (sceneType == "DRIVER") {
-                    scene.typeIndices.push_back(scene.drivers.size());
-                    scene.drivers.push_back({});
-
-                    scene.drivers.back().name = std::get<std::string>(obj["name"]->value);
-                    scene.drivers.back().node = static_cast<uint16_t>(std::get<float>(obj["node"]->value));
-                    scene.drivers.back().channel = std::get<std::string>(obj["channel"]->value);
-
-                    if (obj.count("interpolation") > 0) {
-                        scene.drivers.back().interpolation = std::get<std::string>(obj["interpolation"]->value);
-                    } else {
-                        scene.drivers.back().interpolation = "LINEAR";
-                    }
+            std::cout << "Optimized mesh " << mesh.name << ": ACMR " << stats.acmrBefore << " -> " << stats.acmrAfter
+                << " (" << stats.clusterCount << " clusters)" << std::endl;
+        }
 
-                    std::vector<JsonLoader::JsonNode*>& times = *std::get<std::vector<JsonLoader::JsonNode*>*>(obj["times"]->value);
-                    for (JsonLoader::JsonNode* node : times) {
-                        scene.drivers.back().times.push_back(std::get<float>(node->value));
-                    }
+        if (!meshesCached && !mesh.lods.empty()) {
+            std::cout << "Simplified mesh " << mesh.name << ":";
 
-                    std::vector<JsonLoader::JsonNode*>& values = *std::get<std::vector<JsonLoader::JsonNode*>*>(obj["values"]->value);
-                    for (JsonLoader::JsonNode* node : values) {
-                        scene.drivers.back().values.push_back(std::get<float>(node->value));
-                    }
+            for (const MeshLod& lod : mesh.lods) {
+                std::cout << " " << lod.indexCount / 3 << " (" << lod.error << ")";
+            }
 
-                    scene.drivers.back().animIndex = scene.anims.size();
+            std::cout << " triangles (error)" << std::endl;
+        }
 
-                    // Also initialize the corresponding Animation objects
+        mesh.pipeline = getGraphicsPipeline(mesh.layout);
+        placeMesh(mesh);
 
-                    scene.anims.push_back({});
-                    scene.anims.back().curFrameIndex = std::numeric_limits<uint16_t>::max();
-                }
-            } else {
-                std::cout << "UNEXPECTED JSON TYPE!" << std::endl;
-            }
-        }
+        // copied into the staging ring here, so the files can be released straight away
+        uploadVertices(mesh, *meshUploads);
+        uploadIndices(mesh, *meshUploads);
 
-        // Fix the indices
+        if (releaseSourceFiles) {
+            mesh.mappedVertices = nullptr;
+            mesh.mappedIndices = nullptr;
 
-        for (size_t i = 0; i < scene.roots.size(); i++) {
-            scene.roots[i] = scene.typeIndices[scene.roots[i]];
+            sourceFiles.releaseMesh(mesh);
         }
 
-        for (Node& sceneNode : scene.nodes) {
-            for (size_t i = 0; i < sceneNode.children.size(); i++) {
-                sceneNode.children[i] = scene.typeIndices[sceneNode.children[i]];
-            }
+        meshUploadValues[meshIndex] = meshUploads->getReadyValue();
+        stagedMeshes.push_back(meshIndex);
 
-            if (sceneNode.camera.has_value()) {
-                sceneNode.camera = scene.typeIndices[sceneNode.camera.value()];
-            }
+        return static_cast<VkDeviceSize>(mesh.vertexDataCount) * mesh.layout.stride
+            + static_cast<VkDeviceSize>(mesh.indexCount) * MeshIndexer::getIndexSize(mesh.indexType);
+    }
+
+    // once every mesh is staged, the cache is written and nothing reads from the mapped files any more
+    void finishLoading() {
+        meshPipeline.reset();
 
-            if (sceneNode.mesh.has_value()) {
-                sceneNode.mesh = scene.typeIndices[sceneNode.mesh.value()];
+        // from the files the meshes were loaded from, which were kept mapped for it
+        if (saveSceneCache) {
+            SceneCache::save(sceneCachePath, args.sceneFile, scene, meshOptions);
+        }
+
+        for (Mesh& mesh : scene.meshes) {
+            if (!releaseSourceFiles && !meshesCached) {
+                sourceFiles.releaseMesh(mesh);
             }
+
+            mesh.mappedVertices = nullptr;
+            mesh.mappedIndices = nullptr;
         }
 
-        for (Driver& driver : scene.drivers) {
-            driver.node = scene.typeIndices[driver.node];
+        sceneCacheFile.close();
+
+        std::cout << "Streamed " << scene.meshes.size() << " meshes into " << scene.meshBuffers.size() << " mesh buffers and "
+            << graphicsPipelines.size() << " graphics pipelines, one per vertex layout" << std::endl;
+    }
+
+    // makes the meshes whose copies are done drawable, the frame's submit then waits on meshUploadWaitValue
+    void acquireMeshUploads(VkCommandBuffer commandBuffer) {
+        meshUploadWaitValue = 0;
+
+        if (!meshUploads) {
+            return;
         }
 
-        // Generate view mats for cameras
-        for (uint16_t root : scene.roots) {
-            Node rootNode = scene.nodes[root];
+        uint64_t completedValue = meshUploads->getCompletedValue();
+
+        if (completedValue > acquiredUploadValue) {
+            meshUploads->acquire(commandBuffer, completedValue);
+
+            acquiredUploadValue = completedValue;
+
+            // with fences the copies are known to be done before this is submitted, which is all the wait would have made sure of
+            if (meshUploads->getSemaphore() != VK_NULL_HANDLE) {
+                meshUploadWaitValue = completedValue;
+            }
+        }
 
-            generateCameraViewMatsInNode(scene.nodes[root], glm::mat4(1), scene);
+        // the values only go up in the order the meshes were staged
+        while (residentMeshCount < stagedMeshes.size() && meshUploadValues[stagedMeshes[residentMeshCount]] <= acquiredUploadValue) {
+            scene.meshes[stagedMeshes[residentMeshCount]].resident = true;
+            residentMeshCount++;
         }
     }
 
-    void generateCameraViewMatsInNode(const Node& node, glm::mat4 transform, Scene& scene) {
-        glm::mat4 scaleMat = glm::scale(glm::mat4(1.0), node.scale);
-        glm::mat4 rotMat = glm::toMat4(node.rotation);
-        glm::mat4 transMat = glm::translate(glm::mat4(1.0), node.translation);
+    // called after each submit, the batcher and its staging ring go once every mesh is resident
+    void finishMeshStreaming() {
+        if (!firstFrameSubmitted) {
+            firstFrameSubmitted = true;
 
-        transform *= transMat * rotMat * scaleMat;
+            std::cout << "First frame after " << getElapsedMilliseconds() << " ms, with "
+                << residentMeshCount << " of " << scene.meshes.size() << " meshes" << std::endl;
+        }
 
-        if (node.camera.has_value()) {
-            scene.cameras[node.camera.value()].viewMat = glm::inverse(transform);
+        if (!meshUploads || residentMeshCount < scene.meshes.size()) {
+            return;
         }
 
-        for (uint16_t child : node.children) {
-            Node childNode = scene.nodes[child];
+        // the frame just submitted may still be waiting on the batcher's semaphore
+        vkCheckResult(
+            vkQueueWaitIdle(graphicsQueue),
+            "failed to wait for the graphics queue");
+
+        meshUploads.reset();
+        memoryAllocator.resetTransient();
 
-            generateCameraViewMatsInNode(childNode, transform, scene);
+        std::cout << "All " << scene.meshes.size() << " meshes resident after " << getElapsedMilliseconds() << " ms" << std::endl;
+
+        // the mesh buffers are all there now
+        if (args.memoryStats) {
+            memoryAllocator.dump(std::cout);
         }
     }
 
+    float getElapsedMilliseconds() {
+        return std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - launchTime).count();
+    }
+
     void renderSceneGraph(VkCommandBuffer& commandBuffer, Scene& scene) {
-        for (uint16_t root : scene.roots) {
+        for (uint32_t root : scene.roots) {
             Node rootNode = scene.nodes[root];
 
             renderNode(commandBuffer, rootNode, glm::mat4(1), scene);
@@ -1988,7 +2012,8 @@ private:
 
         transform *= transMat * rotMat * scaleMat;
 
-        if (node.mesh.has_value()) {
+        // meshes that are still being copied in are left out
+        if (node.mesh.has_value() && scene.meshes[node.mesh.value()].resident) {
             const Mesh& mesh = scene.meshes[node.mesh.value()];
             const std::array<glm::vec3, 2>& aabb = mesh.aabb;
 
@@ -1999,193 +2024,211 @@ private:
             glm::vec3 pos(transform * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
 
             if (args.culling == "none" || frustumIntersectsAABB(frustum, center, halfExtent)) {
-                renderMesh(commandBuffer, mesh, transform);
+                uint32_t lod = selectLod(mesh, transform);
+                lodDraws[lod]++;
+
+                renderMesh(commandBuffer, mesh, transform, lod);
             }
         }
 
-        for (uint16_t child : node.children) {
+        for (uint32_t child : node.children) {
             Node childNode = scene.nodes[child];
 
             renderNode(commandBuffer, childNode, transform, scene);
         }
     }
 
-    void renderMesh(VkCommandBuffer& commandBuffer, const Mesh& mesh, glm::mat4 transform) {
-        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &transform);
+    // the coarsest LOD that's within args.lodError pixels of the full mesh, going by the size of its AABB on screen
+    uint32_t selectLod(const Mesh& mesh, const glm::mat4& transform) {
+        if (mesh.lods.empty()) {
+            return 0;
+        }
 
-        VkBuffer vertexBuffers[] = { mesh.vertexBuffer };
-        VkDeviceSize offsets[] = { 0 };
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+        const std::array<glm::vec3, 2>& aabb = mesh.aabb;
 
-        vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer, 0, VK_INDEX_TYPE_UINT16);
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
-            0, 1, &descriptorSets[currentFrame], 0, nullptr);
+        glm::vec3 center(transform * glm::vec4((aabb[0] + aabb[1]) * 0.5f, 1.0f));
+        float radius = glm::length(aabb[1] - aabb[0]) * 0.5f * getMaxScale(transform);
+        float distance = glm::length(center - cameraPosition);
 
-        vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(mesh.indices.size()), 1, 0, 0, 0);
-    }
+        if (distance <= radius) {
+            return 0;
+        }
 
-    glm::vec3 parseVec3(JsonLoader::JsonNode* node) {
-        std::vector<JsonLoader::JsonNode*>& components = *std::get<std::vector<JsonLoader::JsonNode*>*>(node->value);
+        // pixels across the AABB's bounding sphere
+        float screenSize = (2.0f * radius / distance) * pixelsPerRadian;
 
-        return glm::vec3(
-            std::get<float>(components[0]->value),
-            std::get<float>(components[1]->value),
-            std::get<float>(components[2]->value)
-        );
-    }
+        uint32_t lod = 0;
 
-    glm::vec4 parseVec4(JsonLoader::JsonNode* node) {
-        std::vector<JsonLoader::JsonNode*>& components = *std::get<std::vector<JsonLoader::JsonNode*>*>(node->value);
+        while (lod + 1 < mesh.lods.size() && mesh.lods[lod + 1].error * screenSize <= args.lodError.value()) {
+            lod++;
+        }
 
-        return glm::vec4(
-            std::get<float>(components[0]->value),
-            std::get<float>(components[1]->value),
-            std::get<float>(components[2]->value),
-            std::get<float>(components[3]->value)
-        );
+        return lod;
     }
 
-    glm::quat parseQuat(JsonLoader::JsonNode* node) {
-        std::vector<JsonLoader::JsonNode*>& components = *std::get<std::vector<JsonLoader::JsonNode*>*>(node->value);
-
-        return glm::quat(
-            std::get<float>(components[3]->value),
-            std::get<float>(components[0]->value),
-            std::get<float>(components[1]->value),
-            std::get<float>(components[2]->value)
-        );
+    // the longest axis of the transform, so a bounding sphere still holds everything under non uniform scale
+    float getMaxScale(const glm::mat4& transform) {
+        return std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
     }
 
-    void loadVertices(Mesh& mesh) {
-        // assume that all vertices for a model are in the same file
+    void renderMesh(VkCommandBuffer& commandBuffer, const Mesh& mesh, glm::mat4 transform, uint32_t lod) {
+        if (mesh.pipeline != boundPipeline) {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh.pipeline);
+            boundPipeline = mesh.pipeline;
+        }
 
-        mesh.vertices = {};
-        mesh.indices = {};
+        if (VertexQuantizer::isQuantized(mesh.layout)) {
+            std::array<glm::vec4, 2> dequantization = VertexQuantizer::getDequantization(mesh.aabb);
+            PushConstants pushConstants = { transform, dequantization[0], dequantization[1] };
 
-        std::ifstream vertexData;
-        vertexData.open(mesh.src, std::ios::binary | std::ios::in);
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants), &pushConstants);
+        } else {
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &transform);
+        }
 
-        // TODO: Maybe I should read directly into a byte array that I can then copy to the vertex buffer in one go
+        if (mesh.meshBuffer != boundMeshBuffer) {
+            const MeshBuffer& meshBuffer = scene.meshBuffers[mesh.meshBuffer];
 
-        for (uint32_t i = 0; i < mesh.vertexCount; i++) {
-            mesh.vertices.push_back({});
-            mesh.indices.push_back(static_cast<uint16_t>(i));
+            VkBuffer vertexBuffers[] = { meshBuffer.vertexBuffer };
+            VkDeviceSize offsets[] = { 0 };
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 
-            for (Attribute attr : mesh.attributes) {
-                std::size_t size = getFormatSize(attr.format);
+            vkCmdBindIndexBuffer(commandBuffer, meshBuffer.indexBuffer, 0, meshBuffer.indexType);
+            boundMeshBuffer = mesh.meshBuffer;
+        }
 
-                if (attr.name == "POSITION") {
-                    vertexData.read(reinterpret_cast<char*>(&mesh.vertices.back().pos), size);
-                }
-                else if (attr.name == "NORMAL") {
-                    vertexData.read(reinterpret_cast<char*>(&mesh.vertices.back().normal), size);
-                }
-                else if (attr.name == "COLOR") {
-                    uint32_t color;
+        // the meshlets are only of the full mesh
+        if (lod > 0 || args.culling != "meshlet" || mesh.meshlets.empty()) {
+            if (mesh.lods.empty()) {
+                vkCmdDrawIndexed(commandBuffer, mesh.indexCount, 1, mesh.firstIndex, mesh.vertexOffset, 0);
+            } else {
+                vkCmdDrawIndexed(commandBuffer, mesh.lods[lod].indexCount, 1, mesh.firstIndex + mesh.lods[lod].firstIndex, mesh.vertexOffset, 0);
+            }
 
-                    vertexData.read(reinterpret_cast<char*>(&color), size);
+            return;
+        }
 
-                    // the leftmost channel is alpha, so ignoring that since we're just doing rgb colors
-                    mesh.vertices.back().color.r = static_cast<float>((color >> 0) & 0xff) / 255.f;
-                    mesh.vertices.back().color.g = static_cast<float>((color >> 8) & 0xff) / 255.f;
-                    mesh.vertices.back().color.b = static_cast<float>((color >> 16) & 0xff) / 255.f;
-                }
-                else {
-                    std::cout << "Unexpected attribute name: " << attr.name << std::endl;
-                }
+        // the cone test is done in the mesh's own space, where the cones were built (a mirroring transform flips the winding, so it's skipped)
+        bool coneCulling = glm::determinant(glm::mat3(transform)) > 0.0f;
+        glm::vec3 localCamera(glm::affineInverse(transform) * glm::vec4(cameraPosition, 1.0f));
+
+        float scale = getMaxScale(transform);
+
+        // meshlets are contiguous in the index buffer, so runs of visible ones are drawn together
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+
+        for (const Meshlet& meshlet : mesh.meshlets) {
+            glm::vec3 center(transform * glm::vec4(meshlet.center, 1.0f));
+
+            bool visible = frustumIntersectsSphere(frustum, center, meshlet.radius * scale)
+                && !(coneCulling && MeshletBuilder::isBackFacing(meshlet, localCamera));
+
+            if (!visible) {
+                continue;
             }
-        }
 
-        vertexData.close();
-    }
+            if (indexCount > 0 && firstIndex + indexCount != meshlet.firstIndex) {
+                vkCmdDrawIndexed(commandBuffer, indexCount, 1, mesh.firstIndex + firstIndex, mesh.vertexOffset, 0);
+                indexCount = 0;
+            }
 
-    size_t getFormatSize(std::string format) {
-        if (format == "R32G32B32_SFLOAT") {
-            return 12;
-        }
-        else if (format == "R8G8B8A8_UNORM") {
-            return 4;
+            if (indexCount == 0) {
+                firstIndex = meshlet.firstIndex;
+            }
+
+            indexCount += meshlet.indexCount;
         }
-        else {
-            std::cout << "Unexpected input format: " << format << std::endl;
-            return 0;
+
+        if (indexCount > 0) {
+            vkCmdDrawIndexed(commandBuffer, indexCount, 1, mesh.firstIndex + firstIndex, mesh.vertexOffset, 0);
         }
     }
 
-    void createVertexBuffer(Mesh& mesh) {
-        VkDeviceSize bufferSize = sizeof(mesh.vertices[0]) * mesh.vertices.size();
+    // every mesh goes after the others with its vertex layout and index type, in the last MeshBuffer made for them,
+    // so meshes are placed as they're streamed without knowing how big the rest are. A full one is left for a new one.
+    void placeMesh(Mesh& mesh) {
+        auto found = openMeshBuffers.find({ mesh.layout, mesh.indexType });
 
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        createBuffer(bufferSize,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            stagingBuffer, stagingBufferMemory);
+        if (found == openMeshBuffers.end()
+            || uint64_t(scene.meshBuffers[found->second].vertexCount) + mesh.vertexDataCount > scene.meshBuffers[found->second].vertexCapacity
+            || uint64_t(scene.meshBuffers[found->second].indexCount) + mesh.indexCount > scene.meshBuffers[found->second].indexCapacity) {
+            VkDeviceSize indexSize = MeshIndexer::getIndexSize(mesh.indexType);
+            VkDeviceSize vertexBytes = MIN_MESH_BUFFER_SIZE;
+            VkDeviceSize indexBytes = MIN_MESH_BUFFER_SIZE;
 
-        void* data;
-        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, mesh.vertices.data(), (size_t)bufferSize);
-        vkUnmapMemory(device, stagingBufferMemory);
+            if (found != openMeshBuffers.end()) {
+                const MeshBuffer& full = scene.meshBuffers[found->second];
 
-        createBuffer(bufferSize,
-            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            mesh.vertexBuffer, mesh.vertexBufferMemory);
+                vertexBytes = std::min(2 * full.layout.stride * VkDeviceSize(full.vertexCapacity), MAX_MESH_BUFFER_SIZE);
+                indexBytes = std::min(2 * indexSize * full.indexCapacity, MAX_MESH_BUFFER_SIZE);
+            }
 
-        copyBuffer(stagingBuffer, mesh.vertexBuffer, bufferSize);
+            MeshBuffer meshBuffer;
+            meshBuffer.layout = mesh.layout;
+            meshBuffer.indexType = mesh.indexType;
 
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
-    }
+            // firstIndex and vertexOffset have to fit in a draw
+            meshBuffer.vertexCapacity = static_cast<uint32_t>(std::min<VkDeviceSize>(std::max<VkDeviceSize>(vertexBytes / mesh.layout.stride, mesh.vertexDataCount), INT32_MAX));
+            meshBuffer.indexCapacity = static_cast<uint32_t>(std::min<VkDeviceSize>(std::max<VkDeviceSize>(indexBytes / indexSize, mesh.indexCount), UINT32_MAX));
 
-    void createIndexBuffer(Mesh& mesh) {
-        VkDeviceSize bufferSize = sizeof(mesh.indices[0]) * mesh.indices.size();
+            createBuffer(static_cast<VkDeviceSize>(meshBuffer.layout.stride) * meshBuffer.vertexCapacity,
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                meshUploads->getDestinationProperties(),
+                meshBuffer.vertexBuffer, meshBuffer.vertexAllocation);
 
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        createBuffer(bufferSize,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            stagingBuffer, stagingBufferMemory);
+            createBuffer(indexSize * meshBuffer.indexCapacity,
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                meshUploads->getDestinationProperties(),
+                meshBuffer.indexBuffer, meshBuffer.indexAllocation);
 
-        void* data;
-        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, mesh.indices.data(), (size_t)bufferSize);
-        vkUnmapMemory(device, stagingBufferMemory);
+            scene.meshBuffers.push_back(meshBuffer);
+            found = openMeshBuffers.insert_or_assign({ mesh.layout, mesh.indexType }, static_cast<uint32_t>(scene.meshBuffers.size() - 1)).first;
+        }
 
-        createBuffer(bufferSize,
-            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            mesh.indexBuffer, mesh.indexBufferMemory);
+        MeshBuffer& meshBuffer = scene.meshBuffers[found->second];
 
-        copyBuffer(stagingBuffer, mesh.indexBuffer, bufferSize);
+        mesh.meshBuffer = found->second;
+        mesh.firstIndex = meshBuffer.indexCount;
+        mesh.vertexOffset = static_cast<int32_t>(meshBuffer.vertexCount);
 
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
+        meshBuffer.vertexCount += mesh.vertexDataCount;
+        meshBuffer.indexCount += mesh.indexCount;
     }
 
-    std::array<glm::vec3, 2> getAABB(const Mesh& mesh) {
-        if (mesh.name == "Ground") {
-            std::cout << std::endl << "GETTING AABB FOR " << mesh.name << std::endl;
-        }
+    void uploadVertices(const Mesh& mesh, UploadBatcher& uploads) {
+        const MeshBuffer& meshBuffer = scene.meshBuffers[mesh.meshBuffer];
+        VkDeviceSize bufferOffset = static_cast<VkDeviceSize>(mesh.layout.stride) * static_cast<uint32_t>(mesh.vertexOffset);
+        VkDeviceSize uploadSize = static_cast<VkDeviceSize>(mesh.layout.stride) * mesh.vertexDataCount;
 
-        std::array<glm::vec3, 2> aabb;
+        // native records go straight from the mapped file into the staging ring
+        uploads.upload(meshBuffer.vertexBuffer, meshBuffer.vertexAllocation, bufferOffset, uploadSize, mesh.getVertexData());
+    }
 
-        aabb[0] = glm::vec3(std::numeric_limits<float>::max());
-        aabb[1] = glm::vec3(std::numeric_limits<float>::min());
+    void uploadIndices(const Mesh& mesh, UploadBatcher& uploads) {
+        const MeshBuffer& meshBuffer = scene.meshBuffers[mesh.meshBuffer];
+        size_t indexSize = MeshIndexer::getIndexSize(mesh.indexType);
+        VkDeviceSize bufferOffset = static_cast<VkDeviceSize>(indexSize) * mesh.firstIndex;
+        VkDeviceSize uploadSize = static_cast<VkDeviceSize>(indexSize) * mesh.indexCount;
 
-        for (const Vertex& vert : mesh.vertices) {
-            // min vertex
-            aabb[0].x = std::min(aabb[0].x, vert.pos.x);
-            aabb[0].y = std::min(aabb[0].y, vert.pos.y);
-            aabb[0].z = std::min(aabb[0].z, vert.pos.z);
+        // authored indices go straight from the mapped file into the staging ring
+        if (mesh.mappedIndices != nullptr) {
+            uploads.upload(meshBuffer.indexBuffer, meshBuffer.indexAllocation, bufferOffset, uploadSize, mesh.mappedIndices);
+        } else {
+            uploads.upload(meshBuffer.indexBuffer, meshBuffer.indexAllocation, bufferOffset, uploadSize, [&](char* dst, VkDeviceSize offset, VkDeviceSize size) {
+                MeshIndexer::packIndices(mesh.indices.data() + offset / indexSize, static_cast<size_t>(size / indexSize), mesh.indexType, dst);
+            });
+        }
+    }
 
-            // max vertex
-            aabb[1].x = std::max(aabb[1].x, vert.pos.x);
-            aabb[1].y = std::max(aabb[1].y, vert.pos.y);
-            aabb[1].z = std::max(aabb[1].z, vert.pos.z);
+    std::array<glm::vec3, 2> getAABB(const Mesh& mesh) {
+        if (mesh.name == "Ground") {
+            std::cout << std::endl << "GETTING AABB FOR " << mesh.name << std::endl;
         }
 
+        std::array<glm::vec3, 2> aabb = VertexKernels::computeAABB(VertexKernels::getKernel(),
+            mesh.getVertexData() + mesh.layout.offsets[0], mesh.layout.stride, mesh.vertexDataCount);
+
         if (mesh.name == "Ground") {
             std::cout << "AABB min: " << glm::to_string(aabb[0]) << std::endl;
             std::cout << "AABB max: " << glm::to_string(aabb[1]) << std::endl;
@@ -2195,7 +2238,7 @@ private:
         return aabb;
     }
 
-    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, MemoryAllocation& bufferAllocation) {
         VkBufferCreateInfo bufferInfo{};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
         bufferInfo.size = size;
@@ -2210,41 +2253,9 @@ private:
         VkMemoryRequirements memRequirements;
         vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+        bufferAllocation = memoryAllocator.allocate(memRequirements, properties, MemoryAllocator::Kind::LINEAR);
 
-        vkCheckResult(
-            vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory),
-            "failed to allocate buffer memory");
-
-        vkBindBufferMemory(device, buffer, bufferMemory, 0);
-    }
-
-    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-        VkPhysicalDeviceMemoryProperties memProperties;
-        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-            if (typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-                return i;
-            }
-        }
-
-        throw std::runtime_error("failed to find available memory type!");
-    }
-
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-        VkBufferCopy copyRegion{};
-        copyRegion.srcOffset = 0;
-        copyRegion.dstOffset = 0;
-        copyRegion.size = size;
-        vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-        endSingleTimeCommands(commandBuffer);
+        vkBindBufferMemory(device, buffer, bufferAllocation.memory, bufferAllocation.offset);
     }
 
     VkCommandBuffer beginSingleTimeCommands() {
@@ -2284,15 +2295,15 @@ private:
         VkDeviceSize bufferSize = sizeof(UniformBufferObject);
 
         uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-        uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+        uniformBuffersAllocations.resize(MAX_FRAMES_IN_FLIGHT);
         uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
 
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
             createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                uniformBuffers[i], uniformBuffersMemory[i]);
+                uniformBuffers[i], uniformBuffersAllocations[i]);
 
-            vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
+            uniformBuffersMapped[i] = uniformBuffersAllocations[i].mapped;
         }
     }
 
@@ -2455,12 +2466,12 @@ private:
         const char* imagedata;
 
         VkImage dstImage;
-        VkDeviceMemory dstImageMemory;
+        MemoryAllocation dstImageAllocation;
 
         createImage(swapChainExtent.width, swapChainExtent.height, swapChainImageFormat,
                     VK_IMAGE_TILING_LINEAR, VK_IMAGE_USAGE_TRANSFER_DST_BIT,
                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                    dstImage, dstImageMemory);
+                    dstImage, dstImageAllocation, true);
 
         VkCommandBuffer commandBuffer = beginSingleTimeCommands();
 
@@ -2529,8 +2540,7 @@ private:
 
         vkGetImageSubresourceLayout(device, dstImage, &subResource, &subResourceLayout);
 
-        vkMapMemory(device, dstImageMemory, 0, VK_WHOLE_SIZE, 0, (void**)&imagedata);
-        imagedata += subResourceLayout.offset;
+        imagedata = dstImageAllocation.mapped + subResourceLayout.offset;
 
         std::ofstream file(filename, std::ios::out | std::ios::binary);
 
@@ -2557,9 +2567,8 @@ private:
         }
         file.close();
 
-        vkUnmapMemory(device, dstImageMemory);
-		vkFreeMemory(device, dstImageMemory, nullptr);
 		vkDestroyImage(device, dstImage, nullptr);
+        memoryAllocator.resetTransient();
     }
 
     void animate(std::chrono::high_resolution_clock::time_point curTime) {
@@ -2685,15 +2694,34 @@ private:
         vkResetCommandBuffer(commandBuffers[currentFrame], 0);
         recordCommandBuffer(commandBuffers[currentFrame], headlessImageIndex);
 
+        VkSemaphore waitSemaphores[] = { meshUploads ? meshUploads->getSemaphore() : VK_NULL_HANDLE };
+        VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT };
+        uint64_t waitValues[] = { meshUploadWaitValue };
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = 1;
+        timelineInfo.pWaitSemaphoreValues = waitValues;
+
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
         submitInfo.commandBufferCount = 1;
         submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
 
+        // only if the frame acquired new meshes
+        if (meshUploadWaitValue > 0) {
+            submitInfo.pNext = &timelineInfo;
+            submitInfo.waitSemaphoreCount = 1;
+            submitInfo.pWaitSemaphores = waitSemaphores;
+            submitInfo.pWaitDstStageMask = waitStages;
+        }
+
         vkCheckResult(
             vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]),
             "failed to submit draw command buffer");
 
+        finishMeshStreaming();
+
         currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
     }
 
@@ -2716,16 +2744,28 @@ private:
         // Only reset the fence if we are submitting work
         vkResetFences(device, 1, &inFlightFences[currentFrame]);
 
+        // the next batch of meshes is copied while this frame is drawn
+        streamMeshes();
+
         vkResetCommandBuffer(commandBuffers[currentFrame], 0);
         recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
 
-        VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
-        VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+        // the second one only if the frame acquired new meshes, the binary semaphore's value is ignored
+        VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame], meshUploads ? meshUploads->getSemaphore() : VK_NULL_HANDLE };
+        VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT };
+        uint64_t waitValues[] = { 0, meshUploadWaitValue };
+        uint32_t waitSemaphoreCount = meshUploadWaitValue > 0 ? 2 : 1;
         VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
 
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = waitSemaphoreCount;
+        timelineInfo.pWaitSemaphoreValues = waitValues;
+
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.waitSemaphoreCount = waitSemaphoreCount;
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
         submitInfo.commandBufferCount = 1;
@@ -2737,6 +2777,8 @@ private:
             vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]),
             "failed to submit draw command buffer");
 
+        finishMeshStreaming();
+
         VkSwapchainKHR swapChains[] = { swapChain };
 
         VkPresentInfoKHR presentInfo{};
@@ -2830,6 +2872,8 @@ private:
         glm::vec3 up = glm::vec3(viewInverse[1]);
         glm::vec3 forward = -glm::vec3(viewInverse[2]);
         glm::vec3 eye = glm::vec3(viewInverse[3]);
+        cameraPosition = eye;
+        pixelsPerRadian = swapChainExtent.height / (2.0f * tanf(cam.vfov * 0.5f));
         float near = cam.near;
         float far = cam.far;
         float half_v = far * tanf(cam.vfov * 0.5f);
@@ -2885,6 +2929,16 @@ private:
         return true;
     }
 
+    bool frustumIntersectsSphere(const Frustum& frustum, const glm::vec3& center, float radius) {
+        for (const glm::vec4& plane : { frustum.nearPlane, frustum.farPlane, frustum.leftPlane, frustum.rightPlane, frustum.topPlane, frustum.bottomPlane }) {
+            if (getSignedDistanceToPlane(plane, center) < -radius) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
     void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
         VkCommandBufferBeginInfo beginInfo{};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -2895,6 +2949,9 @@ private:
             vkBeginCommandBuffer(commandBuffer, &beginInfo),
             "failed to begin recording command buffer");
 
+        // outside the render pass, the barriers that hand the copied meshes over to this queue
+        acquireMeshUploads(commandBuffer);
+
         VkRenderPassBeginInfo renderPassInfo{};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
         renderPassInfo.renderPass = renderPass;
@@ -2911,7 +2968,10 @@ private:
 
         vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+        // renderMesh binds the pipeline for each mesh's vertex layout, and its mesh buffer
+        boundPipeline = VK_NULL_HANDLE;
+        boundMeshBuffer = UINT32_MAX;
+        lodDraws.fill(0);
 
         VkViewport viewport{};
         viewport.x = 0;
@@ -2927,8 +2987,22 @@ private:
         scissor.extent = swapChainExtent;
         vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
+        // every pipeline has the same layout, so this stays bound whichever one is
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+            0, 1, &descriptorSets[currentFrame], 0, nullptr);
+
         renderSceneGraph(commandBuffer, scene);
 
+        if (args.lodStats) {
+            std::cout << "LOD draws:";
+
+            for (uint32_t draws : lodDraws) {
+                std::cout << " " << draws;
+            }
+
+            std::cout << std::endl;
+        }
+
         vkCmdEndRenderPass(commandBuffer);
 
         vkCheckResult(
@@ -2956,7 +3030,7 @@ private:
     void cleanupSwapChain() {
         vkDestroyImageView(device, depthImageView, nullptr);
         vkDestroyImage(device, depthImage, nullptr);
-        vkFreeMemory(device, depthImageMemory, nullptr);
+        memoryAllocator.free(depthImageAllocation);
 
         for (VkFramebuffer framebuffer : swapChainFramebuffers) {
             vkDestroyFramebuffer(device, framebuffer, nullptr);
@@ -2972,7 +3046,7 @@ private:
     void cleanupHeadlessSwapChain() {
         vkDestroyImageView(device, depthImageView, nullptr);
         vkDestroyImage(device, depthImage, nullptr);
-        vkFreeMemory(device, depthImageMemory, nullptr);
+        memoryAllocator.free(depthImageAllocation);
 
         for (VkFramebuffer framebuffer : swapChainFramebuffers) {
             vkDestroyFramebuffer(device, framebuffer, nullptr);
@@ -2986,8 +3060,8 @@ private:
             vkDestroyImage(device, image, nullptr);
         }
 
-        for (VkDeviceMemory imageMemory : swapChainImagesMemory) {
-            vkFreeMemory(device, imageMemory, nullptr);
+        for (MemoryAllocation& imageAllocation : swapChainImagesAllocations) {
+            memoryAllocator.free(imageAllocation);
         }
     }
 
@@ -3002,14 +3076,17 @@ private:
         //vkDestroyImageView(device, textureImageView, nullptr);
 
         //vkDestroyImage(device, textureImage, nullptr);
-        //vkFreeMemory(device, textureImageMemory, nullptr);
+        //memoryAllocator.free(textureImageAllocation);
 
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
             vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-            vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
+            memoryAllocator.free(uniformBuffersAllocations[i]);
+        }
+
+        for (const auto& pipeline : graphicsPipelines) {
+            vkDestroyPipeline(device, pipeline.second, nullptr);
         }
 
-        vkDestroyPipeline(device, graphicsPipeline, nullptr);
         vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 
         vkDestroyDescriptorPool(device, descriptorPool, nullptr);
@@ -3024,11 +3101,17 @@ private:
 
         vkDestroyRenderPass(device, renderPass, nullptr);
 
-        for (Mesh& mesh : scene.meshes) {
-            mesh.cleanupBuffers(device);
+        // still here if the window was closed before every mesh was resident
+        meshPipeline.reset();
+        meshUploads.reset();
+
+        for (MeshBuffer& meshBuffer : scene.meshBuffers) {
+            meshBuffer.cleanup(device, memoryAllocator);
         }
 
+        vkDestroyCommandPool(device, transferCommandPool, nullptr);
         vkDestroyCommandPool(device, commandPool, nullptr);
+        memoryAllocator.destroy();
         vkDestroyDevice(device, nullptr);
 
         if (!args.headless) {
@@ -0,0 +1,39 @@
+#version 450
+
+// shader.vert for meshes packed by VertexQuantizer
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+layout(push_constant, std430) uniform PushConstant {
+    mat4 model;
+    vec4 positionMin;    // min corner of the mesh's AABB
+    vec4 positionExtent; // max - min
+} pc;
+
+layout(location = 0) in vec4 inPosition; // unorm16, 0-1 across the AABB
+layout(location = 1) in vec2 inNormal;   // snorm16, octahedral
+layout(location = 2) in vec3 inColor;
+
+layout(location = 0) out vec3 fragNormal;
+layout(location = 1) out vec3 fragColor;
+
+vec3 decodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+
+    return normalize(n);
+}
+
+void main() {
+    vec3 position = pc.positionMin.xyz + inPosition.xyz * pc.positionExtent.xyz;
+
+    gl_Position = ubo.proj * ubo.view * pc.model * vec4(position, 1.0);
+    fragNormal = normalize(vec3(ubo.view * pc.model * vec4(decodeOctahedral(inNormal), 0.0))); // this will only apply the rotation of the modelview matrix to the normal
+    fragColor = inColor;
+}
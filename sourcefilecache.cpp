@@ -0,0 +1,103 @@
+#include "sourcefilecache.h"
+
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+template<typename F>
+void SourceFileCache::forEachMeshFile(const Mesh& mesh, F f) {
+    // a mesh counts once per file, however many of its attributes and indices read from it
+    std::vector<const std::string*> seen;
+
+    auto visit = [&](const std::string& src) {
+        if (src == "") {
+            return;
+        }
+
+        const std::string& path = getCanonicalPath(src);
+
+        for (const std::string* other : seen) {
+            if (*other == path) {
+                return;
+            }
+        }
+
+        seen.push_back(&path);
+        f(path);
+    };
+
+    for (const Attribute& attr : mesh.attributes) {
+        visit(attr.src);
+    }
+
+    visit(mesh.indicesData.src);
+}
+
+void SourceFileCache::addMesh(const Mesh& mesh) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    forEachMeshFile(mesh, [this](const std::string& path) {
+        files[path].users++;
+    });
+}
+
+const MappedFile& SourceFileCache::acquire(const std::string& path) {
+    // mapping a file is quick, so it's fine to hold the lock while doing it
+    std::lock_guard<std::mutex> lock(mutex);
+
+    SourceFile& source = files[getCanonicalPath(path)];
+
+    if (!source.file.isOpen() && !source.file.open(path)) {
+        throw std::runtime_error("Failed to open vertex file: " + path);
+    }
+
+    return source.file;
+}
+
+void SourceFileCache::releaseMesh(const Mesh& mesh) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    forEachMeshFile(mesh, [this](const std::string& path) {
+        auto found = files.find(path);
+
+        if (found == files.end()) {
+            return;
+        }
+
+        if (found->second.users > 0) {
+            found->second.users--;
+        }
+
+        if (found->second.users == 0) {
+            files.erase(found);
+        }
+    });
+}
+
+size_t SourceFileCache::getMappedFileCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    size_t count = 0;
+
+    for (const auto& file : files) {
+        if (file.second.file.isOpen()) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+const std::string& SourceFileCache::getCanonicalPath(const std::string& path) {
+    auto found = canonicalPaths.find(path);
+
+    if (found != canonicalPaths.end()) {
+        return found->second;
+    }
+
+    // weakly_canonical doesn't need the file to exist, opening it reports that properly
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+
+    return canonicalPaths.emplace(path, error ? path : canonical.string()).first->second;
+}
@@ -0,0 +1,50 @@
+#ifndef _SOURCE_FILE_CACHE_H
+#define _SOURCE_FILE_CACHE_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "mappedfile.h"
+#include "scene.h"
+
+// The .b72 files of one scene load. Many meshes can read from the same file at
+// different offsets, so each file is mapped once, keyed by its canonical path, and
+// every attribute reads straight out of that mapping. A file stays mapped until the
+// last mesh that reads from it has been released. Meshes can be loaded from several
+// threads at once.
+class SourceFileCache {
+public:
+
+    // counts the mesh as a user of each of its files, call for every mesh before loading any of them
+    void addMesh(const Mesh& mesh);
+
+    // maps the file on first use, throws if it can't be opened
+    const MappedFile& acquire(const std::string& path);
+
+    // call once the mesh has been uploaded, unmaps the files nothing else reads from
+    void releaseMesh(const Mesh& mesh);
+
+    size_t getMappedFileCount();
+
+private:
+
+    struct SourceFile {
+        MappedFile file;
+        uint32_t users = 0;
+    };
+
+    std::mutex mutex;
+
+    std::unordered_map<std::string, SourceFile> files;
+    // src as written in the scene -> canonical path, so each src is only resolved once
+    std::unordered_map<std::string, std::string> canonicalPaths;
+
+    const std::string& getCanonicalPath(const std::string& path);
+
+    template<typename F>
+    void forEachMeshFile(const Mesh& mesh, F f);
+};
+
+#endif // _SOURCE_FILE_CACHE_H
@@ -0,0 +1,412 @@
+#include "uploadbatcher.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <vulkan/vk_enum_string_helper.h>
+
+namespace {
+
+// the most staged in one go, a bigger upload is split so it can't need the whole ring
+const VkDeviceSize MAX_CHUNK_SIZE = UploadBatcher::RING_SIZE / 4;
+
+// of every staged copy, enough for any texel block or index
+const VkDeviceSize COPY_ALIGNMENT = 16;
+
+void checkResult(VkResult result, const std::string& errorMsg) {
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error(errorMsg + std::string(string_VkResult(result)) + " [" + std::to_string(result) + "]");
+    }
+}
+
+} // namespace
+
+UploadBatcher::UploadBatcher(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamily, VkCommandPool commandPool,
+    uint32_t dstQueueFamily, MemoryAllocator& allocator, bool timelineSemaphores)
+    : device(device), queue(queue), queueFamily(queueFamily), commandPool(commandPool), dstQueueFamily(dstQueueFamily) {
+    // without one every batch gets a fence, see submit
+    if (timelineSemaphores) {
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+
+        checkResult(
+            vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore),
+            "failed to create upload semaphore");
+    }
+
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+    // the biggest device local heap, if it can be written from the host everything goes straight into it
+    uint32_t mainHeap = 0;
+    VkDeviceSize mainHeapSize = 0;
+
+    for (uint32_t i = 0; i < memProperties.memoryHeapCount; i++) {
+        if ((memProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && memProperties.memoryHeaps[i].size > mainHeapSize) {
+            mainHeap = i;
+            mainHeapSize = memProperties.memoryHeaps[i].size;
+        }
+    }
+
+    VkMemoryPropertyFlags directProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+        if (memProperties.memoryTypes[i].heapIndex == mainHeap && (memProperties.memoryTypes[i].propertyFlags & directProperties) == directProperties) {
+            direct = true;
+        }
+    }
+
+    if (direct) {
+        return;
+    }
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = RING_SIZE;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    checkResult(
+        vkCreateBuffer(device, &bufferInfo, nullptr, &ringBuffer),
+        "failed to create staging ring buffer");
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, ringBuffer, &memRequirements);
+
+    MemoryAllocation ringAllocation = allocator.allocateTransient(memRequirements,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    vkBindBufferMemory(device, ringBuffer, ringAllocation.memory, ringAllocation.offset);
+
+    ringData = ringAllocation.mapped;
+}
+
+UploadBatcher::~UploadBatcher() {
+    // the ring can't go while a batch still reads from it
+    if (!inFlight.empty() && semaphore != VK_NULL_HANDLE) {
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &semaphore;
+        waitInfo.pValues = &submittedValue;
+
+        vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+    } else if (!inFlight.empty()) {
+        std::vector<VkFence> fences;
+
+        for (const Batch& batch : inFlight) {
+            fences.push_back(batch.fence);
+        }
+
+        vkWaitForFences(device, static_cast<uint32_t>(fences.size()), fences.data(), VK_TRUE, UINT64_MAX);
+    }
+
+    freeBatches.insert(freeBatches.end(), inFlight.begin(), inFlight.end());
+
+    for (const Batch& batch : freeBatches) {
+        vkFreeCommandBuffers(device, commandPool, 1, &batch.commandBuffer);
+        vkDestroyFence(device, batch.fence, nullptr);
+    }
+
+    vkDestroySemaphore(device, semaphore, nullptr);
+
+    if (ringBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, ringBuffer, nullptr);
+    }
+}
+
+VkMemoryPropertyFlags UploadBatcher::getDestinationProperties() const {
+    if (direct) {
+        return VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    }
+
+    return VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+}
+
+void UploadBatcher::upload(VkBuffer dst, const MemoryAllocation& dstAllocation, VkDeviceSize dstOffset, VkDeviceSize size, const Writer& write) {
+    if (size == 0) {
+        return;
+    }
+
+    // host visible memory stays mapped for as long as it's allocated
+    if (direct) {
+        write(dstAllocation.mapped + dstOffset, 0, size);
+        return;
+    }
+
+    for (VkDeviceSize offset = 0; offset < size; offset += MAX_CHUNK_SIZE) {
+        VkDeviceSize chunkSize = std::min(MAX_CHUNK_SIZE, size - offset);
+        VkDeviceSize position = allocate(chunkSize);
+
+        write(ringData + position % RING_SIZE, offset, chunkSize);
+
+        copies.push_back({ dst, { position % RING_SIZE, dstOffset + offset, chunkSize } });
+        batchBytes += chunkSize;
+
+        if (batchBytes >= BATCH_SIZE) {
+            submit();
+        }
+    }
+}
+
+void UploadBatcher::upload(VkBuffer dst, const MemoryAllocation& dstAllocation, VkDeviceSize dstOffset, VkDeviceSize size, const void* src) {
+    upload(dst, dstAllocation, dstOffset, size, [src](char* out, VkDeviceSize offset, VkDeviceSize count) {
+        std::memcpy(out, static_cast<const char*>(src) + offset, static_cast<size_t>(count));
+    });
+}
+
+uint64_t UploadBatcher::getReadyValue() const {
+    // direct uploads are in place as soon as they're written
+    return copies.empty() ? submittedValue : submittedValue + 1;
+}
+
+VkSemaphore UploadBatcher::getSemaphore() const {
+    return semaphore;
+}
+
+uint64_t UploadBatcher::getCompletedValue() {
+    // a fence only says its own batch is done, so they're looked at in order
+    if (semaphore == VK_NULL_HANDLE) {
+        while (!inFlight.empty() && vkGetFenceStatus(device, inFlight.front().fence) == VK_SUCCESS) {
+            retireOldest();
+        }
+
+        return retiredValue;
+    }
+
+    uint64_t value;
+
+    checkResult(
+        vkGetSemaphoreCounterValue(device, semaphore, &value),
+        "failed to get upload semaphore value");
+
+    while (!inFlight.empty() && inFlight.front().value <= value) {
+        retireOldest();
+    }
+
+    return value;
+}
+
+void UploadBatcher::acquire(VkCommandBuffer commandBuffer, uint64_t value) {
+    std::vector<VkBufferMemoryBarrier> barriers;
+
+    while (!releases.empty() && releases.front().value <= value) {
+        const Release& release = releases.front();
+
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+        barrier.srcQueueFamilyIndex = queueFamily;
+        barrier.dstQueueFamilyIndex = dstQueueFamily;
+        barrier.buffer = release.buffer;
+        barrier.offset = release.offset;
+        barrier.size = release.size;
+
+        barriers.push_back(barrier);
+        releases.pop_front();
+    }
+
+    if (!barriers.empty()) {
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+            0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+    }
+}
+
+void UploadBatcher::flush() {
+    submit();
+
+    while (!inFlight.empty()) {
+        retireOldest();
+    }
+}
+
+// returns the ring position of size free bytes, in one piece
+VkDeviceSize UploadBatcher::allocate(VkDeviceSize size) {
+    VkDeviceSize position = (head + COPY_ALIGNMENT - 1) / COPY_ALIGNMENT * COPY_ALIGNMENT;
+
+    // a copy can't wrap, so the rest of the ring is skipped
+    if (position % RING_SIZE + size > RING_SIZE) {
+        position += RING_SIZE - position % RING_SIZE;
+    }
+
+    while (position + size - tail > RING_SIZE) {
+        // the batch being recorded is the only thing left in the way
+        if (inFlight.empty()) {
+            submit();
+        }
+
+        retireOldest();
+    }
+
+    head = position + size;
+
+    return position;
+}
+
+void UploadBatcher::submit() {
+    if (copies.empty()) {
+        return;
+    }
+
+    Batch batch;
+
+    if (!freeBatches.empty()) {
+        batch = freeBatches.back();
+        freeBatches.pop_back();
+
+        if (batch.fence != VK_NULL_HANDLE) {
+            vkResetFences(device, 1, &batch.fence);
+        }
+
+        vkResetCommandBuffer(batch.commandBuffer, 0);
+    } else {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = 1;
+
+        checkResult(
+            vkAllocateCommandBuffers(device, &allocInfo, &batch.commandBuffer),
+            "failed to allocate upload command buffer");
+
+        if (semaphore == VK_NULL_HANDLE) {
+            VkFenceCreateInfo fenceInfo{};
+            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+            checkResult(
+                vkCreateFence(device, &fenceInfo, nullptr, &batch.fence),
+                "failed to create upload fence");
+        }
+    }
+
+    batch.value = submittedValue + 1;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(batch.commandBuffer, &beginInfo);
+
+    // one command per destination buffer, with all of its regions (uploads never overlap, so the order doesn't matter)
+    std::stable_sort(copies.begin(), copies.end(), [](const Copy& a, const Copy& b) {
+        return a.dst < b.dst;
+    });
+
+    std::vector<VkBufferCopy> regions;
+
+    for (size_t i = 0; i < copies.size(); i++) {
+        regions.push_back(copies[i].region);
+
+        if (i + 1 == copies.size() || copies[i + 1].dst != copies[i].dst) {
+            vkCmdCopyBuffer(batch.commandBuffer, ringBuffer, copies[i].dst, static_cast<uint32_t>(regions.size()), regions.data());
+            regions.clear();
+        }
+    }
+
+    if (queueFamily != dstQueueFamily) {
+        // what was written goes over to dstQueueFamily, the regions each upload was split into as one range
+        std::vector<VkBufferMemoryBarrier> barriers;
+
+        for (const Copy& copy : copies) {
+            if (!barriers.empty() && barriers.back().buffer == copy.dst && barriers.back().offset + barriers.back().size == copy.region.dstOffset) {
+                barriers.back().size += copy.region.size;
+                continue;
+            }
+
+            VkBufferMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+            barrier.srcQueueFamilyIndex = queueFamily;
+            barrier.dstQueueFamilyIndex = dstQueueFamily;
+            barrier.buffer = copy.dst;
+            barrier.offset = copy.region.dstOffset;
+            barrier.size = copy.region.size;
+
+            barriers.push_back(barrier);
+        }
+
+        vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+
+        for (const VkBufferMemoryBarrier& barrier : barriers) {
+            releases.push_back({ batch.value, barrier.buffer, barrier.offset, barrier.size });
+        }
+    } else {
+        // anything drawn after this on the queue sees the copies
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+
+        vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+            1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    checkResult(
+        vkEndCommandBuffer(batch.commandBuffer),
+        "failed to record upload command buffer");
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &batch.value;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+
+    if (semaphore != VK_NULL_HANDLE) {
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &semaphore;
+    }
+
+    checkResult(
+        vkQueueSubmit(queue, 1, &submitInfo, batch.fence),
+        "failed to submit upload command buffer");
+
+    submittedValue = batch.value;
+    batch.end = head;
+    inFlight.push_back(batch);
+
+    copies.clear();
+    batchBytes = 0;
+}
+
+void UploadBatcher::retireOldest() {
+    Batch batch = inFlight.front();
+    inFlight.pop_front();
+
+    if (semaphore != VK_NULL_HANDLE) {
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &semaphore;
+        waitInfo.pValues = &batch.value;
+
+        checkResult(
+            vkWaitSemaphores(device, &waitInfo, UINT64_MAX),
+            "failed to wait for upload semaphore");
+    } else {
+        checkResult(
+            vkWaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX),
+            "failed to wait for upload fence");
+    }
+
+    tail = batch.end;
+    retiredValue = batch.value;
+    freeBatches.push_back(batch);
+}
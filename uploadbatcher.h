@@ -0,0 +1,133 @@
+#ifndef _UPLOAD_BATCHER_H
+#define _UPLOAD_BATCHER_H
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "memoryallocator.h"
+
+// Uploads buffer contents without a GPU round trip per buffer. Everything is written into
+// one persistently mapped staging ring, and the copies out of it are recorded into one
+// command buffer per batch, which is submitted once it's big enough (or on submit). Every
+// batch signals the next value of one timeline semaphore (or, on devices without them, its
+// own fence), so the ring only waits when it wraps around onto a batch that's still being
+// copied, and the caller can poll how far the copies have got. The batches can go to a transfer-only queue, what they wrote is
+// then released to the queue family that uses it, which has to acquire it. If the device
+// has host visible memory in its main device local heap (integrated GPUs, resizable BAR),
+// buffers are made there instead and written directly.
+// The ring is transient memory from the allocator, it's good until resetTransient is called
+// after the batcher is gone.
+class UploadBatcher {
+public:
+
+    static const VkDeviceSize RING_SIZE = 64 * 1024 * 1024;
+
+    // a batch is submitted once this much is staged, so the GPU copies while the next one is written
+    static const VkDeviceSize BATCH_SIZE = RING_SIZE / 4;
+
+    // writes size bytes, starting at offset into the data being uploaded, to dst
+    using Writer = std::function<void(char* dst, VkDeviceSize offset, VkDeviceSize size)>;
+
+    // queue and commandPool have to be from queueFamily, the buffers are used on dstQueueFamily.
+    // timelineSemaphores is whether the device has the feature enabled, without it the batches
+    // are tracked with fences.
+    UploadBatcher(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamily, VkCommandPool commandPool,
+        uint32_t dstQueueFamily, MemoryAllocator& allocator, bool timelineSemaphores);
+    ~UploadBatcher();
+
+    UploadBatcher(const UploadBatcher&) = delete;
+    UploadBatcher& operator=(const UploadBatcher&) = delete;
+
+    // what to make the destination buffers with, and they need TRANSFER_DST unless it's host visible
+    VkMemoryPropertyFlags getDestinationProperties() const;
+
+    // size bytes at dstOffset into dst (bound to dstAllocation), they can't be used until the
+    // semaphore reaches getReadyValue() and they've been acquired
+    void upload(VkBuffer dst, const MemoryAllocation& dstAllocation, VkDeviceSize dstOffset, VkDeviceSize size, const Writer& write);
+
+    void upload(VkBuffer dst, const MemoryAllocation& dstAllocation, VkDeviceSize dstOffset, VkDeviceSize size, const void* src);
+
+    // everything uploaded so far is in place once the semaphore reaches this
+    uint64_t getReadyValue() const;
+
+    // signalled by the batches as they finish, with 1, 2, 3... VK_NULL_HANDLE without timeline
+    // semaphores, getCompletedValue has then seen the fences, so a submit has nothing to wait for
+    VkSemaphore getSemaphore() const;
+
+    // how far the copies have got, without waiting (the batches that are done are retired)
+    uint64_t getCompletedValue();
+
+    // records the acquire half of the ownership transfers of every batch up to value (which has
+    // to be complete) into a command buffer of dstQueueFamily. Its submit has to wait for the
+    // semaphore (if there is one) to reach value, even when there's nothing to transfer, that's
+    // what makes the copies visible to it.
+    void acquire(VkCommandBuffer commandBuffer, uint64_t value);
+
+    // submits the batch being recorded, if anything was staged into it
+    void submit();
+
+    // submits the batch being recorded and waits for every batch to finish
+    void flush();
+
+private:
+
+    struct Batch {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        // only without timeline semaphores
+        VkFence fence = VK_NULL_HANDLE;
+        // what it signals
+        uint64_t value = 0;
+        // ring position (counted from the first byte ever written) up to which it reads
+        VkDeviceSize end = 0;
+    };
+
+    struct Copy {
+        VkBuffer dst;
+        VkBufferCopy region;
+    };
+
+    // written by the batch that signals value, released to dstQueueFamily and not acquired yet
+    struct Release {
+        uint64_t value;
+        VkBuffer buffer;
+        VkDeviceSize offset;
+        VkDeviceSize size;
+    };
+
+    VkDevice device;
+    VkQueue queue;
+    uint32_t queueFamily;
+    VkCommandPool commandPool;
+    uint32_t dstQueueFamily;
+
+    bool direct = false;
+
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    // signalled by the last batch submitted
+    uint64_t submittedValue = 0;
+    // of the last batch retired, which is as far as the fences tell without a semaphore
+    uint64_t retiredValue = 0;
+
+    VkBuffer ringBuffer = VK_NULL_HANDLE;
+    char* ringData = nullptr;
+
+    // positions only grow, the bytes between tail and head are still waiting to be copied
+    VkDeviceSize head = 0;
+    VkDeviceSize tail = 0;
+
+    // staged since the last submit, and the batches that are still being copied
+    std::vector<Copy> copies;
+    VkDeviceSize batchBytes = 0;
+    std::deque<Batch> inFlight;
+    std::vector<Batch> freeBatches;
+
+    std::deque<Release> releases;
+
+    VkDeviceSize allocate(VkDeviceSize size);
+    void retireOldest();
+};
+
+#endif // _UPLOAD_BATCHER_H
@@ -0,0 +1,252 @@
+#include "vertexkernels.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define VERTEX_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace {
+
+//----------------------------------------------------------------------
+// scalar
+
+void gatherFloat3Scalar(const char* src, uint32_t srcStride, uint32_t count, char* dst, size_t dstStride) {
+    for (uint32_t i = 0; i < count; i++) {
+        std::memcpy(dst, src, 3 * sizeof(float));
+        src += srcStride;
+        dst += dstStride;
+    }
+}
+
+void convertColorsScalar(const char* src, uint32_t srcStride, uint32_t count, char* dst, size_t dstStride) {
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t color;
+        std::memcpy(&color, src, sizeof(color));
+
+        // the leftmost channel is alpha, so ignoring that since we're just doing rgb colors
+        float rgb[3] = {
+            static_cast<float>((color >> 0) & 0xff) / 255.f,
+            static_cast<float>((color >> 8) & 0xff) / 255.f,
+            static_cast<float>((color >> 16) & 0xff) / 255.f
+        };
+
+        std::memcpy(dst, rgb, sizeof(rgb));
+
+        src += srcStride;
+        dst += dstStride;
+    }
+}
+
+void computeAABBScalar(const char* positions, size_t stride, size_t count, std::array<glm::vec3, 2>& aabb) {
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 pos;
+        std::memcpy(&pos, positions + i * stride, sizeof(pos));
+
+        aabb[0].x = std::min(aabb[0].x, pos.x);
+        aabb[0].y = std::min(aabb[0].y, pos.y);
+        aabb[0].z = std::min(aabb[0].z, pos.z);
+
+        aabb[1].x = std::max(aabb[1].x, pos.x);
+        aabb[1].y = std::max(aabb[1].y, pos.y);
+        aabb[1].z = std::max(aabb[1].z, pos.z);
+    }
+}
+
+#ifdef VERTEX_KERNELS_X86
+
+//----------------------------------------------------------------------
+// SSE2
+
+// A 16 byte load of a float3 reads 4 bytes past it. That stays inside the data for every
+// element but the last, so the vector loops leave the last one to the scalar code.
+inline size_t getVectorCount(size_t stride, size_t count) {
+    return stride >= 4 && count > 0 ? count - 1 : 0;
+}
+
+// writes the low three lanes, the fourth would land on the next member
+inline void storeFloat3(char* dst, __m128 value) {
+    _mm_storel_pi(reinterpret_cast<__m64*>(dst), value);
+    _mm_store_ss(reinterpret_cast<float*>(dst + 2 * sizeof(float)), _mm_movehl_ps(value, value));
+}
+
+void gatherFloat3SSE2(const char* src, uint32_t srcStride, uint32_t count, char* dst, size_t dstStride) {
+    uint32_t vectorCount = static_cast<uint32_t>(getVectorCount(srcStride, count));
+
+    for (uint32_t i = 0; i < vectorCount; i++) {
+        storeFloat3(dst, _mm_loadu_ps(reinterpret_cast<const float*>(src)));
+        src += srcStride;
+        dst += dstStride;
+    }
+
+    gatherFloat3Scalar(src, srcStride, count - vectorCount, dst, dstStride);
+}
+
+void convertColorsSSE2(const char* src, uint32_t srcStride, uint32_t count, char* dst, size_t dstStride) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scale = _mm_set1_ps(255.f);
+
+    for (uint32_t i = 0; i < count; i++) {
+        int32_t color;
+        std::memcpy(&color, src, sizeof(color));
+
+        // r g b a bytes -> four 32 bit lanes
+        __m128i channels = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(color), zero), zero);
+
+        // a divide rather than a multiply by 1 / 255, so it rounds like the scalar code
+        storeFloat3(dst, _mm_div_ps(_mm_cvtepi32_ps(channels), scale));
+
+        src += srcStride;
+        dst += dstStride;
+    }
+}
+
+// The operands are in this order so that a tie or a NaN keeps the value that's already
+// there, like std::min(aabb, pos) and std::max(aabb, pos) do.
+void computeAABBSSE2(const char* positions, size_t stride, size_t count, std::array<glm::vec3, 2>& aabb) {
+    __m128 minimum = _mm_setr_ps(aabb[0].x, aabb[0].y, aabb[0].z, 0.0f);
+    __m128 maximum = _mm_setr_ps(aabb[1].x, aabb[1].y, aabb[1].z, 0.0f);
+
+    size_t vectorCount = getVectorCount(stride, count);
+
+    // the fourth lane is whatever follows the position, it's thrown away at the end
+    for (size_t i = 0; i < vectorCount; i++) {
+        __m128 pos = _mm_loadu_ps(reinterpret_cast<const float*>(positions + i * stride));
+
+        minimum = _mm_min_ps(pos, minimum);
+        maximum = _mm_max_ps(pos, maximum);
+    }
+
+    storeFloat3(reinterpret_cast<char*>(&aabb[0].x), minimum);
+    storeFloat3(reinterpret_cast<char*>(&aabb[1].x), maximum);
+
+    computeAABBScalar(positions + vectorCount * stride, stride, count - vectorCount, aabb);
+}
+
+//----------------------------------------------------------------------
+// AVX2
+
+// two colors per iteration
+TARGET_AVX2 void convertColorsAVX2(const char* src, uint32_t srcStride, uint32_t count, char* dst, size_t dstStride) {
+    const __m256 scale = _mm256_set1_ps(255.f);
+
+    uint32_t i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        int32_t first;
+        int32_t second;
+        std::memcpy(&first, src, sizeof(first));
+        std::memcpy(&second, src + srcStride, sizeof(second));
+
+        __m256i channels = _mm256_cvtepu8_epi32(_mm_setr_epi32(first, second, 0, 0));
+        __m256 colors = _mm256_div_ps(_mm256_cvtepi32_ps(channels), scale);
+
+        storeFloat3(dst, _mm256_castps256_ps128(colors));
+        storeFloat3(dst + dstStride, _mm256_extractf128_ps(colors, 1));
+
+        src += 2 * static_cast<size_t>(srcStride);
+        dst += 2 * dstStride;
+    }
+
+    convertColorsSSE2(src, srcStride, count - i, dst, dstStride);
+}
+
+// two vertices per iteration, one in each half
+TARGET_AVX2 void computeAABBAVX2(const char* positions, size_t stride, size_t count, std::array<glm::vec3, 2>& aabb) {
+    __m256 minimum = _mm256_castps128_ps256(_mm_setr_ps(aabb[0].x, aabb[0].y, aabb[0].z, 0.0f));
+    minimum = _mm256_insertf128_ps(minimum, _mm256_castps256_ps128(minimum), 1);
+
+    __m256 maximum = _mm256_castps128_ps256(_mm_setr_ps(aabb[1].x, aabb[1].y, aabb[1].z, 0.0f));
+    maximum = _mm256_insertf128_ps(maximum, _mm256_castps256_ps128(maximum), 1);
+
+    size_t vectorCount = getVectorCount(stride, count);
+    size_t i = 0;
+
+    for (; i + 2 <= vectorCount; i += 2) {
+        __m256 pos = _mm256_castps128_ps256(_mm_loadu_ps(reinterpret_cast<const float*>(positions + i * stride)));
+        pos = _mm256_insertf128_ps(pos, _mm_loadu_ps(reinterpret_cast<const float*>(positions + (i + 1) * stride)), 1);
+
+        minimum = _mm256_min_ps(pos, minimum);
+        maximum = _mm256_max_ps(pos, maximum);
+    }
+
+    // fold the odd vertices into the even ones
+    __m128 lowMinimum = _mm_min_ps(_mm256_extractf128_ps(minimum, 1), _mm256_castps256_ps128(minimum));
+    __m128 lowMaximum = _mm_max_ps(_mm256_extractf128_ps(maximum, 1), _mm256_castps256_ps128(maximum));
+
+    storeFloat3(reinterpret_cast<char*>(&aabb[0].x), lowMinimum);
+    storeFloat3(reinterpret_cast<char*>(&aabb[1].x), lowMaximum);
+
+    computeAABBSSE2(positions + i * stride, stride, count - i, aabb);
+}
+
+#endif
+
+} // namespace
+
+VertexKernels::Kernel VertexKernels::getKernel() {
+    static const Kernel kernel = JsonIndex::detectKernel();
+
+    return kernel;
+}
+
+void VertexKernels::gatherFloat3(Kernel kernel, const char* src, uint32_t srcStride, uint32_t count, char* dst, size_t dstStride) {
+#ifdef VERTEX_KERNELS_X86
+    // three floats don't fill a 256 bit register any better, so AVX2 uses the SSE2 loop too
+    if (kernel == Kernel::AVX2 || kernel == Kernel::SSE2) {
+        gatherFloat3SSE2(src, srcStride, count, dst, dstStride);
+        return;
+    }
+#endif
+
+    gatherFloat3Scalar(src, srcStride, count, dst, dstStride);
+}
+
+void VertexKernels::convertColors(Kernel kernel, const char* src, uint32_t srcStride, uint32_t count, char* dst, size_t dstStride) {
+#ifdef VERTEX_KERNELS_X86
+    if (kernel == Kernel::AVX2) {
+        convertColorsAVX2(src, srcStride, count, dst, dstStride);
+        return;
+    }
+
+    if (kernel == Kernel::SSE2) {
+        convertColorsSSE2(src, srcStride, count, dst, dstStride);
+        return;
+    }
+#endif
+
+    convertColorsScalar(src, srcStride, count, dst, dstStride);
+}
+
+std::array<glm::vec3, 2> VertexKernels::computeAABB(Kernel kernel, const char* positions, size_t stride, size_t count) {
+    std::array<glm::vec3, 2> aabb;
+
+    // lowest() rather than min(), which is the smallest positive float
+    aabb[0] = glm::vec3(std::numeric_limits<float>::max());
+    aabb[1] = glm::vec3(std::numeric_limits<float>::lowest());
+
+#ifdef VERTEX_KERNELS_X86
+    if (kernel == Kernel::AVX2) {
+        computeAABBAVX2(positions, stride, count, aabb);
+        return aabb;
+    }
+
+    if (kernel == Kernel::SSE2) {
+        computeAABBSSE2(positions, stride, count, aabb);
+        return aabb;
+    }
+#endif
+
+    computeAABBScalar(positions, stride, count, aabb);
+
+    return aabb;
+}
@@ -0,0 +1,35 @@
+#ifndef _VERTEX_KERNELS_H
+#define _VERTEX_KERNELS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "jsonindex.h"
+#include "scene.h"
+
+// The loops that turn .b72 data into Vertex arrays and bound the positions of a mesh,
+// with SSE2 and AVX2 versions that are picked at runtime by the same CPU check as the
+// JSON index. Every kernel writes exactly what the scalar one does (the AABB only up to
+// the sign of a zero). Source and destination are both strided, so the same kernels
+// work on any VertexLayout.
+class VertexKernels {
+public:
+
+    using Kernel = JsonIndex::Kernel;
+
+    // the fastest kernel this CPU supports, detected once
+    static Kernel getKernel();
+
+    // copies count float3s that are srcStride bytes apart to dst, dstStride bytes apart
+    static void gatherFloat3(Kernel kernel, const char* src, uint32_t srcStride, uint32_t count, char* dst, size_t dstStride);
+
+    // turns count RGBA8_UNORM colors that are srcStride bytes apart into float3s at dst, alpha is dropped
+    static void convertColors(Kernel kernel, const char* src, uint32_t srcStride, uint32_t count, char* dst, size_t dstStride);
+
+    // min and max corner of count float3 positions that are stride bytes apart,
+    // { max float, lowest float } if there aren't any
+    static std::array<glm::vec3, 2> computeAABB(Kernel kernel, const char* positions, size_t stride, size_t count);
+};
+
+#endif // _VERTEX_KERNELS_H
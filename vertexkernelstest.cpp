@@ -0,0 +1,258 @@
+// Checks every VertexKernels kernel this CPU supports against the scalar one. gatherFloat3
+// and convertColors have to write exactly the same bytes (and nothing between the destination
+// elements), and computeAABB the same corners, up to the sign of a zero. The inputs cover
+// every stride from a packed float3 up to 64 bytes, the counts around the vector widths, and
+// positions that are all negative or all positive, so a wrong starting corner shows up.
+//
+// usage: vertexkernelstest [--seed <seed>]
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "vertexkernels.h"
+
+namespace {
+
+using Kernel = VertexKernels::Kernel;
+
+const uint32_t MAX_COUNT = 100;
+const uint32_t MAX_STRIDE = 64;
+const size_t DST_STRIDES[] = { 12, 16, 20, 28, 32, 44 };
+
+// what the destination is filled with first, so stray writes show up
+const unsigned char SENTINEL = 0xAB;
+
+enum class Values {
+    MIXED,
+    NEGATIVE,
+    POSITIVE,
+    SPECIAL // zeros of both signs, infinities and NaNs mixed in
+};
+
+const char* getValuesName(Values values) {
+    switch (values) {
+        case Values::NEGATIVE:
+            return "negative";
+        case Values::POSITIVE:
+            return "positive";
+        case Values::SPECIAL:
+            return "special";
+        default:
+            return "mixed";
+    }
+}
+
+std::vector<Kernel> getSupportedKernels() {
+    std::vector<Kernel> kernels;
+    Kernel best = VertexKernels::getKernel();
+
+    if (best == Kernel::SSE2 || best == Kernel::AVX2) {
+        kernels.push_back(Kernel::SSE2);
+    }
+
+    if (best == Kernel::AVX2) {
+        kernels.push_back(Kernel::AVX2);
+    }
+
+    return kernels;
+}
+
+float randomFloat(Values values, std::mt19937& rng) {
+    std::uniform_real_distribution<float> magnitude(1e-3f, 1e4f);
+
+    switch (values) {
+        case Values::NEGATIVE:
+            return -magnitude(rng);
+        case Values::POSITIVE:
+            return magnitude(rng);
+        case Values::SPECIAL: {
+            static const float SPECIALS[] = {
+                0.0f, -0.0f, std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+                std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest()
+            };
+
+            if (rng() % 2 == 0) {
+                return SPECIALS[rng() % (sizeof(SPECIALS) / sizeof(SPECIALS[0]))];
+            }
+
+            return rng() % 2 == 0 ? magnitude(rng) : -magnitude(rng);
+        }
+        default:
+            return rng() % 2 == 0 ? magnitude(rng) : -magnitude(rng);
+    }
+}
+
+// exactly count elements, so reading past the last one is caught by a sanitizer
+std::vector<char> makePositions(uint32_t stride, uint32_t count, Values values, std::mt19937& rng) {
+    std::vector<char> data(count == 0 ? 0 : static_cast<size_t>(stride) * (count - 1) + 3 * sizeof(float));
+
+    for (char& c : data) {
+        c = static_cast<char>(rng());
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        for (uint32_t j = 0; j < 3; j++) {
+            float value = randomFloat(values, rng);
+            std::memcpy(data.data() + static_cast<size_t>(i) * stride + j * sizeof(float), &value, sizeof(value));
+        }
+    }
+
+    return data;
+}
+
+std::vector<char> makeColors(uint32_t stride, uint32_t count, std::mt19937& rng) {
+    std::vector<char> data(count == 0 ? 0 : static_cast<size_t>(stride) * (count - 1) + 4);
+
+    for (char& c : data) {
+        c = static_cast<char>(rng());
+    }
+
+    return data;
+}
+
+bool sameFloat(float a, float b) {
+    return a == b || (std::isnan(a) && std::isnan(b));
+}
+
+bool sameAABB(const std::array<glm::vec3, 2>& a, const std::array<glm::vec3, 2>& b) {
+    for (int corner = 0; corner < 2; corner++) {
+        for (int axis = 0; axis < 3; axis++) {
+            if (!sameFloat(a[corner][axis], b[corner][axis])) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+uint32_t failures = 0;
+
+void fail(const std::string& function, Kernel kernel, uint32_t stride, uint32_t count, const std::string& detail) {
+    if (failures < 20) {
+        std::cout << "MISMATCH " << function << " (" << JsonIndex::getKernelName(kernel) << ") stride " << stride
+            << " count " << count << ": " << detail << std::endl;
+    }
+
+    failures++;
+}
+
+void checkGather(Kernel kernel, const std::vector<char>& src, uint32_t stride, uint32_t count, size_t dstStride) {
+    std::vector<char> expected(dstStride * (count + 1), static_cast<char>(SENTINEL));
+    std::vector<char> result(expected.size(), static_cast<char>(SENTINEL));
+
+    VertexKernels::gatherFloat3(Kernel::SCALAR, src.data(), stride, count, expected.data(), dstStride);
+    VertexKernels::gatherFloat3(kernel, src.data(), stride, count, result.data(), dstStride);
+
+    if (expected != result) {
+        fail("gatherFloat3", kernel, stride, count, "dst stride " + std::to_string(dstStride));
+    }
+}
+
+void checkColors(Kernel kernel, const std::vector<char>& src, uint32_t stride, uint32_t count, size_t dstStride) {
+    std::vector<char> expected(dstStride * (count + 1), static_cast<char>(SENTINEL));
+    std::vector<char> result(expected.size(), static_cast<char>(SENTINEL));
+
+    VertexKernels::convertColors(Kernel::SCALAR, src.data(), stride, count, expected.data(), dstStride);
+    VertexKernels::convertColors(kernel, src.data(), stride, count, result.data(), dstStride);
+
+    if (expected != result) {
+        fail("convertColors", kernel, stride, count, "dst stride " + std::to_string(dstStride));
+    }
+}
+
+void checkAABB(Kernel kernel, const std::vector<char>& positions, uint32_t stride, uint32_t count, Values values) {
+    std::array<glm::vec3, 2> expected = VertexKernels::computeAABB(Kernel::SCALAR, positions.data(), stride, count);
+    std::array<glm::vec3, 2> result = VertexKernels::computeAABB(kernel, positions.data(), stride, count);
+
+    if (!sameAABB(expected, result)) {
+        fail("computeAABB", kernel, stride, count, std::string(getValuesName(values)) + " values");
+    }
+}
+
+// the scalar kernel itself, on positions where the answer is known
+void checkScalarAABB() {
+    float negative[] = { -3.0f, -2.0f, -1.0f, -6.0f, -5.0f, -4.0f };
+    std::array<glm::vec3, 2> aabb = VertexKernels::computeAABB(Kernel::SCALAR, reinterpret_cast<const char*>(negative), 3 * sizeof(float), 2);
+
+    if (aabb[0] != glm::vec3(-6.0f, -5.0f, -4.0f) || aabb[1] != glm::vec3(-3.0f, -2.0f, -1.0f)) {
+        fail("computeAABB", Kernel::SCALAR, 12, 2, "wrong corners for all negative positions");
+    }
+
+    aabb = VertexKernels::computeAABB(Kernel::SCALAR, nullptr, 3 * sizeof(float), 0);
+
+    if (aabb[0] != glm::vec3(std::numeric_limits<float>::max()) || aabb[1] != glm::vec3(std::numeric_limits<float>::lowest())) {
+        fail("computeAABB", Kernel::SCALAR, 12, 0, "wrong corners without any positions");
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    uint32_t seed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--seed" && i + 1 < argc) {
+            seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else {
+            std::cerr << "usage: vertexkernelstest [--seed <seed>]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::mt19937 rng(seed);
+
+    checkScalarAABB();
+
+    std::vector<Kernel> kernels = getSupportedKernels();
+
+    std::cout << "Comparing the scalar vertex kernels against";
+    for (Kernel kernel : kernels) {
+        std::cout << " " << JsonIndex::getKernelName(kernel);
+    }
+    if (kernels.empty()) {
+        std::cout << " nothing, this CPU only has the scalar ones";
+    }
+    std::cout << std::endl;
+
+    uint32_t checks = 0;
+
+    for (Kernel kernel : kernels) {
+        for (uint32_t stride = 3 * sizeof(float); stride <= MAX_STRIDE; stride++) {
+            for (uint32_t count = 0; count <= MAX_COUNT; count++) {
+                size_t dstStride = DST_STRIDES[rng() % (sizeof(DST_STRIDES) / sizeof(DST_STRIDES[0]))];
+
+                for (Values values : { Values::MIXED, Values::NEGATIVE, Values::POSITIVE, Values::SPECIAL }) {
+                    std::vector<char> positions = makePositions(stride, count, values, rng);
+
+                    checkGather(kernel, positions, stride, count, dstStride);
+                    checkAABB(kernel, positions, stride, count, values);
+                    checks += 2;
+                }
+            }
+        }
+
+        // colors are 4 bytes, so they can be packed tighter than positions
+        for (uint32_t stride = 4; stride <= MAX_STRIDE; stride++) {
+            for (uint32_t count = 0; count <= MAX_COUNT; count++) {
+                size_t dstStride = DST_STRIDES[rng() % (sizeof(DST_STRIDES) / sizeof(DST_STRIDES[0]))];
+
+                checkColors(kernel, makeColors(stride, count, rng), stride, count, dstStride);
+                checks++;
+            }
+        }
+    }
+
+    std::cout << checks << " checks, " << failures << " mismatches" << std::endl;
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
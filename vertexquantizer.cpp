@@ -0,0 +1,153 @@
+#include "vertexquantizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+struct QuantizedVertex {
+    uint16_t pos[4];
+    int16_t normal[2];
+    uint8_t color[4];
+};
+
+static_assert(sizeof(QuantizedVertex) == 16, "the quantized layout is 16 bytes");
+
+uint16_t toUnorm16(float value) {
+    return static_cast<uint16_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+int16_t toSnorm16(float value) {
+    return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+float signNotZero(float value) {
+    return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+// the normal is projected onto the octahedron |x| + |y| + |z| = 1, and the lower half is folded over the upper
+void encodeOctahedral(glm::vec3 n, int16_t out[2]) {
+    float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+
+    // a zero normal comes back as +z
+    if (sum == 0.0f) {
+        out[0] = 0;
+        out[1] = 0;
+        return;
+    }
+
+    n /= sum;
+
+    float x = n.x;
+    float y = n.y;
+
+    if (n.z < 0.0f) {
+        x = (1.0f - std::abs(n.y)) * signNotZero(n.x);
+        y = (1.0f - std::abs(n.x)) * signNotZero(n.y);
+    }
+
+    out[0] = toSnorm16(x);
+    out[1] = toSnorm16(y);
+}
+
+glm::vec3 readFloat3(const char* src) {
+    glm::vec3 value;
+    std::memcpy(&value, src, sizeof(value));
+
+    return value;
+}
+
+} // namespace
+
+VertexLayout VertexQuantizer::getQuantizedLayout() {
+    VertexLayout layout;
+
+    layout.stride = sizeof(QuantizedVertex);
+    layout.formats = { VK_FORMAT_R16G16B16A16_UNORM, VK_FORMAT_R16G16_SNORM, VK_FORMAT_R8G8B8A8_UNORM };
+    layout.offsets = { offsetof(QuantizedVertex, pos), offsetof(QuantizedVertex, normal), offsetof(QuantizedVertex, color) };
+
+    return layout;
+}
+
+bool VertexQuantizer::isQuantized(const VertexLayout& layout) {
+    return layout.formats[0] == VK_FORMAT_R16G16B16A16_UNORM;
+}
+
+void VertexQuantizer::quantize(Mesh& mesh) {
+    const VertexLayout& layout = mesh.layout;
+
+    if (mesh.mappedVertices != nullptr) {
+        throw std::runtime_error("The vertices of mesh " + mesh.name + " have to be copied out of their file to be quantized");
+    }
+
+    if (layout.formats[0] != VK_FORMAT_R32G32B32_SFLOAT || layout.formats[1] != VK_FORMAT_R32G32B32_SFLOAT
+        || (layout.formats[2] != VK_FORMAT_R32G32B32_SFLOAT && layout.formats[2] != VK_FORMAT_R8G8B8A8_UNORM)) {
+        throw std::runtime_error("Mesh " + mesh.name + " has a vertex layout that can't be quantized");
+    }
+
+    std::array<glm::vec4, 2> dequantization = getDequantization(mesh.aabb);
+    glm::vec3 minimum(dequantization[0]);
+    glm::vec3 extent(dequantization[1]);
+
+    // a flat mesh has no extent along one axis, everything on it is at the minimum
+    glm::vec3 scale(
+        extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+        extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+        extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+    std::vector<char> vertexData(static_cast<size_t>(mesh.vertexDataCount) * sizeof(QuantizedVertex));
+
+    for (uint32_t i = 0; i < mesh.vertexDataCount; i++) {
+        const char* src = mesh.vertexData.data() + static_cast<size_t>(i) * layout.stride;
+        QuantizedVertex vertex{};
+
+        glm::vec3 pos = (readFloat3(src + layout.offsets[0]) - minimum) * scale;
+
+        vertex.pos[0] = toUnorm16(pos.x);
+        vertex.pos[1] = toUnorm16(pos.y);
+        vertex.pos[2] = toUnorm16(pos.z);
+
+        encodeOctahedral(readFloat3(src + layout.offsets[1]), vertex.normal);
+
+        if (layout.formats[2] == VK_FORMAT_R8G8B8A8_UNORM) {
+            std::memcpy(vertex.color, src + layout.offsets[2], sizeof(vertex.color));
+        } else {
+            // decoded colors were divided by 255, so this gets the bytes back exactly
+            glm::vec3 color = readFloat3(src + layout.offsets[2]);
+
+            vertex.color[0] = static_cast<uint8_t>(std::lround(std::clamp(color.r, 0.0f, 1.0f) * 255.0f));
+            vertex.color[1] = static_cast<uint8_t>(std::lround(std::clamp(color.g, 0.0f, 1.0f) * 255.0f));
+            vertex.color[2] = static_cast<uint8_t>(std::lround(std::clamp(color.b, 0.0f, 1.0f) * 255.0f));
+            vertex.color[3] = 255;
+        }
+
+        std::memcpy(vertexData.data() + static_cast<size_t>(i) * sizeof(QuantizedVertex), &vertex, sizeof(vertex));
+    }
+
+    mesh.vertexData = std::move(vertexData);
+    mesh.layout = getQuantizedLayout();
+}
+
+std::array<glm::vec4, 2> VertexQuantizer::getDequantization(const std::array<glm::vec3, 2>& aabb) {
+    // an empty mesh has an inside out AABB
+    if (aabb[0].x > aabb[1].x || aabb[0].y > aabb[1].y || aabb[0].z > aabb[1].z) {
+        return { glm::vec4(0.0f), glm::vec4(0.0f) };
+    }
+
+    return { glm::vec4(aabb[0], 0.0f), glm::vec4(aabb[1] - aabb[0], 0.0f) };
+}
+
+glm::vec3 VertexQuantizer::decodeOctahedral(int16_t x, int16_t y) {
+    // snorm16 turns -32768 into -1 as well
+    glm::vec3 n(std::max(x / 32767.0f, -1.0f), std::max(y / 32767.0f, -1.0f), 0.0f);
+    n.z = 1.0f - std::abs(n.x) - std::abs(n.y);
+
+    float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+
+    return glm::normalize(n);
+}
@@ -0,0 +1,32 @@
+#ifndef _VERTEX_QUANTIZER_H
+#define _VERTEX_QUANTIZER_H
+
+#include <array>
+#include <cstdint>
+
+#include "scene.h"
+
+// Packs the vertices of a mesh into 16 bytes each, for scenes too big to keep float
+// vertices for:
+//   POSITION  R16G16B16A16_UNORM  relative to the mesh's AABB, w is unused
+//   NORMAL    R16G16_SNORM        octahedral encoding
+//   COLOR     R8G8B8A8_UNORM
+// shader_quantized.vert undoes it, with the AABB in the push constants.
+class VertexQuantizer {
+public:
+
+    static VertexLayout getQuantizedLayout();
+
+    static bool isQuantized(const VertexLayout& layout);
+
+    // the vertices have to be copied out of the file, with float positions and normals, and mesh.aabb computed
+    static void quantize(Mesh& mesh);
+
+    // what the shader multiplies the unorm position by and adds to it, { min, max - min } of the AABB
+    static std::array<glm::vec4, 2> getDequantization(const std::array<glm::vec3, 2>& aabb);
+
+    // the same math as the shader, for checking
+    static glm::vec3 decodeOctahedral(int16_t x, int16_t y);
+};
+
+#endif // _VERTEX_QUANTIZER_H
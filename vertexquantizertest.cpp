@@ -0,0 +1,274 @@
+// Checks that VertexQuantizer round trips vertices as well as it has to. Meshes in the native
+// .b72 layout (RGBA8 colors) and the decoded one (float colors) are quantized and then decoded
+// the way shader_quantized.vert does it:
+//   positions have to come back within half a step (1/65535 of the AABB extent, per axis),
+//   normals within MAX_NORMAL_ERROR radians,
+//   colors with exactly the bytes they started from.
+//
+// usage: vertexquantizertest [--seed <seed>]
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "vertexquantizer.h"
+
+namespace {
+
+const uint32_t MESH_COUNT = 200;
+const uint32_t VERTEX_COUNT = 1000;
+
+// a snorm16 step is 1/32767 on the octahedron, which is at most about 1e-4 radians on the sphere
+const double MAX_NORMAL_ERROR = 1e-4;
+
+// a native .b72 record, with the color still in bytes
+struct NativeVertex {
+    glm::vec3 pos;
+    glm::vec3 normal;
+    uint8_t color[4];
+};
+
+static_assert(sizeof(NativeVertex) == 28, "the native layout is 28 bytes");
+
+VertexLayout getNativeLayout() {
+    VertexLayout layout;
+
+    layout.stride = sizeof(NativeVertex);
+    layout.formats = { VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R8G8B8A8_UNORM };
+    layout.offsets = { offsetof(NativeVertex, pos), offsetof(NativeVertex, normal), offsetof(NativeVertex, color) };
+
+    return layout;
+}
+
+struct Original {
+    glm::vec3 pos;
+    glm::vec3 normal;
+    uint8_t color[4];
+};
+
+glm::vec3 randomNormal(std::mt19937& rng) {
+    std::normal_distribution<float> gaussian;
+
+    // the axes, and the edges and corners of the octahedron, are where the folding goes wrong
+    static const glm::vec3 SPECIALS[] = {
+        { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f },
+        { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 1.0f, 0.0f }, { -1.0f, 1.0f, 0.0f },
+        { 1.0f, -1.0f, 0.0f }, { -1.0f, -1.0f, 0.0f }, { 1.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, -1.0f },
+        { 1.0f, 1.0f, 1.0f }, { -1.0f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }, { 1e-6f, 0.0f, -1.0f }
+    };
+
+    if (rng() % 8 == 0) {
+        return glm::normalize(SPECIALS[rng() % (sizeof(SPECIALS) / sizeof(SPECIALS[0]))]);
+    }
+
+    glm::vec3 n(gaussian(rng), gaussian(rng), gaussian(rng));
+
+    // normals in files aren't always unit length
+    return glm::normalize(n) * std::uniform_real_distribution<float>(0.5f, 2.0f)(rng);
+}
+
+// random vertices in a random box, some of them flat along an axis
+std::vector<Original> makeVertices(std::mt19937& rng) {
+    std::uniform_real_distribution<float> center(-1000.0f, 1000.0f);
+    std::uniform_real_distribution<float> exponent(-3.0f, 3.0f);
+
+    glm::vec3 origin(center(rng), center(rng), center(rng));
+    glm::vec3 size(std::pow(10.0f, exponent(rng)), std::pow(10.0f, exponent(rng)), std::pow(10.0f, exponent(rng)));
+
+    if (rng() % 10 == 0) {
+        size[rng() % 3] = 0.0f;
+    }
+
+    std::vector<Original> vertices(VERTEX_COUNT);
+
+    for (Original& vertex : vertices) {
+        for (int axis = 0; axis < 3; axis++) {
+            vertex.pos[axis] = origin[axis] + std::uniform_real_distribution<float>(0.0f, 1.0f)(rng) * size[axis];
+        }
+
+        vertex.normal = randomNormal(rng);
+
+        for (uint8_t& c : vertex.color) {
+            c = static_cast<uint8_t>(rng());
+        }
+    }
+
+    return vertices;
+}
+
+Mesh makeMesh(const std::vector<Original>& vertices, bool native) {
+    Mesh mesh;
+
+    mesh.name = native ? "native" : "decoded";
+    mesh.layout = native ? getNativeLayout() : VertexLayout::getDecoded();
+    mesh.vertexDataCount = static_cast<uint32_t>(vertices.size());
+    mesh.vertexData.resize(static_cast<size_t>(mesh.vertexDataCount) * mesh.layout.stride);
+
+    mesh.aabb[0] = glm::vec3(std::numeric_limits<float>::max());
+    mesh.aabb[1] = glm::vec3(std::numeric_limits<float>::lowest());
+
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const Original& vertex = vertices[i];
+        char* dst = mesh.vertexData.data() + i * mesh.layout.stride;
+
+        if (native) {
+            NativeVertex record;
+            record.pos = vertex.pos;
+            record.normal = vertex.normal;
+            std::memcpy(record.color, vertex.color, sizeof(record.color));
+            std::memcpy(dst, &record, sizeof(record));
+        } else {
+            // the way convertColors decodes them
+            Vertex record;
+            record.pos = vertex.pos;
+            record.normal = vertex.normal;
+            record.color = glm::vec3(vertex.color[0], vertex.color[1], vertex.color[2]) / 255.0f;
+            std::memcpy(dst, &record, sizeof(record));
+        }
+
+        mesh.aabb[0] = glm::min(mesh.aabb[0], vertex.pos);
+        mesh.aabb[1] = glm::max(mesh.aabb[1], vertex.pos);
+    }
+
+    return mesh;
+}
+
+double getAngle(glm::vec3 a, glm::vec3 b) {
+    glm::dvec3 u = glm::normalize(glm::dvec3(a));
+    glm::dvec3 v = glm::normalize(glm::dvec3(b));
+
+    // better conditioned than acos for nearly equal directions
+    return std::atan2(glm::length(glm::cross(u, v)), glm::dot(u, v));
+}
+
+uint32_t failures = 0;
+
+void fail(const Mesh& mesh, size_t vertex, const std::string& detail) {
+    if (failures < 20) {
+        std::cout << "MISMATCH " << mesh.name << " vertex " << vertex << ": " << detail << std::endl;
+    }
+
+    failures++;
+}
+
+struct Errors {
+    double position = 0.0; // of what's allowed
+    double normal = 0.0;   // in radians
+};
+
+void checkMesh(const std::vector<Original>& vertices, bool native, Errors& errors) {
+    Mesh mesh = makeMesh(vertices, native);
+    std::array<glm::vec4, 2> dequantization = VertexQuantizer::getDequantization(mesh.aabb);
+
+    VertexQuantizer::quantize(mesh);
+
+    const VertexLayout& layout = mesh.layout;
+
+    if (!VertexQuantizer::isQuantized(layout) || layout.stride != 16 || mesh.vertexData.size() != vertices.size() * layout.stride) {
+        fail(mesh, 0, "not in the quantized layout");
+        return;
+    }
+
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const Original& vertex = vertices[i];
+        const char* src = mesh.vertexData.data() + i * layout.stride;
+
+        uint16_t pos[4];
+        int16_t normal[2];
+        uint8_t color[4];
+        std::memcpy(pos, src + layout.offsets[0], sizeof(pos));
+        std::memcpy(normal, src + layout.offsets[1], sizeof(normal));
+        std::memcpy(color, src + layout.offsets[2], sizeof(color));
+
+        for (int axis = 0; axis < 3; axis++) {
+            float extent = dequantization[1][axis];
+            float decoded = dequantization[0][axis] + (pos[axis] / 65535.0f) * extent;
+            double error = std::abs(static_cast<double>(decoded) - vertex.pos[axis]);
+
+            // plus what float rounding can add to the dequantization at this magnitude
+            float magnitude = std::max(std::abs(mesh.aabb[0][axis]), std::abs(mesh.aabb[1][axis]));
+            double allowed = 0.5 * extent / 65535.0 + 4.0 * std::numeric_limits<float>::epsilon() * magnitude;
+
+            if (allowed > 0.0) {
+                errors.position = std::max(errors.position, error / allowed);
+            }
+
+            if (error > allowed) {
+                fail(mesh, i, "position axis " + std::to_string(axis) + " is off by " + std::to_string(error)
+                    + ", more than half a step (" + std::to_string(allowed) + ")");
+            }
+        }
+
+        double angle = getAngle(vertex.normal, VertexQuantizer::decodeOctahedral(normal[0], normal[1]));
+        errors.normal = std::max(errors.normal, angle);
+
+        if (!(angle <= MAX_NORMAL_ERROR)) {
+            fail(mesh, i, "normal is off by " + std::to_string(angle) + " radians");
+        }
+
+        uint8_t expected[4] = { vertex.color[0], vertex.color[1], vertex.color[2], native ? vertex.color[3] : uint8_t(255) };
+
+        if (std::memcmp(color, expected, sizeof(color)) != 0) {
+            fail(mesh, i, "color bytes changed");
+        }
+    }
+}
+
+// a mesh without normals has zeros for them, which have to come back as +z
+void checkZeroNormal() {
+    std::vector<Original> vertices(1);
+    vertices[0].pos = glm::vec3(1.0f, 2.0f, 3.0f);
+    vertices[0].normal = glm::vec3(0.0f);
+    std::memset(vertices[0].color, 0, sizeof(vertices[0].color));
+
+    Mesh mesh = makeMesh(vertices, true);
+    VertexQuantizer::quantize(mesh);
+
+    int16_t normal[2];
+    std::memcpy(normal, mesh.vertexData.data() + mesh.layout.offsets[1], sizeof(normal));
+
+    if (VertexQuantizer::decodeOctahedral(normal[0], normal[1]) != glm::vec3(0.0f, 0.0f, 1.0f)) {
+        fail(mesh, 0, "a zero normal doesn't come back as +z");
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    uint32_t seed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--seed" && i + 1 < argc) {
+            seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else {
+            std::cerr << "usage: vertexquantizertest [--seed <seed>]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::mt19937 rng(seed);
+    Errors errors;
+
+    checkZeroNormal();
+
+    for (uint32_t i = 0; i < MESH_COUNT; i++) {
+        std::vector<Original> vertices = makeVertices(rng);
+
+        checkMesh(vertices, true, errors);
+        checkMesh(vertices, false, errors);
+    }
+
+    std::cout << 2 * MESH_COUNT * VERTEX_COUNT << " vertices, worst position error " << errors.position << " of the allowed, worst normal error "
+        << errors.normal << " radians, " << failures << " mismatches" << std::endl;
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}